@@ -0,0 +1,531 @@
+#include "StdAfx.h"
+#include "ClassificationServer.h"
+
+#ifndef _WIN32
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+using namespace std;
+using boost::lexical_cast;
+
+// Lotes completos que pueden esperar antes de que la lectura se detenga
+const size_t queuedBatches = 4;
+
+// Tamano de las lecturas de cada conexion del socket
+const size_t socketBlockSize = 1 << 16;
+
+// Posiciones de la lista de poll antes de los clientes: el socket que acepta conexiones
+// y la tuberia con la que el hilo de los lotes despierta al ciclo
+const size_t firstClient = 2;
+
+/** Destino de las respuestas: un flujo de salida o una conexion del socket. Solo el hilo
+    de los lotes agrega respuestas. El socket no bloquea: lo que no se puede escribir queda
+	en Unsent y lo envia el ciclo del socket cuando la conexion admite mas datos. El socket
+	se cierra al liberarse la ultima referencia
+*/
+struct ClassificationServer::TClient
+{
+	ostream* Output;
+	int Socket;
+	size_t MaxUnsent;
+	// respuestas del lote en curso
+	string Reply;
+	// protege Unsent y Broken, que comparten el hilo de los lotes y el ciclo del socket
+	std::mutex Lock;
+	// respuestas que el socket aun no acepto
+	string Unsent;
+	// el cliente cerro la conexion o no lee sus respuestas, se descartan
+	bool Broken;
+
+	TClient(ostream* output, int socket, size_t maxUnsent)
+		: Output(output), Socket(socket), MaxUnsent(maxUnsent), Broken(false)
+	{
+	}
+
+	~TClient()
+	{
+#ifndef _WIN32
+		if(Socket >= 0) close(Socket);
+#endif
+	}
+
+	void Flush()
+	{
+		if(Output != NULL)
+		{
+			Output->write(Reply.data(), Reply.size());
+			Output->flush();
+			if(!*Output) throw runtime_error("Error escribiendo las respuestas");
+		}
+#ifndef _WIN32
+		else
+		{
+			lock_guard<std::mutex> lock(Lock);
+			if(!Broken)
+			{
+				Unsent += Reply;
+				Send();
+				// un cliente que no lee sus respuestas no debe acumularlas sin limite
+				if(Unsent.size() > MaxUnsent) Drop();
+			}
+		}
+#endif
+		Reply.clear();
+	}
+
+#ifndef _WIN32
+	/** Escribe en el socket lo que acepte de Unsent sin esperar. Requiere Lock
+	*/
+	void Send()
+	{
+		size_t sent = 0;
+		while(!Broken && sent < Unsent.size())
+		{
+			ssize_t written = write(Socket, Unsent.data() + sent, Unsent.size() - sent);
+			if(written < 0 && errno == EINTR) continue;
+			if(written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+			if(written < 0) Drop();
+			else sent += (size_t)written;
+		}
+		Unsent.erase(0, sent);
+	}
+
+	/** Descarta las respuestas del cliente. Requiere Lock
+	*/
+	void Drop()
+	{
+		Broken = true;
+		Unsent.clear();
+	}
+
+	void Drain()
+	{
+		lock_guard<std::mutex> lock(Lock);
+		Send();
+	}
+
+	void Close()
+	{
+		lock_guard<std::mutex> lock(Lock);
+		Drop();
+	}
+
+	bool IsBroken()
+	{
+		lock_guard<std::mutex> lock(Lock);
+		return Broken;
+	}
+
+	bool HasUnsent()
+	{
+		lock_guard<std::mutex> lock(Lock);
+		return !Unsent.empty();
+	}
+#endif
+};
+
+bool _isRequestBlank(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+/** Interpreta una linea "longitud s1 ... sn". Retorna el motivo si la linea no es valida
+*/
+string _parseRequest(const char* line, size_t size, unsigned alphabetLength, SampleSet::TSample& sample)
+{
+	const char* p = line;
+	const char* end = line + size;
+	sample.clear();
+	auto next = [&](unsigned long long& value) -> bool
+	{
+		while(p < end && _isRequestBlank(*p)) p++;
+		if(p == end || *p < '0' || *p > '9') return false;
+		value = 0;
+		while(p < end && *p >= '0' && *p <= '9')
+		{
+			value = value * 10 + (*p - '0');
+			if(value > 0xFFFFFFFFull) return false;
+			p++;
+		}
+		return p == end || _isRequestBlank(*p);
+	};
+
+	unsigned long long length;
+	if(!next(length)) return "longitud mal formada";
+	for(unsigned long long k=0; k<length; k++)
+	{
+		unsigned long long symbol;
+		if(!next(symbol)) return "simbolo mal formado o faltante";
+		if(symbol >= alphabetLength) return "simbolo fuera del alfabeto";
+		sample.push_back((SampleSet::TSymbol)symbol);
+	}
+	while(p < end && _isRequestBlank(*p)) p++;
+	if(p != end) return "la linea tiene mas simbolos que su longitud";
+	return string();
+}
+
+ClassificationServer::ClassificationServer(const vector<Nfa>& models)
+	: models(models), alphabetLength(0), inputClosed(false), failed(false), wakeSignal(-1),
+	Threads(0), MaxBatchSamples(256), MaxBatchMicroseconds(200), ReportVotes(false), MaxUnsentBytes(16 << 20)
+{
+	// los simbolos deben pertenecer al alfabeto de todos los modelos
+	for(size_t j=0; j<models.size(); j++)
+	{
+		unsigned alpha = models[j].GetAlphabetLenght();
+		alphabetLength = j == 0 ? alpha : min(alphabetLength, alpha);
+	}
+}
+
+ClassificationServer::~ClassificationServer()
+{
+	try
+	{
+		Finish();
+	}
+	catch(...)
+	{
+	}
+}
+
+void ClassificationServer::Start()
+{
+	if(models.empty()) throw runtime_error("No hay modelos para clasificar");
+	if(MaxBatchSamples == 0) throw runtime_error("El tamano maximo del lote debe ser mayor que cero");
+	unsigned threads = Threads != 0 ? Threads : max(1u, thread::hardware_concurrency());
+	pool.Start(threads);
+	pending.reset(new SampleSet());
+	pending->SetAlphabetLength(alphabetLength);
+	pendingEntries.clear();
+	inputClosed = false;
+	failed = false;
+	error = exception_ptr();
+	batcher = thread(&ClassificationServer::BatchLoop, this);
+}
+
+/** Evalua las muestras pendientes, detiene los hilos y relanza el error de los lotes
+*/
+void ClassificationServer::Finish()
+{
+	if(!batcher.joinable()) return;
+	{
+		lock_guard<std::mutex> lock(mutex);
+		inputClosed = true;
+	}
+	arrived.notify_all();
+	batcher.join();
+	pool.Stop();
+	if(error)
+	{
+		auto e = error;
+		error = exception_ptr();
+		rethrow_exception(e);
+	}
+}
+
+/** Agrega una linea de entrada al lote pendiente, esperando si hay demasiadas. Retorna
+    false si la evaluacion de los lotes fallo
+*/
+bool ClassificationServer::Enqueue(const shared_ptr<TClient>& client, const char* line, size_t size)
+{
+	size_t first = 0;
+	while(first < size && _isRequestBlank(line[first])) first++;
+	// ignora lineas vacias
+	if(first == size) return true;
+
+	TEntry entry;
+	entry.Client = client;
+	entry.Error = _parseRequest(line, size, alphabetLength, request);
+
+	unique_lock<std::mutex> lock(mutex);
+	space.wait(lock, [this]{ return failed || pendingEntries.size() < MaxBatchSamples * queuedBatches; });
+	if(failed) return false;
+	if(pendingEntries.empty()) firstArrival = chrono::steady_clock::now();
+	entry.Sample = entry.Error.empty() ? pending->size() : NoSample;
+	if(entry.Error.empty()) pending->Add(request);
+	pendingEntries.push_back(entry);
+	// el hilo de los lotes solo necesita despertar con la primera muestra y con el lote lleno
+	bool wake = pendingEntries.size() == 1 || pendingEntries.size() == MaxBatchSamples;
+	lock.unlock();
+	if(wake) arrived.notify_one();
+	return true;
+}
+
+void ClassificationServer::BatchLoop()
+{
+	try
+	{
+		unique_ptr<SampleSet> batch(new SampleSet());
+		batch->SetAlphabetLength(alphabetLength);
+		vector<TEntry> entries;
+		vector<unsigned> votes;
+		vector<TClient*> replied;
+		auto threshold = models.size() / 2;
+		for(;;)
+		{
+			{
+				unique_lock<std::mutex> lock(mutex);
+				arrived.wait(lock, [this]{ return !pendingEntries.empty() || inputClosed; });
+				if(pendingEntries.empty()) return;
+				// el lote se cierra al llenarse o al vencer el plazo de su primera muestra
+				auto deadline = firstArrival + chrono::microseconds(MaxBatchMicroseconds);
+				arrived.wait_until(lock, deadline, [this]{ return pendingEntries.size() >= MaxBatchSamples || inputClosed; });
+				batch.swap(pending);
+				entries.swap(pendingEntries);
+			}
+			space.notify_all();
+
+			Evaluate(*batch, votes);
+			// las respuestas de cada cliente conservan el orden de sus lineas
+			for(auto e=entries.begin(); e!=entries.end(); ++e)
+			{
+				auto client = e->Client.get();
+				if(client->Reply.empty()) replied.push_back(client);
+				if(e->Sample == NoSample)
+				{
+					client->Reply += "error: " + e->Error + "\n";
+					continue;
+				}
+				auto v = votes[e->Sample];
+				client->Reply += v > threshold ? '1' : '0';
+				if(ReportVotes) client->Reply += " " + lexical_cast<string>(v);
+				client->Reply += '\n';
+			}
+			for(auto c=replied.begin(); c!=replied.end(); ++c) (*c)->Flush();
+			replied.clear();
+			entries.clear();
+			batch->Clear();
+#ifndef _WIN32
+			// el ciclo del socket envia lo que quedo pendiente y cierra las conexiones terminadas
+			if(wakeSignal >= 0)
+			{
+				char wake = 0;
+				if(write(wakeSignal, &wake, 1) < 0 && errno != EAGAIN && errno != EWOULDBLOCK) throw runtime_error("Error despertando el ciclo del socket");
+			}
+#endif
+		}
+	}
+	catch(...)
+	{
+		{
+			lock_guard<std::mutex> lock(mutex);
+			error = current_exception();
+			failed = true;
+		}
+		space.notify_all();
+	}
+}
+
+/** Cuenta los modelos que reconocen cada muestra del lote. Los hilos se reparten los
+    pares (muestra, modelo), de modo que un lote de una sola muestra tambien se divide
+*/
+void ClassificationServer::Evaluate(const SampleSet& batch, vector<unsigned>& votes)
+{
+	size_t modelCount = models.size();
+	size_t work = batch.size() * modelCount;
+	unsigned workers = (unsigned)min((size_t)pool.GetCount(), work);
+	votes.assign(batch.size(), 0);
+	if(workers <= 1)
+	{
+		for(size_t i=0; i<batch.size(); i++)
+		{
+			for(size_t j=0; j<modelCount; j++) if(batch[i].IsMatchedBy(models[j])) votes[i]++;
+		}
+		return;
+	}
+
+	// cada hilo cuenta sus votos por separado
+	vector<vector<unsigned>> partial(workers, vector<unsigned>(batch.size(), 0));
+	pool.Run([&](unsigned worker)
+	{
+		if(worker >= workers) return;
+		auto& counts = partial[worker];
+		for(size_t k=worker; k<work; k+=workers)
+		{
+			if(batch[k / modelCount].IsMatchedBy(models[k % modelCount])) counts[k / modelCount]++;
+		}
+	});
+	for(unsigned w=0; w<workers; w++)
+	{
+		for(size_t i=0; i<batch.size(); i++) votes[i] += partial[w][i];
+	}
+}
+
+/** Atiende las lineas de input hasta su final y escribe las respuestas en output
+*/
+void ClassificationServer::ServeStream(istream& input, ostream& output)
+{
+	shared_ptr<TClient> client(new TClient(&output, -1, 0));
+	Start();
+	exception_ptr readError;
+	try
+	{
+		string line;
+		while(getline(input, line) && Enqueue(client, line.data(), line.size()));
+	}
+	catch(...)
+	{
+		readError = current_exception();
+	}
+	Finish();
+	if(readError) rethrow_exception(readError);
+}
+
+/** Escucha en un socket Unix en la ruta indicada y atiende a varios clientes a la vez;
+    las muestras de todos los clientes comparten los lotes. Un cliente que no lee sus
+	respuestas no detiene a los demas: se desconecta al acumular MaxUnsentBytes sin enviar.
+	No retorna salvo por un error
+*/
+void ClassificationServer::ServeSocket(const string& path)
+{
+#ifdef _WIN32
+	throw runtime_error("Los sockets Unix no estan disponibles en esta plataforma, use la entrada estandar");
+#else
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if(path.size() >= sizeof(address.sun_path)) throw runtime_error("La ruta del socket es demasiado larga: " + path);
+	memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(listener < 0) throw runtime_error("No fue posible crear el socket");
+	// un socket anterior en la misma ruta se reemplaza
+	unlink(path.c_str());
+	if(bind(listener, (sockaddr*)&address, sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0)
+	{
+		close(listener);
+		throw runtime_error("No fue posible escuchar en el socket " + path);
+	}
+	// un cliente que cierra antes de recibir sus respuestas no debe terminar el proceso
+	signal(SIGPIPE, SIG_IGN);
+
+	int wake[2];
+	if(pipe(wake) != 0)
+	{
+		close(listener);
+		throw runtime_error("No fue posible crear la tuberia del socket");
+	}
+	fcntl(wake[0], F_SETFL, O_NONBLOCK);
+	fcntl(wake[1], F_SETFL, O_NONBLOCK);
+	wakeSignal = wake[1];
+
+	Start();
+	vector<pollfd> fds(firstClient);
+	fds[0].fd = listener;
+	fds[0].events = POLLIN;
+	fds[1].fd = wake[0];
+	fds[1].events = POLLIN;
+	vector<shared_ptr<TClient>> clients(firstClient);
+	vector<string> partial(firstClient);
+	// la conexion sigue enviando respuestas despues de que el cliente termina de escribir
+	vector<char> reading(firstClient);
+	vector<char> block(socketBlockSize);
+	exception_ptr ioError;
+	try
+	{
+		bool running = true;
+		while(running)
+		{
+			// se descartan las conexiones terminadas sin respuestas pendientes en los lotes
+			// ni en el socket, y las de clientes que no leen sus respuestas
+			for(size_t k=fds.size() - 1; k>=firstClient; k--)
+			{
+				auto& client = clients[k];
+				if(client->IsBroken() || (!reading[k] && client.use_count() == 1 && !client->HasUnsent()))
+				{
+					fds.erase(fds.begin() + k);
+					clients.erase(clients.begin() + k);
+					partial.erase(partial.begin() + k);
+					reading.erase(reading.begin() + k);
+					continue;
+				}
+				fds[k].events = (reading[k] ? POLLIN : 0) | (client->HasUnsent() ? POLLOUT : 0);
+			}
+			if(poll(fds.data(), fds.size(), -1) < 0)
+			{
+				if(errno == EINTR) continue;
+				throw runtime_error("Error esperando datos del socket");
+			}
+			if(fds[1].revents & POLLIN)
+			{
+				while(read(wake[0], block.data(), block.size()) > 0);
+			}
+			for(size_t k=fds.size() - 1; k>=firstClient && running; k--)
+			{
+				if(fds[k].revents == 0) continue;
+				if(fds[k].revents & POLLOUT) clients[k]->Drain();
+				if(!reading[k])
+				{
+					// sin lectura pendiente solo interesa si el cliente desaparecio
+					if(fds[k].revents & (POLLHUP | POLLERR)) clients[k]->Close();
+					continue;
+				}
+				if((fds[k].revents & (POLLIN | POLLHUP | POLLERR)) == 0) continue;
+				ssize_t readed = read(fds[k].fd, block.data(), block.size());
+				if(readed < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) continue;
+				if(readed > 0)
+				{
+					// solo se encolan lineas completas
+					string& rest = partial[k];
+					rest.append(block.data(), (size_t)readed);
+					size_t begin = 0, eol;
+					while(running && (eol = rest.find('\n', begin)) != string::npos)
+					{
+						running = Enqueue(clients[k], rest.data() + begin, eol - begin);
+						begin = eol + 1;
+					}
+					rest.erase(0, begin);
+					continue;
+				}
+				// fin de la conexion, la ultima linea puede no terminar en '\n'. La conexion
+				// se descarta cuando se envian sus respuestas pendientes
+				if(!partial[k].empty()) running = Enqueue(clients[k], partial[k].data(), partial[k].size());
+				partial[k].clear();
+				reading[k] = false;
+			}
+			if(running && (fds[0].revents & POLLIN))
+			{
+				int connection = accept(listener, NULL, NULL);
+				if(connection >= 0)
+				{
+					fcntl(connection, F_SETFL, O_NONBLOCK);
+					pollfd fd;
+					fd.fd = connection;
+					fd.events = POLLIN;
+					fd.revents = 0;
+					fds.push_back(fd);
+					clients.push_back(shared_ptr<TClient>(new TClient(NULL, connection, MaxUnsentBytes)));
+					partial.push_back(string());
+					reading.push_back(true);
+				}
+			}
+		}
+	}
+	catch(...)
+	{
+		ioError = current_exception();
+	}
+	clients.clear();
+	close(listener);
+	unlink(path.c_str());
+	exception_ptr batchError;
+	try
+	{
+		Finish();
+	}
+	catch(...)
+	{
+		batchError = current_exception();
+	}
+	wakeSignal = -1;
+	close(wake[0]);
+	close(wake[1]);
+	if(batchError) rethrow_exception(batchError);
+	if(ioError) rethrow_exception(ioError);
+#endif
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "Nfa.h"
+#include "SampleSet.h"
+#include "WorkerPool.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <istream>
+#include <ostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <exception>
+
+/** Clasifica muestras sin etiqueta con un modelo o un comite de modelos cargados una sola
+    vez. Cada linea de entrada es "longitud s1 ... sn" y recibe una linea de respuesta en
+	el mismo orden: el veredicto (1 o 0), seguido de los votos positivos si ReportVotes, o
+	"error: <motivo>" si la linea no es valida. Las lineas vacias se ignoran.
+	Las muestras que llegan se acumulan en lotes que se cierran al juntar MaxBatchSamples
+	o al cumplirse MaxBatchMicroseconds desde la primera muestra del lote; cada lote se
+	evalua en paralelo y sus respuestas se escriben juntas
+*/
+class ClassificationServer
+{
+	struct TClient;
+
+	// muestra o linea invalida a la espera de un lote
+	struct TEntry
+	{
+		std::shared_ptr<TClient> Client;
+		// indice de la muestra en el lote, NoSample si la linea es invalida
+		size_t Sample;
+		std::string Error;
+	};
+
+	static const size_t NoSample = ~(size_t)0;
+
+	const std::vector<Nfa>& models;
+	unsigned alphabetLength;
+	WorkerPool pool;
+	std::thread batcher;
+	std::mutex mutex;
+	std::condition_variable arrived;
+	std::condition_variable space;
+	std::unique_ptr<SampleSet> pending;
+	std::vector<TEntry> pendingEntries;
+	std::chrono::steady_clock::time_point firstArrival;
+	bool inputClosed;
+	bool failed;
+	std::exception_ptr error;
+	// extremo de escritura de la tuberia que despierta al ciclo del socket despues de cada lote (-1: sin socket)
+	int wakeSignal;
+	// linea interpretada, se reutiliza entre lineas
+	SampleSet::TSample request;
+
+	void Start();
+	void Finish();
+	bool Enqueue(const std::shared_ptr<TClient>& client, const char* line, size_t size);
+	void BatchLoop();
+	void Evaluate(const SampleSet& batch, std::vector<unsigned>& votes);
+
+	// no se puede copiar
+	ClassificationServer(const ClassificationServer&);
+	ClassificationServer& operator=(const ClassificationServer&);
+
+public:
+	/// Hilos que evaluan cada lote (0: tantos como nucleos)
+	unsigned Threads;
+	/// Cantidad de muestras que cierra un lote
+	size_t MaxBatchSamples;
+	/// Espera maxima de la primera muestra de un lote antes de evaluarlo
+	unsigned MaxBatchMicroseconds;
+	/// Agrega a cada veredicto la cantidad de modelos que reconocen la muestra
+	bool ReportVotes;
+	/// Bytes de respuestas que un cliente del socket puede dejar sin leer antes de ser desconectado
+	size_t MaxUnsentBytes;
+
+	void ServeStream(std::istream& input, std::ostream& output);
+	void ServeSocket(const std::string& path);
+
+	explicit ClassificationServer(const std::vector<Nfa>& models);
+	~ClassificationServer();
+};
@@ -0,0 +1,344 @@
+#include "StdAfx.h"
+#include "CompressedInput.h"
+
+#ifdef _USE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef _USE_ZSTD
+#include <zstd.h>
+#endif
+
+using namespace std;
+
+CompressedInput::CompressedInput()
+	: file(NULL), format(Plain), finished(false), stopping(false)
+{
+}
+
+CompressedInput::~CompressedInput()
+{
+	Close();
+}
+
+/** Reconoce el formato por los primeros bytes: 1F 8B para gzip y 28 B5 2F FD para zstd
+*/
+CompressedInput::TFormat _detectFormat(const unsigned char* magic, size_t size)
+{
+	if(size >= 2 && magic[0] == 0x1F && magic[1] == 0x8B) return CompressedInput::Gzip;
+	if(size >= 4 && magic[0] == 0x28 && magic[1] == 0xB5 && magic[2] == 0x2F && magic[3] == 0xFD) return CompressedInput::Zstd;
+	return CompressedInput::Plain;
+}
+
+/** Formato de un archivo segun sus primeros bytes, Plain si no se puede abrir
+*/
+CompressedInput::TFormat CompressedInput::DetectFormat(const string& filename)
+{
+	FILE* f = fopen(filename.c_str(), "rb");
+	if(f == NULL) return Plain;
+	unsigned char magic[4];
+	size_t size = fread(magic, 1, sizeof(magic), f);
+	fclose(f);
+	return _detectFormat(magic, size);
+}
+
+const char* CompressedInput::GetFormatName(TFormat format)
+{
+	switch(format)
+	{
+	case Gzip: return "gzip";
+	case Zstd: return "zstd";
+	default: return "texto";
+	}
+}
+
+/** Abre el archivo e inicia la descompresion. Retorna false si el archivo no se pudo abrir
+    y lanza una excepcion si esta comprimido en un formato sin soporte en esta compilacion
+*/
+bool CompressedInput::Open(const string& filename)
+{
+	Close();
+	file = fopen(filename.c_str(), "rb");
+	if(file == NULL) return false;
+	unsigned char magic[4];
+	size_t size = fread(magic, 1, sizeof(magic), file);
+	rewind(file);
+	format = _detectFormat(magic, size);
+#ifndef _USE_ZLIB
+	if(format == Gzip)
+	{
+		Close();
+		throw runtime_error("El archivo " + filename + " esta comprimido con gzip y FastOil se compilo sin soporte para gzip");
+	}
+#endif
+#ifndef _USE_ZSTD
+	if(format == Zstd)
+	{
+		Close();
+		throw runtime_error("El archivo " + filename + " esta comprimido con zstd y FastOil se compilo sin soporte para zstd");
+	}
+#endif
+
+	finished = false;
+	stopping = false;
+	error = exception_ptr();
+	decoder = thread(&CompressedInput::DecodeLoop, this);
+	return true;
+}
+
+/** Detiene la descompresion y cierra el archivo
+*/
+void CompressedInput::Close()
+{
+	if(decoder.joinable())
+	{
+		{
+			lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		space.notify_all();
+		decoder.join();
+	}
+	if(file != NULL)
+	{
+		fclose(file);
+		file = NULL;
+	}
+	blocks.clear();
+	current.clear();
+	setg(NULL, NULL, NULL);
+}
+
+CompressedInput::TFormat CompressedInput::GetFormat() const
+{
+	return format;
+}
+
+/** Lee hasta size bytes descomprimidos. Retorna 0 al final del archivo
+*/
+size_t CompressedInput::Read(char* buffer, size_t size)
+{
+	return (size_t)sgetn(buffer, (streamsize)size);
+}
+
+CompressedInput::int_type CompressedInput::underflow()
+{
+	if(gptr() < egptr()) return traits_type::to_int_type(*gptr());
+	if(!NextBlock()) return traits_type::eof();
+	setg(current.data(), current.data(), current.data() + current.size());
+	return traits_type::to_int_type(*gptr());
+}
+
+/** Toma el siguiente bloque descomprimido. Retorna false al final del archivo y relanza
+    el error del hilo de descompresion despues de entregar los bloques anteriores a el
+*/
+bool CompressedInput::NextBlock()
+{
+	unique_lock<std::mutex> lock(mutex);
+	ready.wait(lock, [this]{ return !blocks.empty() || finished; });
+	if(!blocks.empty())
+	{
+		current.swap(blocks.front());
+		blocks.pop_front();
+		lock.unlock();
+		space.notify_one();
+		return true;
+	}
+	if(error)
+	{
+		auto e = error;
+		error = exception_ptr();
+		rethrow_exception(e);
+	}
+	return false;
+}
+
+/** Entrega un bloque no vacio al lector, esperando si va demasiado adelantado.
+    Retorna false si el lector cerro el archivo
+*/
+bool CompressedInput::Push(vector<char>& block)
+{
+	assert(!block.empty());
+	unique_lock<std::mutex> lock(mutex);
+	space.wait(lock, [this]{ return stopping || blocks.size() < MaxQueuedBlocks; });
+	if(stopping) return false;
+	blocks.push_back(vector<char>());
+	blocks.back().swap(block);
+	lock.unlock();
+	ready.notify_one();
+	return true;
+}
+
+void CompressedInput::DecodeLoop()
+{
+	try
+	{
+		if(format == Gzip) DecodeGzip();
+		else if(format == Zstd) DecodeZstd();
+		else DecodePlain();
+	}
+	catch(...)
+	{
+		lock_guard<std::mutex> lock(mutex);
+		error = current_exception();
+	}
+	{
+		lock_guard<std::mutex> lock(mutex);
+		finished = true;
+	}
+	ready.notify_all();
+}
+
+void CompressedInput::DecodePlain()
+{
+	vector<char> block(BlockSize);
+	size_t readed;
+	while((readed = fread(block.data(), 1, block.size(), file)) > 0)
+	{
+		block.resize(readed);
+		if(!Push(block)) return;
+		block.resize(BlockSize);
+	}
+	if(ferror(file)) throw runtime_error("Error leyendo el archivo");
+}
+
+/** Descomprime gzip, incluidos archivos con varios miembros concatenados
+*/
+void CompressedInput::DecodeGzip()
+{
+#ifdef _USE_ZLIB
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	// 15 + 32: ventana maxima y deteccion automatica de cabecera gzip o zlib
+	if(inflateInit2(&zs, 15 + 32) != Z_OK) throw runtime_error("No fue posible iniciar la descompresion gzip");
+
+	vector<unsigned char> in(BlockSize);
+	vector<char> out(BlockSize);
+	size_t outUsed = 0;
+	bool streamEnd = false;
+	bool outputFull = false;
+	// el lector cerro el archivo antes del final
+	bool aborted = false;
+	try
+	{
+		for(;;)
+		{
+			// con la salida llena zlib puede tener datos pendientes sin consumir entrada
+			if(zs.avail_in == 0 && !outputFull)
+			{
+				size_t readed = fread(in.data(), 1, in.size(), file);
+				if(readed == 0) break;
+				zs.next_in = in.data();
+				zs.avail_in = (uInt)readed;
+			}
+			// otro miembro gzip a continuacion del anterior
+			if(streamEnd && zs.avail_in > 0)
+			{
+				inflateReset(&zs);
+				streamEnd = false;
+			}
+			zs.next_out = (Bytef*)out.data() + outUsed;
+			zs.avail_out = (uInt)(out.size() - outUsed);
+			int ret = inflate(&zs, Z_NO_FLUSH);
+			if(ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+			{
+				throw runtime_error("Archivo gzip danado");
+			}
+			if(ret == Z_STREAM_END) streamEnd = true;
+			outUsed = out.size() - zs.avail_out;
+			outputFull = outUsed == out.size();
+			if(outputFull)
+			{
+				if(!Push(out))
+				{
+					aborted = true;
+					break;
+				}
+				out.resize(BlockSize);
+				outUsed = 0;
+			}
+		}
+		if(ferror(file)) throw runtime_error("Error leyendo el archivo");
+		if(!streamEnd && !aborted) throw runtime_error("Archivo gzip incompleto");
+		if(outUsed > 0 && !aborted)
+		{
+			out.resize(outUsed);
+			Push(out);
+		}
+	}
+	catch(...)
+	{
+		inflateEnd(&zs);
+		throw;
+	}
+	inflateEnd(&zs);
+#endif
+}
+
+/** Descomprime zstd, incluidos archivos con varios marcos concatenados
+*/
+void CompressedInput::DecodeZstd()
+{
+#ifdef _USE_ZSTD
+	ZSTD_DStream* zs = ZSTD_createDStream();
+	if(zs == NULL || ZSTD_isError(ZSTD_initDStream(zs)))
+	{
+		ZSTD_freeDStream(zs);
+		throw runtime_error("No fue posible iniciar la descompresion zstd");
+	}
+
+	vector<char> in(BlockSize);
+	vector<char> out(BlockSize);
+	ZSTD_inBuffer input = { in.data(), 0, 0 };
+	size_t outUsed = 0;
+	// 0 cuando el ultimo marco termino
+	size_t pending = 0;
+	bool outputFull = false;
+	// el lector cerro el archivo antes del final
+	bool aborted = false;
+	try
+	{
+		for(;;)
+		{
+			// con la salida llena zstd puede tener datos pendientes sin consumir entrada
+			if(input.pos == input.size && !outputFull)
+			{
+				size_t readed = fread(in.data(), 1, in.size(), file);
+				if(readed == 0) break;
+				input.size = readed;
+				input.pos = 0;
+			}
+			ZSTD_outBuffer output = { out.data() + outUsed, out.size() - outUsed, 0 };
+			pending = ZSTD_decompressStream(zs, &output, &input);
+			if(ZSTD_isError(pending))
+			{
+				throw runtime_error(string("Archivo zstd danado: ") + ZSTD_getErrorName(pending));
+			}
+			outUsed += output.pos;
+			outputFull = outUsed == out.size();
+			if(outputFull)
+			{
+				if(!Push(out))
+				{
+					aborted = true;
+					break;
+				}
+				out.resize(BlockSize);
+				outUsed = 0;
+			}
+		}
+		if(ferror(file)) throw runtime_error("Error leyendo el archivo");
+		if(pending != 0 && !aborted) throw runtime_error("Archivo zstd incompleto");
+		if(outUsed > 0 && !aborted)
+		{
+			out.resize(outUsed);
+			Push(out);
+		}
+	}
+	catch(...)
+	{
+		ZSTD_freeDStream(zs);
+		throw;
+	}
+	ZSTD_freeDStream(zs);
+#endif
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <streambuf>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <cstdio>
+
+/** Lectura secuencial de un archivo que puede estar comprimido con gzip o zstd. El formato
+    se detecta por los primeros bytes del archivo. La descompresion corre en un hilo propio
+	que llena bloques mientras el llamador interpreta los anteriores. Se lee por bloques
+	con Read() o como istream a traves de este streambuf
+*/
+class CompressedInput : public std::streambuf
+{
+public:
+	enum TFormat
+	{
+		Plain,
+		Gzip,
+		Zstd
+	};
+
+	/// Tamano de los bloques descomprimidos
+	static const size_t BlockSize = 1 << 20;
+	/// Bloques que el hilo de descompresion puede adelantar al lector
+	static const size_t MaxQueuedBlocks = 4;
+
+private:
+	FILE* file;
+	TFormat format;
+	std::thread decoder;
+	std::mutex mutex;
+	std::condition_variable ready;
+	std::condition_variable space;
+	std::deque<std::vector<char> > blocks;
+	bool finished;
+	bool stopping;
+	std::exception_ptr error;
+	// bloque que se esta leyendo
+	std::vector<char> current;
+
+	void DecodeLoop();
+	void DecodePlain();
+	void DecodeGzip();
+	void DecodeZstd();
+	bool Push(std::vector<char>& block);
+	bool NextBlock();
+
+	// no se puede copiar
+	CompressedInput(const CompressedInput&);
+	CompressedInput& operator=(const CompressedInput&);
+
+protected:
+	int_type underflow();
+
+public:
+	bool Open(const std::string& filename);
+	void Close();
+	TFormat GetFormat() const;
+	size_t Read(char* buffer, size_t size);
+
+	static TFormat DetectFormat(const std::string& filename);
+	static const char* GetFormatName(TFormat format);
+
+	CompressedInput();
+	~CompressedInput();
+};
@@ -0,0 +1,240 @@
+#include "StdAfx.h"
+#include "CompressedOutput.h"
+
+#ifdef _USE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef _USE_ZSTD
+#include <zstd.h>
+#endif
+
+using namespace std;
+
+/** Formato de salida segun la extension del archivo
+*/
+CompressedOutput::TFormat CompressedOutput::FormatFor(const string& filename)
+{
+	if(boost::iends_with(filename, ".gz")) return Gzip;
+	if(boost::iends_with(filename, ".zst")) return Zstd;
+	return Plain;
+}
+
+CompressedOutput::CompressedOutput(const string& filename)
+	: ostream(NULL)
+{
+	rdbuf(&buffer);
+	if(!buffer.Open(filename, FormatFor(filename))) setstate(ios::failbit);
+}
+
+CompressedOutput::~CompressedOutput()
+{
+	try
+	{
+		buffer.Close();
+	}
+	catch(...)
+	{
+	}
+}
+
+bool CompressedOutput::is_open() const
+{
+	return buffer.IsOpen();
+}
+
+/** Escribe los datos pendientes, termina el flujo comprimido y cierra el archivo
+*/
+void CompressedOutput::close()
+{
+	buffer.Close();
+}
+
+CompressedOutput::TBuffer::TBuffer()
+	: file(NULL), format(Plain), stream(NULL)
+{
+}
+
+CompressedOutput::TBuffer::~TBuffer()
+{
+	try
+	{
+		Close();
+	}
+	catch(...)
+	{
+	}
+}
+
+bool CompressedOutput::TBuffer::Open(const string& filename, TFormat fileFormat)
+{
+	Close();
+	format = fileFormat;
+#ifndef _USE_ZLIB
+	if(format == Gzip) throw runtime_error("FastOil se compilo sin soporte para gzip, no es posible escribir " + filename);
+#endif
+#ifndef _USE_ZSTD
+	if(format == Zstd) throw runtime_error("FastOil se compilo sin soporte para zstd, no es posible escribir " + filename);
+#endif
+	file = fopen(filename.c_str(), "wb");
+	if(file == NULL) return false;
+
+#ifdef _USE_ZLIB
+	if(format == Gzip)
+	{
+		auto zs = new z_stream;
+		memset(zs, 0, sizeof(z_stream));
+		// 15 + 16: ventana maxima con cabecera gzip
+		if(deflateInit2(zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		{
+			delete zs;
+			fclose(file);
+			file = NULL;
+			throw runtime_error("No fue posible iniciar la compresion gzip");
+		}
+		stream = zs;
+	}
+#endif
+#ifdef _USE_ZSTD
+	if(format == Zstd)
+	{
+		auto zs = ZSTD_createCStream();
+		if(zs == NULL || ZSTD_isError(ZSTD_initCStream(zs, 3)))
+		{
+			ZSTD_freeCStream(zs);
+			fclose(file);
+			file = NULL;
+			throw runtime_error("No fue posible iniciar la compresion zstd");
+		}
+		stream = zs;
+	}
+#endif
+
+	text.resize(BlockSize);
+	if(format != Plain) compressed.resize(BlockSize);
+	setp(text.data(), text.data() + text.size());
+	return true;
+}
+
+bool CompressedOutput::TBuffer::IsOpen() const
+{
+	return file != NULL;
+}
+
+void CompressedOutput::TBuffer::Write(const char* data, size_t size)
+{
+	if(size > 0 && fwrite(data, 1, size, file) != size)
+	{
+		throw runtime_error("Error escribiendo el archivo de salida");
+	}
+}
+
+/** Comprime un tramo de texto y escribe lo producido. finish termina el flujo comprimido
+*/
+void CompressedOutput::TBuffer::Compress(const char* data, size_t size, bool finish)
+{
+	if(format == Plain)
+	{
+		Write(data, size);
+		return;
+	}
+#ifdef _USE_ZLIB
+	if(format == Gzip)
+	{
+		auto zs = (z_stream*)stream;
+		zs->next_in = (Bytef*)data;
+		zs->avail_in = (uInt)size;
+		do
+		{
+			zs->next_out = (Bytef*)compressed.data();
+			zs->avail_out = (uInt)compressed.size();
+			if(deflate(zs, finish ? Z_FINISH : Z_NO_FLUSH) == Z_STREAM_ERROR)
+			{
+				throw runtime_error("Error en la compresion gzip");
+			}
+			Write(compressed.data(), compressed.size() - zs->avail_out);
+		}
+		while(zs->avail_out == 0);
+		return;
+	}
+#endif
+#ifdef _USE_ZSTD
+	if(format == Zstd)
+	{
+		auto zs = (ZSTD_CStream*)stream;
+		ZSTD_inBuffer input = { data, size, 0 };
+		while(input.pos < input.size)
+		{
+			ZSTD_outBuffer output = { compressed.data(), compressed.size(), 0 };
+			size_t ret = ZSTD_compressStream(zs, &output, &input);
+			if(ZSTD_isError(ret)) throw runtime_error(string("Error en la compresion zstd: ") + ZSTD_getErrorName(ret));
+			Write(compressed.data(), output.pos);
+		}
+		if(finish)
+		{
+			size_t remaining;
+			do
+			{
+				ZSTD_outBuffer output = { compressed.data(), compressed.size(), 0 };
+				remaining = ZSTD_endStream(zs, &output);
+				if(ZSTD_isError(remaining)) throw runtime_error(string("Error en la compresion zstd: ") + ZSTD_getErrorName(remaining));
+				Write(compressed.data(), output.pos);
+			}
+			while(remaining > 0);
+		}
+	}
+#endif
+}
+
+CompressedOutput::TBuffer::int_type CompressedOutput::TBuffer::overflow(int_type c)
+{
+	if(file == NULL) return traits_type::eof();
+	Compress(pbase(), pptr() - pbase(), false);
+	setp(text.data(), text.data() + text.size());
+	if(!traits_type::eq_int_type(c, traits_type::eof())) sputc(traits_type::to_char_type(c));
+	return traits_type::not_eof(c);
+}
+
+/** Sin compresion el texto pendiente se escribe en el archivo. Comprimido se conserva hasta
+    llenar el buffer, comprimir cada linea por separado arruina la tasa de compresion
+*/
+int CompressedOutput::TBuffer::sync()
+{
+	if(file == NULL) return -1;
+	if(format == Plain)
+	{
+		Write(pbase(), pptr() - pbase());
+		setp(text.data(), text.data() + text.size());
+	}
+	return 0;
+}
+
+void CompressedOutput::TBuffer::Close()
+{
+	if(file == NULL) return;
+	// el compresor y el archivo se liberan aunque falle la ultima escritura
+	exception_ptr failure;
+	try
+	{
+		Compress(pbase(), pptr() - pbase(), true);
+	}
+	catch(...)
+	{
+		failure = current_exception();
+	}
+	setp(NULL, NULL);
+#ifdef _USE_ZLIB
+	if(format == Gzip)
+	{
+		deflateEnd((z_stream*)stream);
+		delete (z_stream*)stream;
+	}
+#endif
+#ifdef _USE_ZSTD
+	if(format == Zstd) ZSTD_freeCStream((ZSTD_CStream*)stream);
+#endif
+	stream = NULL;
+	bool closed = fclose(file) == 0;
+	file = NULL;
+	if(failure) rethrow_exception(failure);
+	if(!closed) throw runtime_error("Error cerrando el archivo de salida");
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <streambuf>
+#include <cstdio>
+
+/** Archivo de salida de texto que se comprime con gzip o zstd segun su extension
+    (.gz o .zst); con cualquier otra extension se escribe sin comprimir. Los datos
+	comprimidos se escriben al llenarse el buffer y al cerrar el archivo
+*/
+class CompressedOutput : public std::ostream
+{
+public:
+	enum TFormat
+	{
+		Plain,
+		Gzip,
+		Zstd
+	};
+
+	/// Tamano del buffer de texto antes de comprimir
+	static const size_t BlockSize = 1 << 20;
+
+private:
+	class TBuffer : public std::streambuf
+	{
+		FILE* file;
+		TFormat format;
+		std::vector<char> text;
+		std::vector<char> compressed;
+		// estado del compresor (z_stream o ZSTD_CStream)
+		void* stream;
+
+		void Compress(const char* data, size_t size, bool finish);
+		void Write(const char* data, size_t size);
+
+	protected:
+		int_type overflow(int_type c);
+		int sync();
+
+	public:
+		bool Open(const std::string& filename, TFormat format);
+		void Close();
+		bool IsOpen() const;
+
+		TBuffer();
+		~TBuffer();
+	};
+
+	TBuffer buffer;
+
+	// no se puede copiar
+	CompressedOutput(const CompressedOutput&);
+	CompressedOutput& operator=(const CompressedOutput&);
+
+public:
+	static TFormat FormatFor(const std::string& filename);
+
+	bool is_open() const;
+	void close();
+
+	explicit CompressedOutput(const std::string& filename);
+	~CompressedOutput();
+};
@@ -0,0 +1,175 @@
+#include "StdAfx.h"
+#include "CrossValidator.h"
+#include "MajorityVote.h"
+#include "WorkerPool.h"
+#include <mutex>
+
+using namespace std;
+
+CrossValidator::CrossValidator()
+	: Folds(10), Models(1), Jobs(1), ShowProgress(false), Seed(0)
+{
+}
+
+/** Reparte count posiciones entre los pliegues: la posicion de orden k en una permutacion
+    aleatoria va al pliegue k % Folds. Cada pliegue queda con sus posiciones en orden creciente
+*/
+void CrossValidator::Partition(size_t count, unsigned seed, vector<vector<size_t>>& parts) const
+{
+	vector<size_t> order(count);
+	for(size_t i=0; i<count; i++) order[i] = i;
+	mt19937 rng(seed);
+	shuffle(order.begin(), order.end(), rng);
+	parts.assign(Folds, vector<size_t>());
+	for(size_t k=0; k<count; k++) parts[k % Folds].push_back(order[k]);
+	for(auto it=parts.begin(); it!=parts.end(); ++it) sort(it->begin(), it->end());
+}
+
+/** Copia las muestras de los demas pliegues en los conjuntos de entrenamiento del pliegue.
+    Los conjuntos quedan ordenados y sin repetir, asi el entrenador no los modifica y los
+	modelos del pliegue pueden compartirlos
+*/
+void CrossValidator::BuildTrainingSets(const SampleSet& pos, const SampleSet& neg, unsigned fold, vector<TFold>& folds) const
+{
+	vector<size_t> trainPositives, trainNegatives;
+	for(unsigned f=0; f<Folds; f++)
+	{
+		if(f == fold) continue;
+		trainPositives.insert(trainPositives.end(), folds[f].Positives.begin(), folds[f].Positives.end());
+		trainNegatives.insert(trainNegatives.end(), folds[f].Negatives.begin(), folds[f].Negatives.end());
+	}
+	sort(trainPositives.begin(), trainPositives.end());
+	sort(trainNegatives.begin(), trainNegatives.end());
+	folds[fold].TrainPositives = make_shared<SampleSet>();
+	folds[fold].TrainNegatives = make_shared<SampleSet>();
+	folds[fold].TrainPositives->AppendSelected(pos, trainPositives);
+	folds[fold].TrainNegatives->AppendSelected(neg, trainNegatives);
+	folds[fold].TrainPositives->Deduplicate();
+	folds[fold].TrainNegatives->Deduplicate();
+}
+
+/** Evalua el comite del pliegue sobre sus muestras de prueba, sin copiarlas
+*/
+CrossValidator::TFoldResult CrossValidator::Evaluate(const SampleSet& pos, const SampleSet& neg, const TFold& fold) const
+{
+	MajorityVote vote(fold.Models);
+	MajorityVote::TTally tally;
+	MajorityVote::TVote ignore = [](size_t, bool){};
+	TFoldResult result;
+	for(size_t k=0; k<fold.Positives.size(); k++)
+	{
+		size_t i = fold.Positives[k];
+		if(vote.IsCorrect(pos[i], true, ignore, tally)) result.TruePositives += pos.GetWeight(i);
+		result.Positives += pos.GetWeight(i);
+		if((k + 1) % MajorityVote::ReorderEverySamples == 0) vote.Update(tally);
+	}
+	for(size_t k=0; k<fold.Negatives.size(); k++)
+	{
+		size_t i = fold.Negatives[k];
+		if(vote.IsCorrect(neg[i], false, ignore, tally)) result.TrueNegatives += neg.GetWeight(i);
+		result.Negatives += neg.GetWeight(i);
+		if((k + 1) % MajorityVote::ReorderEverySamples == 0) vote.Update(tally);
+	}
+	return result;
+}
+
+/** Entrena y evalua los pliegues. Las semillas de la particion y de cada modelo se derivan
+    de Seed antes de empezar, por lo que el resultado no depende de la cantidad de hilos.
+	Cada pliegue debe recibir al menos una muestra de cada clase para que sus metricas
+	esten definidas. Retorna los conteos de cada pliegue
+*/
+vector<CrossValidator::TFoldResult> CrossValidator::Run(const SampleSet& pos, const SampleSet& neg, unsigned alpha)
+{
+	if(Folds < 2)
+	{
+		throw runtime_error("La validacion cruzada requiere al menos 2 pliegues");
+	}
+	if(Models == 0)
+	{
+		throw runtime_error("La validacion cruzada requiere al menos un modelo por pliegue");
+	}
+	// el reparto por posicion deja al menos una muestra de cada clase en cada pliegue
+	if(pos.size() < Folds)
+	{
+		throw runtime_error("Hay menos muestras positivas que pliegues");
+	}
+	if(neg.size() < Folds)
+	{
+		throw runtime_error("Hay menos muestras negativas que pliegues");
+	}
+
+	minstd_rand engine(Seed);
+	vector<vector<size_t>> positiveParts, negativeParts;
+	Partition(pos.size(), (unsigned)engine(), positiveParts);
+	Partition(neg.size(), (unsigned)engine(), negativeParts);
+	vector<TFold> folds(Folds);
+	for(unsigned f=0; f<Folds; f++)
+	{
+		folds[f].Positives.swap(positiveParts[f]);
+		folds[f].Negatives.swap(negativeParts[f]);
+		folds[f].Models.assign(Models, Nfa(alpha));
+		folds[f].Pending = Models;
+	}
+	size_t total = (size_t)Folds * Models;
+	// minstd_rand entrega valores en [1, 2^31-2], siempre validos como OilTrainer::Seed
+	vector<int> seeds(total);
+	for(size_t t=0; t<total; t++) seeds[t] = (int)engine();
+
+	// los modelos se toman en orden de pliegue para que vivan pocos conjuntos de entrenamiento
+	vector<TFoldResult> results(Folds);
+	atomic<size_t> next(0);
+	atomic<bool> failed(false);
+	size_t finished = 0;
+	mutex foldsMutex;
+	unsigned jobs = Jobs == 0 ? max(1u, thread::hardware_concurrency()) : Jobs;
+	WorkerPool pool;
+	pool.Start((unsigned)min<size_t>(jobs, total));
+	pool.Run([&](unsigned)
+	{
+		try
+		{
+			for(size_t t; !failed && (t = next++) < total; )
+			{
+				unsigned f = (unsigned)(t / Models);
+				unsigned m = (unsigned)(t % Models);
+				shared_ptr<SampleSet> trainPositives, trainNegatives;
+				{
+					lock_guard<mutex> lock(foldsMutex);
+					if(!folds[f].TrainPositives) BuildTrainingSets(pos, neg, f, folds);
+					trainPositives = folds[f].TrainPositives;
+					trainNegatives = folds[f].TrainNegatives;
+				}
+
+				OilTrainer trainer;
+				if(Configure) Configure(trainer);
+				trainer.Seed = seeds[t];
+				auto ndfa = trainer.Train(*trainPositives, *trainNegatives, alpha);
+				folds[f].Models[m] = *ndfa;
+				delete ndfa;
+				trainPositives.reset();
+				trainNegatives.reset();
+
+				bool last;
+				{
+					lock_guard<mutex> lock(foldsMutex);
+					last = --folds[f].Pending == 0;
+					if(last)
+					{
+						folds[f].TrainPositives.reset();
+						folds[f].TrainNegatives.reset();
+					}
+					finished++;
+					if(ShowProgress) cout << "Progreso global: pliegue " << f << ", modelo " << m << " (" << (finished*100/total) << "%)" << endl;
+				}
+				if(last) results[f] = Evaluate(pos, neg, folds[f]);
+			}
+		}
+		catch(...)
+		{
+			failed = true;
+			throw;
+		}
+	});
+	pool.Stop();
+	return results;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "Nfa.h"
+#include "SampleSet.h"
+#include "OilTrainer.h"
+#include <vector>
+#include <memory>
+#include <functional>
+
+/** Validacion cruzada de k pliegues en memoria. Las muestras se reparten entre los
+    pliegues por posicion, positivas y negativas por separado, en orden aleatorio. Cada
+	pliegue se evalua con un comite de modelos entrenados con las muestras de los demas
+	pliegues. Los modelos de todos los pliegues se entrenan en paralelo y cada pliegue se
+	evalua, sobre los modelos en memoria, en cuanto termina su ultimo modelo. Los
+	conjuntos de entrenamiento de un pliegue existen solo mientras se entrenan sus modelos
+*/
+class CrossValidator
+{
+public:
+	/// Conteos de la evaluacion de un pliegue; cada muestra cuenta con su peso
+	struct TFoldResult
+	{
+		unsigned long long TruePositives;
+		unsigned long long TrueNegatives;
+		unsigned long long Positives;
+		unsigned long long Negatives;
+
+		TFoldResult() : TruePositives(0), TrueNegatives(0), Positives(0), Negatives(0) {}
+	};
+
+	/// Configura cada entrenador antes de entrenar un modelo
+	typedef std::function<void(OilTrainer& trainer)> TConfigure;
+
+private:
+	struct TFold
+	{
+		// posiciones de las muestras de prueba del pliegue en los conjuntos completos
+		std::vector<size_t> Positives;
+		std::vector<size_t> Negatives;
+		std::shared_ptr<SampleSet> TrainPositives;
+		std::shared_ptr<SampleSet> TrainNegatives;
+		std::vector<Nfa> Models;
+		unsigned Pending;
+	};
+
+	void Partition(size_t count, unsigned seed, std::vector<std::vector<size_t>>& parts) const;
+	void BuildTrainingSets(const SampleSet& pos, const SampleSet& neg, unsigned fold, std::vector<TFold>& folds) const;
+	TFoldResult Evaluate(const SampleSet& pos, const SampleSet& neg, const TFold& fold) const;
+
+public:
+	/// Cantidad de pliegues
+	unsigned Folds;
+	/// Modelos del comite de cada pliegue
+	unsigned Models;
+	/// Hilos que entrenan modelos (0: tantos como nucleos)
+	unsigned Jobs;
+	/// Informa el avance de cada modelo entrenado
+	bool ShowProgress;
+	/// Semilla de la particion y de los modelos, no usa rand()
+	unsigned Seed;
+	TConfigure Configure;
+
+	std::vector<TFoldResult> Run(const SampleSet& pos, const SampleSet& neg, unsigned alpha);
+
+	CrossValidator();
+};
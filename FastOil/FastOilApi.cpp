@@ -0,0 +1,849 @@
+#include "StdAfx.h"
+#include "FastOilApi.h"
+#include "Nfa.h"
+#include "SampleSet.h"
+#include "OilTrainer.h"
+#include "NfaDotExporter.h"
+#include "WorkerPool.h"
+#include "SamplesReader.h"
+#include "SampleGenerator.h"
+#include "MultiProcessTrainer.h"
+#include "CrossValidator.h"
+#include "ModelEvaluator.h"
+#include "ClassificationServer.h"
+#include "Profiler.h"
+#include <sstream>
+#include <memory>
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+
+#ifdef _MSC_VER
+#define FASTOIL_THREAD_LOCAL __declspec(thread)
+#else
+#define FASTOIL_THREAD_LOCAL __thread
+#endif
+
+struct fastoil_model
+{
+	std::vector<Nfa> Models;
+};
+
+// Muestras de un archivo, ordenadas y sin repetir: el entrenador no las modifica
+struct fastoil_samples
+{
+	SampleSet Positives;
+	SampleSet Negatives;
+	unsigned AlphabetLength;
+	size_t DuplicatePositives;
+	size_t DuplicateNegatives;
+};
+
+struct fastoil_session
+{
+	OilTrainer Trainer;
+	std::string Profile;
+};
+
+struct fastoil_generator
+{
+	SampleGenerator Generator;
+	std::unique_ptr<Nfa> Target;
+
+	explicit fastoil_generator(unsigned seed) : Generator(seed) {}
+};
+
+// ultimo error de cada hilo
+static FASTOIL_THREAD_LOCAL char _lastError[256];
+
+void _setError(const char* message)
+{
+	strncpy(_lastError, message, sizeof(_lastError) - 1);
+	_lastError[sizeof(_lastError) - 1] = '\0';
+}
+
+// Ejecuta function y traduce sus excepciones al codigo de retorno de la interfaz C
+template<class TFunction>
+int _call(TFunction function)
+{
+	try
+	{
+		function();
+		return FASTOIL_OK;
+	}
+	catch(const exception& e)
+	{
+		_setError(e.what());
+	}
+	catch(...)
+	{
+		_setError("Error desconocido");
+	}
+	return FASTOIL_ERROR;
+}
+
+// Vista de la muestra i de un buffer del llamador. Verifica las posiciones y los simbolos
+SampleSet::TSampleView _sampleView(const fastoil_symbol* symbols, const size_t* offsets, size_t i, unsigned alpha)
+{
+	if(offsets[i+1] < offsets[i])
+	{
+		throw runtime_error("Las posiciones de las muestras deben ser crecientes");
+	}
+	const fastoil_symbol* begin = symbols + offsets[i];
+	const fastoil_symbol* end = symbols + offsets[i+1];
+	for(auto s=begin; s!=end; ++s)
+	{
+		if(*s >= alpha) throw runtime_error("Simbolo fuera del alfabeto");
+	}
+	return SampleSet::TSampleView((const unsigned char*)begin, end - begin, sizeof(fastoil_symbol));
+}
+
+// Copia text en un buffer nuevo terminado en nulo que se libera con fastoil_free()
+void _copyText(const string& text, char** data, size_t* size)
+{
+	auto buffer = (char*)malloc(text.size() + 1);
+	if(buffer == NULL) throw bad_alloc();
+	memcpy(buffer, text.c_str(), text.size() + 1);
+	*data = buffer;
+	*size = text.size();
+}
+
+// Automata index del comite
+const Nfa& _automaton(const fastoil_model* model, size_t index)
+{
+	if(index >= model->Models.size()) throw runtime_error("Indice de automata fuera del comite");
+	return model->Models[index];
+}
+
+// Semilla del comite de las opciones, sin tocar el estado de rand() del proceso
+unsigned _committeeSeed(int seed)
+{
+	return seed >= 0 ? (unsigned)seed : random_device()();
+}
+
+// Aplica las opciones de entrenamiento a un entrenador
+void _configure(OilTrainer& trainer, const fastoil_train_options& options)
+{
+	trainer.ShowProgress = options.show_progress != 0;
+	trainer.ShowMerges = options.show_merges != 0;
+	trainer.ShowPossibleMerges = options.show_merges != 0;
+	trainer.SkipSearchBestMerge = options.skip_search != 0;
+	trainer.DoNotUseRandomSort = options.no_random != 0;
+	trainer.UseNegativePrefilter = options.no_prefilter == 0;
+	trainer.PrefilterMemoryLimit = (size_t)options.prefilter_memory << 20;
+	trainer.Threads = options.threads;
+	trainer.SpeculativeStates = options.speculative_states;
+	trainer.TimeBudgetSeconds = options.time_budget;
+	trainer.CheckpointFilename = options.checkpoint != NULL ? options.checkpoint : "";
+	trainer.CheckpointEverySamples = options.checkpoint_samples;
+	trainer.CheckpointEverySeconds = options.checkpoint_seconds;
+	trainer.ResumeFilename = options.resume != NULL ? options.resume : "";
+	if(options.conflict_policy == FASTOIL_CONFLICT_RETRAIN) trainer.ConflictPolicy = OilTrainer::RetrainOnConflict;
+	else if(options.conflict_policy == FASTOIL_CONFLICT_IGNORE) trainer.ConflictPolicy = OilTrainer::IgnoreConflicts;
+	else if(options.conflict_policy == FASTOIL_CONFLICT_REJECT) trainer.ConflictPolicy = OilTrainer::RejectConflicts;
+	else throw runtime_error("Politica de conflicto invalida");
+}
+
+// Activa el perfil del entrenamiento mientras existe, si filename no esta vacio
+class TProfileScope
+{
+	bool opened;
+
+public:
+	explicit TProfileScope(const string& filename) : opened(!filename.empty())
+	{
+		if(opened) Profiler::Open(filename);
+	}
+	~TProfileScope()
+	{
+		if(opened) Profiler::Close();
+	}
+};
+
+// Entrena los automatas del comite con las semillas de train_multiple. Con procesos de
+// trabajo cada automata vuelve serializado al coordinador
+void _trainCommittee(SampleSet& pos, SampleSet& neg, unsigned alpha, const fastoil_train_options& options, fastoil_model& trained)
+{
+	if(options.models == 0) throw runtime_error("El comite requiere al menos un automata");
+	bool checkpoints = options.checkpoint != NULL || options.resume != NULL;
+	if(checkpoints && (options.models != 1 || options.workers > 0))
+	{
+		throw runtime_error("Los puntos de control solo estan disponibles con un automata sin procesos de trabajo");
+	}
+	if(options.profile != NULL && options.workers > 0)
+	{
+		throw runtime_error("El perfil de entrenamiento no esta disponible con procesos de trabajo");
+	}
+	auto seeds = OilTrainer::CommitteeSeeds(_committeeSeed(options.seed), options.models);
+	trained.Models.assign(options.models, Nfa(alpha));
+	auto done = [&](unsigned j)
+	{
+		if(options.trained == NULL) return;
+		fastoil_model automaton;
+		automaton.Models.push_back(trained.Models[j]);
+		options.trained(options.context, j, &automaton);
+	};
+
+	if(options.workers > 0)
+	{
+		MultiProcessTrainer coordinator;
+		coordinator.Workers = options.workers;
+		coordinator.Share(pos, neg);
+		if(options.show_progress) cout << "Muestras compartidas: " << coordinator.GetSharedBytes() << " bytes, " << options.workers << " procesos" << endl;
+		// los procesos no muestran su progreso para no mezclar la salida
+		coordinator.Run(options.models, [&](unsigned j, SampleSet& sharedPos, SampleSet& sharedNeg)
+		{
+			OilTrainer trainer;
+			_configure(trainer, options);
+			trainer.ShowProgress = false;
+			trainer.ShowMerges = false;
+			trainer.ShowPossibleMerges = false;
+			trainer.Seed = seeds[j];
+			unique_ptr<Nfa> ndfa(trainer.Train(sharedPos, sharedNeg, alpha));
+			ostringstream output;
+			NfaDotExporter::ExportDestinoPlainText(*ndfa, output);
+			return output.str();
+		}, [&](unsigned j, const string& text)
+		{
+			istringstream input(text);
+			trained.Models[j] = NfaDotExporter::ImportDestinoPlainText(input);
+			done(j);
+		});
+		return;
+	}
+
+	TProfileScope profile(options.profile != NULL ? options.profile : "");
+	for(unsigned j=0; j<options.models; j++)
+	{
+		OilTrainer trainer;
+		_configure(trainer, options);
+		trainer.Seed = seeds[j];
+		unique_ptr<Nfa> ndfa(trainer.Train(pos, neg, alpha));
+		trained.Models[j] = *ndfa;
+		done(j);
+	}
+}
+
+// Copia los conteos de una evaluacion a la estructura de la interfaz C
+void _copyEvaluation(const ModelEvaluator::TResult& result, fastoil_evaluation* evaluation)
+{
+	if(evaluation == NULL) return;
+	evaluation->true_positives = result.TruePositives;
+	evaluation->true_negatives = result.TrueNegatives;
+	evaluation->positives = result.Positives;
+	evaluation->negatives = result.Negatives;
+	evaluation->queries = result.Queries;
+	evaluation->full_queries = result.FullQueries;
+}
+
+/** Describe el ultimo error del hilo que llama
+*/
+const char* fastoil_last_error(void)
+{
+	return _lastError;
+}
+
+/** Libera la memoria entregada por fastoil_model_write() y fastoil_evaluation_format()
+*/
+void fastoil_free(void* data)
+{
+	free(data);
+}
+
+/** Crea un comite vacio
+*/
+int fastoil_model_create(fastoil_model** model)
+{
+	return _call([&]
+	{
+		if(model == NULL) throw runtime_error("Argumento nulo");
+		*model = new fastoil_model();
+	});
+}
+
+/** Carga un modelo en texto plano, comprimido o no, como un comite de un automata
+*/
+int fastoil_model_load(const char* filename, fastoil_model** model)
+{
+	return _call([&]
+	{
+		if(filename == NULL || model == NULL) throw runtime_error("Argumento nulo");
+		unique_ptr<fastoil_model> loaded(new fastoil_model());
+		loaded->Models.push_back(NfaDotExporter::ImportDestinoPlainText(filename));
+		*model = loaded.release();
+	});
+}
+
+/** Carga como un comite los modelos indicados en un manifiesto
+*/
+int fastoil_ensemble_load(const char* manifestFilename, fastoil_model** model)
+{
+	return _call([&]
+	{
+		if(manifestFilename == NULL || model == NULL) throw runtime_error("Argumento nulo");
+		unique_ptr<fastoil_model> loaded(new fastoil_model());
+		NfaDotExporter::ImportManifest(manifestFilename, loaded->Models);
+		*model = loaded.release();
+	});
+}
+
+/** Agrega al comite un automata en texto plano leido de memoria, como lo entrega
+    fastoil_model_write()
+*/
+int fastoil_model_read(fastoil_model* model, const char* data, size_t size)
+{
+	return _call([&]
+	{
+		if(model == NULL || (data == NULL && size > 0)) throw runtime_error("Argumento nulo");
+		istringstream input(string(data, size));
+		model->Models.push_back(NfaDotExporter::ImportDestinoPlainText(input));
+	});
+}
+
+/** Escribe en texto plano el automata index del comite en un buffer nuevo de *size bytes,
+    terminado en nulo, que se libera con fastoil_free()
+*/
+int fastoil_model_write(const fastoil_model* model, size_t index, char** data, size_t* size)
+{
+	return _call([&]
+	{
+		if(model == NULL || data == NULL || size == NULL) throw runtime_error("Argumento nulo");
+		ostringstream output;
+		NfaDotExporter::ExportDestinoPlainText(_automaton(model, index), output);
+		_copyText(output.str(), data, size);
+	});
+}
+
+/** Guarda en texto plano el automata index del comite. Si filename termina en .gz o .zst
+    se escribe comprimido
+*/
+int fastoil_model_save(const fastoil_model* model, size_t index, const char* filename)
+{
+	return _call([&]
+	{
+		if(model == NULL || filename == NULL) throw runtime_error("Argumento nulo");
+		NfaDotExporter::ExportDestinoPlainText(_automaton(model, index), filename);
+	});
+}
+
+/** Guarda el automata index del comite en formato dot de Graphviz
+*/
+int fastoil_model_save_dot(const fastoil_model* model, size_t index, const char* filename)
+{
+	return _call([&]
+	{
+		if(model == NULL || filename == NULL) throw runtime_error("Argumento nulo");
+		NfaDotExporter::Export(_automaton(model, index), filename);
+	});
+}
+
+void fastoil_model_free(fastoil_model* model)
+{
+	delete model;
+}
+
+size_t fastoil_model_count(const fastoil_model* model)
+{
+	return model == NULL ? 0 : model->Models.size();
+}
+
+/** Longitud del alfabeto que aceptan todos los automatas del comite
+*/
+unsigned fastoil_model_alphabet_length(const fastoil_model* model)
+{
+	if(model == NULL || model->Models.empty()) return 0;
+	unsigned alpha = model->Models[0].GetAlphabetLenght();
+	for(size_t j=1; j<model->Models.size(); j++) alpha = min(alpha, model->Models[j].GetAlphabetLenght());
+	return alpha;
+}
+
+/** Lee un archivo de muestras, de texto o comprimido. Las muestras repetidas se reducen a
+    una sola y se cuentan en fastoil_samples_info; las etiquetadas como positivas y negativas
+	son un error
+*/
+int fastoil_samples_load(const char* filename, fastoil_samples** samples)
+{
+	return _call([&]
+	{
+		if(filename == NULL || samples == NULL) throw runtime_error("Argumento nulo");
+		unique_ptr<fastoil_samples> loaded(new fastoil_samples());
+		SamplesReader reader;
+		reader.ReadUniqueSamples(filename, loaded->Positives, loaded->Negatives, &loaded->AlphabetLength);
+		if(reader.Conflicts > 0)
+		{
+			throw runtime_error(boost::lexical_cast<string>(reader.Conflicts) + " muestras estan etiquetadas como positivas y negativas");
+		}
+		loaded->DuplicatePositives = reader.DuplicatePositives;
+		loaded->DuplicateNegatives = reader.DuplicateNegatives;
+		*samples = loaded.release();
+	});
+}
+
+int fastoil_samples_describe(const fastoil_samples* samples, fastoil_samples_info* info)
+{
+	return _call([&]
+	{
+		if(samples == NULL || info == NULL) throw runtime_error("Argumento nulo");
+		info->alphabet_length = samples->AlphabetLength;
+		info->positives = samples->Positives.size();
+		info->negatives = samples->Negatives.size();
+		info->duplicate_positives = samples->DuplicatePositives;
+		info->duplicate_negatives = samples->DuplicateNegatives;
+	});
+}
+
+void fastoil_samples_free(fastoil_samples* samples)
+{
+	delete samples;
+}
+
+/** Clasifica count muestras. classes[i] recibe 1 si la mayoria del comite reconoce la
+    muestra i y votes[i] los automatas que la reconocen; cualquiera de los dos puede ser
+	nulo. Con threads mayor que 1 las muestras se reparten en tramos contiguos entre
+	hilos creados para esta llamada
+*/
+int fastoil_classify(const fastoil_model* model, const fastoil_symbol* symbols, const size_t* offsets, size_t count,
+	unsigned char* classes, unsigned* votes, unsigned threads)
+{
+	return _call([&]
+	{
+		if(model == NULL || (count > 0 && (symbols == NULL || offsets == NULL))) throw runtime_error("Argumento nulo");
+		if(model->Models.empty()) throw runtime_error("El comite no tiene automatas");
+		auto& models = model->Models;
+		unsigned alpha = fastoil_model_alphabet_length(model);
+		size_t threshold = models.size() / 2;
+		auto classifyRange = [&](size_t first, size_t last)
+		{
+			for(size_t i=first; i<last; i++)
+			{
+				auto sample = _sampleView(symbols, offsets, i, alpha);
+				unsigned v = 0;
+				for(size_t j=0; j<models.size(); j++) if(sample.IsMatchedBy(models[j])) v++;
+				if(classes != NULL) classes[i] = v > threshold ? 1 : 0;
+				if(votes != NULL) votes[i] = v;
+			}
+		};
+		unsigned workers = (unsigned)min<size_t>(max(1u, threads), count);
+		if(workers <= 1)
+		{
+			classifyRange(0, count);
+			return;
+		}
+		WorkerPool pool;
+		pool.Start(workers);
+		pool.Run([&](unsigned w)
+		{
+			classifyRange(count * w / workers, count * (w + 1) / workers);
+		});
+		pool.Stop();
+	});
+}
+
+void fastoil_train_options_init(fastoil_train_options* options)
+{
+	if(options == NULL) return;
+	options->models = 1;
+	options->seed = -1;
+	options->skip_search = 0;
+	options->no_random = 0;
+	options->no_prefilter = 0;
+	options->threads = 0;
+	options->time_budget = 0;
+	options->show_progress = 0;
+	options->show_merges = 0;
+	options->prefilter_memory = 1024;
+	options->speculative_states = 0;
+	options->workers = 0;
+	options->checkpoint = NULL;
+	options->checkpoint_samples = 0;
+	options->checkpoint_seconds = 600;
+	options->resume = NULL;
+	options->profile = NULL;
+	options->conflict_policy = FASTOIL_CONFLICT_RETRAIN;
+	options->trained = NULL;
+	options->context = NULL;
+}
+
+/** Entrena un comite con count muestras etiquetadas (labels[i] distinto de cero: positiva)
+    sobre un alfabeto de alpha simbolos. options puede ser nulo
+*/
+int fastoil_train(const fastoil_symbol* symbols, const size_t* offsets, const unsigned char* labels, size_t count,
+	unsigned alpha, const fastoil_train_options* options, fastoil_model** model)
+{
+	return _call([&]
+	{
+		if(model == NULL || (count > 0 && (symbols == NULL || offsets == NULL || labels == NULL))) throw runtime_error("Argumento nulo");
+		if(alpha == 0) throw runtime_error("El alfabeto no puede estar vacio");
+		fastoil_train_options defaults;
+		fastoil_train_options_init(&defaults);
+		if(options == NULL) options = &defaults;
+
+		SampleSet pos, neg;
+		pos.SetAlphabetLength(alpha);
+		neg.SetAlphabetLength(alpha);
+		for(size_t i=0; i<count; i++)
+		{
+			_sampleView(symbols, offsets, i, alpha);
+			auto& set = labels[i] != 0 ? pos : neg;
+			set.Add(symbols + offsets[i], symbols + offsets[i+1]);
+		}
+
+		unique_ptr<fastoil_model> trained(new fastoil_model());
+		_trainCommittee(pos, neg, alpha, *options, *trained);
+		*model = trained.release();
+	});
+}
+
+/** Entrena un comite con las muestras de un archivo. options puede ser nulo
+*/
+int fastoil_train_samples(const fastoil_samples* samples, const fastoil_train_options* options, fastoil_model** model)
+{
+	return _call([&]
+	{
+		if(samples == NULL || model == NULL) throw runtime_error("Argumento nulo");
+		fastoil_train_options defaults;
+		fastoil_train_options_init(&defaults);
+		if(options == NULL) options = &defaults;
+
+		// las muestras ya estan ordenadas y sin repetir, el entrenamiento no las modifica
+		auto& pos = const_cast<SampleSet&>(samples->Positives);
+		auto& neg = const_cast<SampleSet&>(samples->Negatives);
+		unique_ptr<fastoil_model> trained(new fastoil_model());
+		_trainCommittee(pos, neg, samples->AlphabetLength, *options, *trained);
+		*model = trained.release();
+	});
+}
+
+// Sesion con las opciones de entrenamiento; la semilla es la del comite de un automata
+fastoil_session* _newSession(const fastoil_train_options* options)
+{
+	fastoil_train_options defaults;
+	fastoil_train_options_init(&defaults);
+	if(options == NULL) options = &defaults;
+	if(options->workers > 0 || options->checkpoint != NULL || options->resume != NULL)
+	{
+		throw runtime_error("Las sesiones no admiten procesos de trabajo ni puntos de control");
+	}
+	unique_ptr<fastoil_session> session(new fastoil_session());
+	_configure(session->Trainer, *options);
+	session->Trainer.Seed = OilTrainer::CommitteeSeeds(_committeeSeed(options->seed), 1)[0];
+	if(options->profile != NULL) session->Profile = options->profile;
+	return session.release();
+}
+
+/** Inicia una sesion de entrenamiento incremental vacia sobre un alfabeto de alpha simbolos.
+    options puede ser nulo
+*/
+int fastoil_session_create(unsigned alpha, const fastoil_train_options* options, fastoil_session** session)
+{
+	return _call([&]
+	{
+		if(session == NULL) throw runtime_error("Argumento nulo");
+		if(alpha == 0) throw runtime_error("El alfabeto no puede estar vacio");
+		unique_ptr<fastoil_session> created(_newSession(options));
+		created->Trainer.BeginSession(alpha);
+		*session = created.release();
+	});
+}
+
+/** Continua una sesion guardada con fastoil_session_save(). options puede ser nulo
+*/
+int fastoil_session_load(const char* filename, const fastoil_train_options* options, fastoil_session** session)
+{
+	return _call([&]
+	{
+		if(filename == NULL || session == NULL) throw runtime_error("Argumento nulo");
+		unique_ptr<fastoil_session> loaded(_newSession(options));
+		loaded->Trainer.LoadSession(filename);
+		*session = loaded.release();
+	});
+}
+
+/** Agrega las muestras a la sesion: primero las negativas, para que las nuevas positivas
+    las respeten. Solo las positivas que el modelo no reconoce lo modifican. update puede
+	ser nulo
+*/
+int fastoil_session_add(fastoil_session* session, const fastoil_samples* samples, fastoil_session_update* update)
+{
+	return _call([&]
+	{
+		if(session == NULL || samples == NULL) throw runtime_error("Argumento nulo");
+		auto& trainer = session->Trainer;
+		if(samples->AlphabetLength != trainer.GetModel().GetAlphabetLenght())
+		{
+			throw runtime_error("La longitud del alfabeto no corresponde a la de la sesion");
+		}
+		TProfileScope profile(session->Profile);
+
+		OilTrainer::TSamples negatives;
+		negatives.reserve(samples->Negatives.size());
+		for(size_t i=0; i<samples->Negatives.size(); i++) negatives.push_back(samples->Negatives[i].ToSample());
+		auto ignored = trainer.IgnoredNegatives;
+		bool retrained = trainer.AddNegatives(negatives);
+		ignored = trainer.IgnoredNegatives - ignored;
+
+		auto& pos = samples->Positives;
+		size_t changes = 0;
+		for(size_t i=0; i<pos.size(); i++)
+		{
+			if(trainer.AddPositive(pos[i].ToSample())) changes++;
+			if(trainer.ShowProgress && (i+1) % 100 == 0)
+			{
+				cout << "Procesada muestra " << (i+1) << " de " << pos.size() << " (" << ((i+1)*100L/pos.size()) << "%)" << endl;
+			}
+		}
+		if(update == NULL) return;
+		update->retrained = retrained ? 1 : 0;
+		update->ignored_negatives = ignored;
+		update->changes = changes;
+		update->positives = trainer.GetPositiveCount();
+		update->negatives = trainer.GetNegativeCount();
+	});
+}
+
+int fastoil_session_save(const fastoil_session* session, const char* filename)
+{
+	return _call([&]
+	{
+		if(session == NULL || filename == NULL) throw runtime_error("Argumento nulo");
+		session->Trainer.SaveSession(filename);
+	});
+}
+
+/** Copia el modelo actual de la sesion como un comite de un automata
+*/
+int fastoil_session_model(const fastoil_session* session, fastoil_model** model)
+{
+	return _call([&]
+	{
+		if(session == NULL || model == NULL) throw runtime_error("Argumento nulo");
+		unique_ptr<fastoil_model> copy(new fastoil_model());
+		copy->Models.push_back(session->Trainer.GetModel());
+		*model = copy.release();
+	});
+}
+
+void fastoil_session_free(fastoil_session* session)
+{
+	delete session;
+}
+
+void fastoil_evaluate_options_init(fastoil_evaluate_options* options)
+{
+	if(options == NULL) return;
+	options->report = FASTOIL_REPORT_TEXT;
+	options->early_vote = 0;
+	options->auc = 0;
+	options->jobs = 1;
+}
+
+/** Evalua el comite sobre un archivo de muestras etiquetadas, sin cargarlo completo, y
+    escribe el reporte en reportFilename. options y evaluation pueden ser nulos
+*/
+int fastoil_evaluate(const fastoil_model* model, const char* samplesFilename, const char* reportFilename,
+	const fastoil_evaluate_options* options, fastoil_evaluation* evaluation)
+{
+	return _call([&]
+	{
+		if(model == NULL || samplesFilename == NULL || reportFilename == NULL) throw runtime_error("Argumento nulo");
+		if(model->Models.empty()) throw runtime_error("El comite no tiene automatas");
+		fastoil_evaluate_options defaults;
+		fastoil_evaluate_options_init(&defaults);
+		if(options == NULL) options = &defaults;
+		if(options->report < FASTOIL_REPORT_TEXT || options->report > FASTOIL_REPORT_SWEEP) throw runtime_error("Formato de reporte invalido");
+
+		ModelEvaluator evaluator;
+		evaluator.Format = (ModelEvaluator::TReportFormat)options->report;
+		evaluator.EarlyVote = options->early_vote != 0;
+		evaluator.Auc = options->auc != 0;
+		evaluator.Jobs = options->jobs;
+		_copyEvaluation(evaluator.Evaluate(model->Models, samplesFilename, reportFilename), evaluation);
+	});
+}
+
+/** Escribe en reportFilename las metricas de cada umbral a partir de una matriz de votos
+    escrita con FASTOIL_REPORT_BINARY o FASTOIL_REPORT_CSV. evaluation recibe los conteos
+	de la votacion por mayoria y puede ser nulo
+*/
+int fastoil_sweep(const char* votesFilename, const char* reportFilename, int auc, fastoil_evaluation* evaluation)
+{
+	return _call([&]
+	{
+		if(votesFilename == NULL || reportFilename == NULL) throw runtime_error("Argumento nulo");
+		_copyEvaluation(ModelEvaluator::Sweep(votesFilename, reportFilename, auc != 0), evaluation);
+	});
+}
+
+/** Validacion cruzada de folds pliegues en memoria con comites de options->models automatas
+    entrenados con jobs hilos (0: tantos como nucleos). evaluations recibe los conteos de
+	cada pliegue. Con la misma semilla el resultado no depende de jobs
+*/
+int fastoil_crossvalidate(const fastoil_samples* samples, unsigned folds, unsigned jobs, const fastoil_train_options* options,
+	fastoil_evaluation* evaluations)
+{
+	return _call([&]
+	{
+		// con menos de 2 pliegues el error lo informa el validador aunque no haya resultados
+		if(samples == NULL || (folds > 0 && evaluations == NULL)) throw runtime_error("Argumento nulo");
+		fastoil_train_options defaults;
+		fastoil_train_options_init(&defaults);
+		if(options == NULL) options = &defaults;
+		if(options->workers > 0 || options->checkpoint != NULL || options->resume != NULL || options->profile != NULL)
+		{
+			throw runtime_error("La validacion cruzada no admite procesos de trabajo, puntos de control ni perfil");
+		}
+
+		CrossValidator validator;
+		validator.Folds = folds;
+		validator.Models = options->models;
+		validator.Jobs = jobs;
+		validator.ShowProgress = options->show_progress != 0;
+		validator.Seed = _committeeSeed(options->seed);
+		// los entrenamientos paralelos no muestran su progreso para no mezclar la salida
+		validator.Configure = [options](OilTrainer& trainer)
+		{
+			_configure(trainer, *options);
+			trainer.ShowProgress = false;
+			trainer.ShowMerges = false;
+			trainer.ShowPossibleMerges = false;
+		};
+		auto results = validator.Run(samples->Positives, samples->Negatives, samples->AlphabetLength);
+		for(unsigned f=0; f<folds; f++)
+		{
+			ModelEvaluator::TResult result;
+			result.TruePositives = results[f].TruePositives;
+			result.TrueNegatives = results[f].TrueNegatives;
+			result.Positives = results[f].Positives;
+			result.Negatives = results[f].Negatives;
+			_copyEvaluation(result, &evaluations[f]);
+		}
+	});
+}
+
+/** Describe en texto las metricas de una evaluacion (exactitud, sensibilidad, especificidad
+    y MCC) en un buffer nuevo que se libera con fastoil_free()
+*/
+int fastoil_evaluation_format(const fastoil_evaluation* evaluation, char** text, size_t* size)
+{
+	return _call([&]
+	{
+		if(evaluation == NULL || text == NULL || size == NULL) throw runtime_error("Argumento nulo");
+		ostringstream output;
+		ModelEvaluator::ReportMetric(output, evaluation->true_positives, evaluation->true_negatives, evaluation->positives, evaluation->negatives);
+		_copyText(output.str(), text, size);
+	});
+}
+
+void fastoil_serve_options_init(fastoil_serve_options* options)
+{
+	if(options == NULL) return;
+	options->socket = NULL;
+	options->threads = 0;
+	options->batch = 256;
+	options->batch_latency = 200;
+	options->votes = 0;
+}
+
+/** Clasifica muestras sin etiqueta, una por linea con el formato "longitud s1 ... sn",
+    hasta que se cierra la entrada estandar o, con un socket, hasta un error. Ver
+	ClassificationServer. options puede ser nulo
+*/
+int fastoil_serve(const fastoil_model* model, const fastoil_serve_options* options)
+{
+	return _call([&]
+	{
+		if(model == NULL) throw runtime_error("Argumento nulo");
+		if(model->Models.empty()) throw runtime_error("El comite no tiene automatas");
+		fastoil_serve_options defaults;
+		fastoil_serve_options_init(&defaults);
+		if(options == NULL) options = &defaults;
+
+		ClassificationServer server(model->Models);
+		server.Threads = options->threads;
+		server.MaxBatchSamples = options->batch;
+		server.MaxBatchMicroseconds = options->batch_latency;
+		server.ReportVotes = options->votes != 0;
+		if(options->socket == NULL) server.ServeStream(cin, cout);
+		else server.ServeSocket(options->socket);
+	});
+}
+
+void fastoil_generator_options_init(fastoil_generator_options* options)
+{
+	if(options == NULL) return;
+	SampleGenerator generator(0);
+	options->states = generator.States;
+	options->alphabet_length = generator.AlphabetLength;
+	options->deterministic = generator.Deterministic ? 1 : 0;
+	options->density = generator.Density;
+	options->final_ratio = generator.FinalRatio;
+	options->min_length = generator.MinLength;
+	options->max_length = generator.MaxLength;
+	options->length_mean = generator.LengthMean;
+	options->length_sd = generator.LengthDeviation;
+	options->seed = -1;
+}
+
+/** Crea un generador de muestras y su automata objetivo aleatorio. options puede ser nulo
+*/
+int fastoil_generator_create(const fastoil_generator_options* options, fastoil_generator** generator)
+{
+	return _call([&]
+	{
+		if(generator == NULL) throw runtime_error("Argumento nulo");
+		fastoil_generator_options defaults;
+		fastoil_generator_options_init(&defaults);
+		if(options == NULL) options = &defaults;
+		if(options->states == 0 || options->alphabet_length == 0)
+		{
+			throw runtime_error("El automata objetivo requiere al menos un estado y un simbolo");
+		}
+
+		unique_ptr<fastoil_generator> created(new fastoil_generator(_committeeSeed(options->seed)));
+		auto& g = created->Generator;
+		g.States = options->states;
+		g.AlphabetLength = options->alphabet_length;
+		g.Deterministic = options->deterministic != 0;
+		g.Density = options->density;
+		g.FinalRatio = options->final_ratio;
+		g.MinLength = options->min_length;
+		g.MaxLength = options->max_length;
+		g.LengthMean = options->length_mean;
+		g.LengthDeviation = options->length_sd;
+		created->Target.reset(g.CreateTarget());
+		*generator = created.release();
+	});
+}
+
+/** Copia el automata objetivo del generador como un comite de un automata
+*/
+int fastoil_generator_target(const fastoil_generator* generator, fastoil_model** target)
+{
+	return _call([&]
+	{
+		if(generator == NULL || target == NULL) throw runtime_error("Argumento nulo");
+		unique_ptr<fastoil_model> copy(new fastoil_model());
+		copy->Models.push_back(*generator->Target);
+		*target = copy.release();
+	});
+}
+
+/** Escribe en un archivo de muestras count muestras nuevas, la mitad positivas, etiquetadas
+    por el automata objetivo
+*/
+int fastoil_generator_write_samples(fastoil_generator* generator, const char* filename, unsigned count)
+{
+	return _call([&]
+	{
+		if(generator == NULL || filename == NULL) throw runtime_error("Argumento nulo");
+		SampleGenerator::TSamples pos, neg;
+		generator->Generator.Generate(*generator->Target, count / 2, count - count / 2, pos, neg);
+		SampleGenerator::WriteSamples(filename, pos, neg, generator->Generator.AlphabetLength);
+	});
+}
+
+void fastoil_generator_free(fastoil_generator* generator)
+{
+	delete generator;
+}
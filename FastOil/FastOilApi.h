@@ -0,0 +1,246 @@
+#pragma once
+
+/* Interfaz C estable de libfastoil. Los modelos se manejan con un puntero opaco que
+   contiene un comite de uno o mas automatas; un comite clasifica una muestra como
+   positiva si mas de la mitad entera de sus automatas la reconocen.
+   Las muestras se entregan en buffers del llamador: la muestra i ocupa los simbolos
+   symbols[offsets[i]] .. symbols[offsets[i+1]-1], de modo que offsets tiene count+1
+   posiciones. Tambien pueden leerse de un archivo de muestras como fastoil_samples.
+   Las funciones retornan FASTOIL_OK o FASTOIL_ERROR; fastoil_last_error() describe el
+   ultimo error del hilo que llama. Un modelo puede usarse para clasificar desde varios
+   hilos a la vez mientras ninguno lo modifique.
+   El ejecutable fastoil es un cliente de esta interfaz: sus comandos leen las opciones,
+   llaman a estas funciones e informan los resultados.
+   fastoil_train con seed da los mismos automatas que train_multiple con --seed */
+
+#include <stddef.h>
+
+#if defined(_WIN32) && defined(FASTOIL_DLL)
+#ifdef FASTOIL_EXPORTS
+#define FASTOIL_API __declspec(dllexport)
+#else
+#define FASTOIL_API __declspec(dllimport)
+#endif
+#elif defined(__GNUC__)
+#define FASTOIL_API __attribute__((visibility("default")))
+#else
+#define FASTOIL_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FASTOIL_OK 0
+#define FASTOIL_ERROR (-1)
+
+/* Politicas de una sesion incremental ante una muestra negativa que el modelo reconoce */
+#define FASTOIL_CONFLICT_RETRAIN 0
+#define FASTOIL_CONFLICT_IGNORE 1
+#define FASTOIL_CONFLICT_REJECT 2
+
+/* Contenido del reporte de fastoil_evaluate */
+#define FASTOIL_REPORT_TEXT 0
+#define FASTOIL_REPORT_CSV 1
+#define FASTOIL_REPORT_BINARY 2
+#define FASTOIL_REPORT_METRICS 3
+#define FASTOIL_REPORT_SWEEP 4
+
+typedef unsigned int fastoil_symbol;
+typedef struct fastoil_model fastoil_model;
+typedef struct fastoil_samples fastoil_samples;
+typedef struct fastoil_session fastoil_session;
+typedef struct fastoil_generator fastoil_generator;
+
+/* Recibe cada automata entrenado en el hilo que llamo a fastoil_train; automaton es un
+   comite de solo ese automata, valido durante la llamada */
+typedef void (*fastoil_trained_callback)(void* context, unsigned index, const fastoil_model* automaton);
+
+/* Opciones de entrenamiento, se inicializan con fastoil_train_options_init() */
+typedef struct fastoil_train_options
+{
+	/* automatas del comite (por defecto 1) */
+	unsigned models;
+	/* semilla del comite; con la misma semilla el comite es el de train_multiple con --seed.
+	   No se usa rand() ni srand() (-1: semilla no determinista) */
+	int seed;
+	/* omite la busqueda de la mejor mezcla */
+	int skip_search;
+	/* mezcla los estados en orden determinista */
+	int no_random;
+	/* desactiva el prefiltro de muestras negativas */
+	int no_prefilter;
+	/* hilos que evaluan mezclas candidatas (0 o 1: secuencial) */
+	unsigned threads;
+	/* segundos por automata (0: sin limite) */
+	double time_budget;
+	/* escribe el avance y las mezclas del entrenamiento en la salida estandar */
+	int show_progress;
+	int show_merges;
+	/* megabytes que puede ocupar el prefiltro (por defecto 1024, 0: sin limite) */
+	unsigned prefilter_memory;
+	/* estados nuevos cuyas mezclas se evaluan por adelantado (0: tantos como hilos) */
+	unsigned speculative_states;
+	/* procesos que entrenan los automatas del comite con una copia compartida de las muestras (0: ninguno) */
+	unsigned workers;
+	/* punto de control de un comite de un automata: archivo, frecuencia en muestras
+	   positivas o en segundos (por defecto 600) y punto de control a reanudar. NULL: ninguno */
+	const char* checkpoint;
+	unsigned checkpoint_samples;
+	unsigned checkpoint_seconds;
+	const char* resume;
+	/* archivo del perfil del entrenamiento, NULL: sin perfil */
+	const char* profile;
+	/* politica de las sesiones incrementales (FASTOIL_CONFLICT_RETRAIN por defecto) */
+	int conflict_policy;
+	/* se llama al terminar cada automata, NULL: ninguna */
+	fastoil_trained_callback trained;
+	void* context;
+} fastoil_train_options;
+
+/* Descripcion de un archivo de muestras leido con fastoil_samples_load() */
+typedef struct fastoil_samples_info
+{
+	unsigned alphabet_length;
+	/* muestras distintas de cada clase */
+	size_t positives;
+	size_t negatives;
+	/* repeticiones descartadas al leer */
+	size_t duplicate_positives;
+	size_t duplicate_negatives;
+} fastoil_samples_info;
+
+/* Conteos de una evaluacion por mayoria; cada muestra cuenta con su peso */
+typedef struct fastoil_evaluation
+{
+	unsigned long long true_positives;
+	unsigned long long true_negatives;
+	unsigned long long positives;
+	unsigned long long negatives;
+	/* automatas consultados con votacion temprana y los que consultaria la votacion
+	   completa (0 con votacion completa) */
+	unsigned long long queries;
+	unsigned long long full_queries;
+} fastoil_evaluation;
+
+/* Opciones de fastoil_evaluate(), se inicializan con fastoil_evaluate_options_init() */
+typedef struct fastoil_evaluate_options
+{
+	/* FASTOIL_REPORT_* (por defecto FASTOIL_REPORT_TEXT) */
+	int report;
+	/* consulta los automatas solo hasta que la mayoria queda decidida */
+	int early_vote;
+	/* agrega el area bajo la curva ROC al reporte de umbrales */
+	int auc;
+	/* hilos que evaluan las muestras (0: tantos como nucleos, por defecto 1) */
+	unsigned jobs;
+} fastoil_evaluate_options;
+
+/* Resultado de agregar muestras a una sesion incremental */
+typedef struct fastoil_session_update
+{
+	/* el modelo se reentreno por una muestra negativa que reconocia */
+	int retrained;
+	/* muestras negativas descartadas por FASTOIL_CONFLICT_IGNORE */
+	size_t ignored_negatives;
+	/* muestras positivas que modificaron el modelo */
+	size_t changes;
+	/* muestras de la sesion despues de agregar */
+	size_t positives;
+	size_t negatives;
+} fastoil_session_update;
+
+/* Opciones de fastoil_serve(), se inicializan con fastoil_serve_options_init() */
+typedef struct fastoil_serve_options
+{
+	/* socket Unix que se atiende, NULL: entrada y salida estandar */
+	const char* socket;
+	/* hilos que evaluan cada lote (0: tantos como nucleos) */
+	unsigned threads;
+	/* muestras que cierran un lote (por defecto 256) */
+	size_t batch;
+	/* microsegundos que un lote incompleto espera desde su primera muestra (por defecto 200) */
+	unsigned batch_latency;
+	/* agrega a cada veredicto los votos positivos */
+	int votes;
+} fastoil_serve_options;
+
+/* Opciones del generador de muestras, se inicializan con fastoil_generator_options_init() */
+typedef struct fastoil_generator_options
+{
+	/* estados del automata objetivo y longitud del alfabeto (por defecto 16 y 4) */
+	unsigned states;
+	unsigned alphabet_length;
+	/* automata objetivo determinista (por defecto) o con density transiciones medias por estado y simbolo */
+	int deterministic;
+	double density;
+	/* probabilidad de que un estado sea final */
+	double final_ratio;
+	/* longitud uniforme en [min_length, max_length], o normal recortada si length_sd es mayor que cero */
+	unsigned min_length;
+	unsigned max_length;
+	double length_mean;
+	double length_sd;
+	/* semilla del generador (-1: semilla no determinista) */
+	int seed;
+} fastoil_generator_options;
+
+FASTOIL_API const char* fastoil_last_error(void);
+FASTOIL_API void fastoil_free(void* data);
+
+/* Creacion, lectura y escritura de modelos */
+FASTOIL_API int fastoil_model_create(fastoil_model** model);
+FASTOIL_API int fastoil_model_load(const char* filename, fastoil_model** model);
+FASTOIL_API int fastoil_ensemble_load(const char* manifestFilename, fastoil_model** model);
+FASTOIL_API int fastoil_model_read(fastoil_model* model, const char* data, size_t size);
+FASTOIL_API int fastoil_model_write(const fastoil_model* model, size_t index, char** data, size_t* size);
+FASTOIL_API int fastoil_model_save(const fastoil_model* model, size_t index, const char* filename);
+FASTOIL_API int fastoil_model_save_dot(const fastoil_model* model, size_t index, const char* filename);
+FASTOIL_API void fastoil_model_free(fastoil_model* model);
+FASTOIL_API size_t fastoil_model_count(const fastoil_model* model);
+FASTOIL_API unsigned fastoil_model_alphabet_length(const fastoil_model* model);
+
+/* Archivos de muestras */
+FASTOIL_API int fastoil_samples_load(const char* filename, fastoil_samples** samples);
+FASTOIL_API int fastoil_samples_describe(const fastoil_samples* samples, fastoil_samples_info* info);
+FASTOIL_API void fastoil_samples_free(fastoil_samples* samples);
+
+/* Clasificacion y entrenamiento */
+FASTOIL_API int fastoil_classify(const fastoil_model* model, const fastoil_symbol* symbols, const size_t* offsets, size_t count,
+	unsigned char* classes, unsigned* votes, unsigned threads);
+FASTOIL_API void fastoil_train_options_init(fastoil_train_options* options);
+FASTOIL_API int fastoil_train(const fastoil_symbol* symbols, const size_t* offsets, const unsigned char* labels, size_t count,
+	unsigned alpha, const fastoil_train_options* options, fastoil_model** model);
+FASTOIL_API int fastoil_train_samples(const fastoil_samples* samples, const fastoil_train_options* options, fastoil_model** model);
+
+/* Entrenamiento incremental */
+FASTOIL_API int fastoil_session_create(unsigned alpha, const fastoil_train_options* options, fastoil_session** session);
+FASTOIL_API int fastoil_session_load(const char* filename, const fastoil_train_options* options, fastoil_session** session);
+FASTOIL_API int fastoil_session_add(fastoil_session* session, const fastoil_samples* samples, fastoil_session_update* update);
+FASTOIL_API int fastoil_session_save(const fastoil_session* session, const char* filename);
+FASTOIL_API int fastoil_session_model(const fastoil_session* session, fastoil_model** model);
+FASTOIL_API void fastoil_session_free(fastoil_session* session);
+
+/* Evaluacion */
+FASTOIL_API void fastoil_evaluate_options_init(fastoil_evaluate_options* options);
+FASTOIL_API int fastoil_evaluate(const fastoil_model* model, const char* samplesFilename, const char* reportFilename,
+	const fastoil_evaluate_options* options, fastoil_evaluation* evaluation);
+FASTOIL_API int fastoil_sweep(const char* votesFilename, const char* reportFilename, int auc, fastoil_evaluation* evaluation);
+FASTOIL_API int fastoil_crossvalidate(const fastoil_samples* samples, unsigned folds, unsigned jobs, const fastoil_train_options* options,
+	fastoil_evaluation* evaluations);
+FASTOIL_API int fastoil_evaluation_format(const fastoil_evaluation* evaluation, char** text, size_t* size);
+
+/* Servidor de clasificacion */
+FASTOIL_API void fastoil_serve_options_init(fastoil_serve_options* options);
+FASTOIL_API int fastoil_serve(const fastoil_model* model, const fastoil_serve_options* options);
+
+/* Generacion de muestras sinteticas */
+FASTOIL_API void fastoil_generator_options_init(fastoil_generator_options* options);
+FASTOIL_API int fastoil_generator_create(const fastoil_generator_options* options, fastoil_generator** generator);
+FASTOIL_API int fastoil_generator_target(const fastoil_generator* generator, fastoil_model** target);
+FASTOIL_API int fastoil_generator_write_samples(fastoil_generator* generator, const char* filename, unsigned count);
+FASTOIL_API void fastoil_generator_free(fastoil_generator* generator);
+
+#ifdef __cplusplus
+}
+#endif
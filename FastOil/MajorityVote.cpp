@@ -0,0 +1,89 @@
+#include "StdAfx.h"
+#include "MajorityVote.h"
+
+using namespace std;
+
+MajorityVote::MajorityVote(const vector<Nfa>& models)
+	: models(models), order(models.size()), cost(models.size()), queried(models.size(), 0), agreed(models.size(), 0),
+	AllVotes(false), Queries(0), FullQueries(0)
+{
+	// IsMatch recorre los estados activos y opera sobre vectores del ancho de GetMaxStates
+	for(size_t j=0; j<models.size(); j++)
+	{
+		cost[j] = (double)max(1u, models[j].GetActiveStateCount()) * (models[j].GetMaxStates() / Nfa::BitsPerToken + 1);
+	}
+	Reorder();
+}
+
+/** Ordena los modelos por tasa de acuerdo por unidad de costo, de mayor a menor. La tasa
+    parte de 1/2 para los modelos aun no consultados. Los empates conservan el orden del comite
+*/
+void MajorityVote::Reorder()
+{
+	vector<double> score(models.size());
+	for(size_t j=0; j<models.size(); j++)
+	{
+		score[j] = (agreed[j] + 1.0) / (queried[j] + 2.0) / cost[j];
+	}
+	for(size_t j=0; j<models.size(); j++) order[j] = j;
+	stable_sort(order.begin(), order.end(), [&score](size_t a, size_t b){ return score[a] > score[b]; });
+}
+
+/** Indica si mas de la mitad entera de los modelos votan por la clase de la muestra.
+    vote recibe cada modelo consultado en el orden de consulta y tally acumula las consultas
+*/
+bool MajorityVote::IsCorrect(const SampleSet::TSampleView& sample, bool isPositive, const TVote& vote, TTally& tally) const
+{
+	if(tally.Queried.size() != models.size())
+	{
+		tally.Queried.assign(models.size(), 0);
+		tally.Agreed.assign(models.size(), 0);
+		tally.Ballots.resize(models.size());
+	}
+	size_t threshold = models.size() / 2;
+	size_t forClass = 0;
+	size_t remaining = models.size();
+	size_t consulted = 0;
+	for(size_t k=0; k<models.size(); k++)
+	{
+		size_t j = AllVotes ? k : order[k];
+		bool match = sample.IsMatchedBy(models[j]);
+		vote(j, match);
+		tally.Ballots[consulted++] = match;
+		remaining--;
+		if(match == isPositive) forClass++;
+		// ya hay mayoria o los modelos restantes no alcanzan a formarla
+		if(!AllVotes && (forClass > threshold || forClass + remaining <= threshold)) break;
+	}
+	bool correct = forClass > threshold;
+	tally.Queries += consulted;
+	tally.FullQueries += models.size();
+	if(AllVotes) return correct;
+
+	// un modelo acuerda si su voto empuja hacia el resultado obtenido
+	for(size_t k=0; k<consulted; k++)
+	{
+		size_t j = order[k];
+		tally.Queried[j]++;
+		if((tally.Ballots[k] != 0) == (isPositive == correct)) tally.Agreed[j]++;
+	}
+	return correct;
+}
+
+/** Incorpora y reinicia los conteos de un hilo. Reordena los modelos
+*/
+void MajorityVote::Update(TTally& tally)
+{
+	Queries += tally.Queries;
+	FullQueries += tally.FullQueries;
+	tally.Queries = 0;
+	tally.FullQueries = 0;
+	for(size_t j=0; j<tally.Queried.size(); j++)
+	{
+		queried[j] += tally.Queried[j];
+		agreed[j] += tally.Agreed[j];
+		tally.Queried[j] = 0;
+		tally.Agreed[j] = 0;
+	}
+	if(!AllVotes) Reorder();
+}
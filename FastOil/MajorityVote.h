@@ -0,0 +1,66 @@
+#pragma once
+
+#include "Nfa.h"
+#include "SampleSet.h"
+#include <vector>
+#include <functional>
+
+/** Votacion por mayoria de un comite de modelos. Una muestra es bien clasificada si mas
+    de la mitad entera de los modelos votan por su clase. Los modelos se consultan de a
+	uno y la consulta se detiene en cuanto el resultado ya no puede cambiar. Primero
+	votan los modelos con mayor tasa de acuerdo con el resultado de las muestras
+	anteriores por unidad de costo; el costo se estima por los estados activos y el
+	ancho del vector de estados, de modo que el orden y el reporte no dependen de los
+	tiempos medidos. Con AllVotes se consultan todos los modelos en su orden original.
+	IsCorrect() no modifica la votacion y puede llamarse desde varios hilos, cada uno con
+	su TTally; Update() incorpora los conteos y reordena los modelos
+*/
+class MajorityVote
+{
+public:
+	/// Recibe el voto de cada modelo consultado: true si reconoce la muestra
+	typedef std::function<void(size_t model, bool match)> TVote;
+
+	/// Muestras que conviene evaluar entre cada llamada a Update()
+	static const size_t ReorderEverySamples = 4096;
+
+	/// Conteos de las consultas de un hilo desde el ultimo Update()
+	struct TTally
+	{
+		// consultas de cada modelo y veces que voto como el resultado final
+		std::vector<unsigned long long> Queried;
+		std::vector<unsigned long long> Agreed;
+		// votos de la muestra actual en el orden de consulta
+		std::vector<char> Ballots;
+		unsigned long long Queries;
+		unsigned long long FullQueries;
+
+		TTally() : Queries(0), FullQueries(0) {}
+	};
+
+private:
+	const std::vector<Nfa>& models;
+	std::vector<size_t> order;
+	std::vector<double> cost;
+	std::vector<unsigned long long> queried;
+	std::vector<unsigned long long> agreed;
+
+	void Reorder();
+
+	// no se puede copiar
+	MajorityVote(const MajorityVote&);
+	MajorityVote& operator=(const MajorityVote&);
+
+public:
+	/// Consulta todos los modelos en el orden del comite
+	bool AllVotes;
+	/// Modelos consultados en total
+	unsigned long long Queries;
+	/// Consultas que haria la votacion completa
+	unsigned long long FullQueries;
+
+	bool IsCorrect(const SampleSet::TSampleView& sample, bool isPositive, const TVote& vote, TTally& tally) const;
+	void Update(TTally& tally);
+
+	explicit MajorityVote(const std::vector<Nfa>& models);
+};
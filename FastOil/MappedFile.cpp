@@ -0,0 +1,109 @@
+#include "StdAfx.h"
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+
+#ifdef _WIN32
+
+MappedFile::MappedFile()
+	: data(NULL), size(0), fileHandle(INVALID_HANDLE_VALUE), mappingHandle(NULL)
+{
+}
+
+/** Proyecta el archivo completo. Retorna false si no se puede abrir
+*/
+bool MappedFile::Open(const string& filename)
+{
+	Close();
+	fileHandle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if(fileHandle == INVALID_HANDLE_VALUE) return false;
+	LARGE_INTEGER fileSize;
+	if(!GetFileSizeEx(fileHandle, &fileSize))
+	{
+		Close();
+		return false;
+	}
+	size = (size_t)fileSize.QuadPart;
+	// un archivo vacio no se puede proyectar
+	if(size == 0) return true;
+	mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if(mappingHandle != NULL) data = (const char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	if(data == NULL)
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if(data != NULL) UnmapViewOfFile(data);
+	if(mappingHandle != NULL) CloseHandle(mappingHandle);
+	if(fileHandle != INVALID_HANDLE_VALUE) CloseHandle(fileHandle);
+	data = NULL;
+	size = 0;
+	mappingHandle = NULL;
+	fileHandle = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+MappedFile::MappedFile()
+	: data(NULL), size(0), fd(-1)
+{
+}
+
+/** Proyecta el archivo completo. Retorna false si no se puede abrir
+*/
+bool MappedFile::Open(const string& filename)
+{
+	Close();
+	fd = open(filename.c_str(), O_RDONLY);
+	if(fd < 0) return false;
+	struct stat info;
+	if(fstat(fd, &info) != 0 || !S_ISREG(info.st_mode))
+	{
+		Close();
+		return false;
+	}
+	size = (size_t)info.st_size;
+	// un archivo vacio no se puede proyectar
+	if(size == 0) return true;
+	void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if(mapping == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+	// el archivo se recorre una sola vez de principio a fin
+	madvise(mapping, size, MADV_SEQUENTIAL);
+	data = (const char*)mapping;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if(data != NULL) munmap((void*)data, size);
+	if(fd >= 0) close(fd);
+	data = NULL;
+	size = 0;
+	fd = -1;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
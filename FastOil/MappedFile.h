@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+
+/** Archivo de solo lectura proyectado en memoria. El contenido se lee directamente de
+    las paginas del archivo sin copiarlo a un buffer propio
+*/
+class MappedFile
+{
+	const char* data;
+	size_t size;
+#ifdef _WIN32
+	void* fileHandle;
+	void* mappingHandle;
+#else
+	int fd;
+#endif
+
+	// no se puede copiar
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+public:
+	bool Open(const std::string& filename);
+	void Close();
+	const char* GetData() const { return data; }
+	size_t GetSize() const { return size; }
+
+	MappedFile();
+	~MappedFile();
+};
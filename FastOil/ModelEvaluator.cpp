@@ -0,0 +1,308 @@
+#include "StdAfx.h"
+#include "ModelEvaluator.h"
+#include "MajorityVote.h"
+#include "ReportWriter.h"
+#include "SamplesReader.h"
+#include "CompressedInput.h"
+#include "CompressedOutput.h"
+#include "WorkerPool.h"
+#include <sstream>
+
+using namespace std;
+using boost::starts_with;
+
+ModelEvaluator::ModelEvaluator()
+	: Format(ReportText), EarlyVote(false), Auc(false), Jobs(1)
+{
+}
+
+// Resultados de la parte de un bloque de muestras que evalua un hilo
+struct TEvaluationShard
+{
+	string lines;
+	string negLines;
+	unsigned long long pc;
+	unsigned long long nc;
+	MajorityVote::TTally tally;
+	VoteHistogram histogram;
+	vector<char> row;
+};
+
+/** Evalua el comite sobre el archivo de muestras y escribe el reporte.
+    Retorna los conteos de la votacion por mayoria
+*/
+ModelEvaluator::TResult ModelEvaluator::Evaluate(const vector<Nfa>& models, string samplesFilename, string reportFilename) const
+{
+	ReportWriter report;
+	if(!report.Open(reportFilename))
+	{
+		throw runtime_error("Error abriendo el archivo de reporte");
+	}
+
+	// la muestra es bien clasificada si mas de la mitad entera de los modelos votan por su clase
+	MajorityVote vote(models);
+	bool matrix = Format == ReportCsv || Format == ReportBinary;
+	vote.AllVotes = !EarlyVote || matrix || Format == ReportSweep;
+	// sin votacion completa el orden de consulta cambia, cada linea indica el modelo
+	bool showModel = !vote.AllVotes;
+
+	string lines, negLines;
+	if(Format == ReportText)
+	{
+		lines += "Muestras Positivas\n";
+	}
+	else if(Format == ReportCsv)
+	{
+		lines += "label";
+		for(size_t j=0; j<models.size(); j++)
+		{
+			lines += ",model";
+			ReportWriter::AppendNumber(lines, j);
+		}
+		lines += '\n';
+	}
+	else if(Format == ReportBinary)
+	{
+		// "FOVM", cantidad de modelos en 32 bits little endian
+		lines += "FOVM";
+		for(unsigned k=0; k<4; k++) lines += (char)((models.size() >> (8 * k)) & 0xFF);
+	}
+
+	// evalua la muestra n de su clase y agrega sus registros a los buffers del hilo
+	auto evaluate = [&](TEvaluationShard& shard, const SampleSet::TSampleView& sample, bool isPositive, size_t n)
+	{
+		string& out = isPositive ? shard.lines : shard.negLines;
+		size_t votes = 0;
+		bool correct = vote.IsCorrect(sample, isPositive, [&](size_t model, bool match)
+		{
+			if(match) votes++;
+			if(Format == ReportText)
+			{
+				out += "Evaluation # ";
+				ReportWriter::AppendNumber(out, n);
+				out += match ? " class: 1" : " class: 0";
+				if(showModel)
+				{
+					out += " model: ";
+					ReportWriter::AppendNumber(out, model);
+				}
+				out += '\n';
+			}
+			else if(matrix) shard.row[model] = match;
+		}, shard.tally);
+		if(correct) (isPositive ? shard.pc : shard.nc)++;
+		if(Format == ReportSweep) shard.histogram.Add(isPositive, votes);
+
+		// las matrices tienen una fila por muestra en el orden de evaluacion
+		if(Format == ReportCsv)
+		{
+			shard.lines += isPositive ? '1' : '0';
+			for(size_t j=0; j<shard.row.size(); j++) shard.lines += shard.row[j] ? ",1" : ",0";
+			shard.lines += '\n';
+		}
+		else if(Format == ReportBinary)
+		{
+			// etiqueta y un bit por modelo, el modelo 0 en el bit menos significativo
+			shard.lines += (char)(isPositive ? 1 : 0);
+			for(size_t j=0; j<shard.row.size(); j+=8)
+			{
+				unsigned char bits = 0;
+				for(size_t b=0; b<8 && j+b<shard.row.size(); b++) if(shard.row[j+b]) bits |= 1 << b;
+				shard.lines += (char)bits;
+			}
+		}
+	};
+
+	unsigned jobs = Jobs == 0 ? max(1u, thread::hardware_concurrency()) : Jobs;
+	vector<TEvaluationShard> shards(jobs);
+	for(auto sh=shards.begin(); sh!=shards.end(); ++sh)
+	{
+		sh->pc = sh->nc = 0;
+		sh->row.resize(models.size());
+		sh->histogram = VoteHistogram(models.size());
+	}
+	WorkerPool pool;
+	pool.Start(jobs);
+
+	unsigned long long totalP = 0, totalN = 0;
+	SamplesReader reader;
+	unsigned alpha;
+	reader.ReadChunks(samplesFilename, &alpha, ChunkSamples, [&](const SampleSet& pos, const SampleSet& neg)
+	{
+		// el grupo se recorre como las positivas seguidas de las negativas
+		size_t total = pos.size() + neg.size();
+		for(size_t begin=0; begin<total; begin+=MajorityVote::ReorderEverySamples)
+		{
+			size_t end = min(total, begin + MajorityVote::ReorderEverySamples);
+			pool.Run([&](unsigned w)
+			{
+				size_t first = begin + (end - begin) * w / jobs;
+				size_t last = begin + (end - begin) * (w + 1) / jobs;
+				for(size_t k=first; k<last; k++)
+				{
+					if(k < pos.size()) evaluate(shards[w], pos[k], true, totalP + k);
+					else evaluate(shards[w], neg[k - pos.size()], false, totalN + k - pos.size());
+				}
+			});
+			for(auto sh=shards.begin(); sh!=shards.end(); ++sh)
+			{
+				vote.Update(sh->tally);
+				lines += sh->lines;
+				negLines += sh->negLines;
+				sh->lines.clear();
+				sh->negLines.clear();
+			}
+			if(lines.size() >= ReportWriter::BufferSize) report.Write(lines);
+			// en texto las negativas van despues de todas las positivas
+			if(negLines.size() >= ReportWriter::BufferSize) report.WriteDeferred(negLines);
+		}
+		totalP += pos.size();
+		totalN += neg.size();
+	});
+	pool.Stop();
+
+	unsigned long long pc = 0, nc = 0;
+	for(auto sh=shards.begin(); sh!=shards.end(); ++sh)
+	{
+		pc += sh->pc;
+		nc += sh->nc;
+	}
+	if(Format == ReportText)
+	{
+		lines += "Muestras Negativas\n";
+		report.Write(lines);
+		report.WriteDeferred(negLines);
+		report.AppendDeferred();
+	}
+	if(Format == ReportText || Format == ReportMetrics)
+	{
+		ostringstream metrics;
+		ReportMetric(metrics, pc, nc, totalP, totalN);
+		lines += metrics.str();
+	}
+	if(Format == ReportSweep)
+	{
+		VoteHistogram histogram(models.size());
+		for(auto sh=shards.begin(); sh!=shards.end(); ++sh) histogram.Merge(sh->histogram);
+		ostringstream metrics;
+		ReportThresholds(metrics, histogram, Auc);
+		lines += metrics.str();
+	}
+	report.Write(lines);
+	report.Close();
+
+	TResult result;
+	result.TruePositives = pc;
+	result.TrueNegatives = nc;
+	result.Positives = totalP;
+	result.Negatives = totalN;
+	if(!vote.AllVotes)
+	{
+		result.Queries = vote.Queries;
+		result.FullQueries = vote.FullQueries;
+	}
+	return result;
+}
+
+/** Obtiene las metricas de todos los umbrales desde una matriz de votos escrita con
+    ReportBinary o ReportCsv, sin volver a evaluar las muestras. Retorna los conteos
+	del umbral de la votacion por mayoria
+*/
+ModelEvaluator::TResult ModelEvaluator::Sweep(string matrixFilename, string reportFilename, bool auc)
+{
+	CompressedInput input;
+	if(!input.Open(matrixFilename))
+	{
+		throw runtime_error("El archivo de votos no pudo ser abierto");
+	}
+	istream file(&input);
+	file.exceptions(ios::badbit);
+	char magic[4];
+	file.read(magic, sizeof(magic));
+	string start(magic, (size_t)file.gcount());
+	VoteHistogram histogram;
+	if(start == "FOVM")
+	{
+		unsigned char count[4];
+		if(!file.read((char*)count, sizeof(count))) throw runtime_error("Matriz de votos truncada");
+		size_t models = count[0] | count[1] << 8 | count[2] << 16 | (size_t)count[3] << 24;
+		histogram = VoteHistogram(models);
+		// etiqueta y un bit por modelo
+		vector<unsigned char> row(1 + (models + 7) / 8);
+		while(file.read((char*)row.data(), row.size()))
+		{
+			size_t votes = 0;
+			for(size_t k=1; k<row.size(); k++) for(unsigned bits=row[k]; bits!=0; bits&=bits-1) votes++;
+			if(votes > models) throw runtime_error("Matriz de votos mal formada");
+			histogram.Add(row[0] != 0, votes);
+		}
+		if(file.gcount() != 0) throw runtime_error("Matriz de votos truncada");
+	}
+	else
+	{
+		// cabecera "label,model0,...", luego "etiqueta,voto0,..." por muestra
+		string line;
+		getline(file, line);
+		line = start + line;
+		if(!starts_with(line, "label")) throw runtime_error("Formato de matriz de votos desconocido");
+		size_t models = count(line.begin(), line.end(), ',');
+		histogram = VoteHistogram(models);
+		while(getline(file, line))
+		{
+			boost::trim(line);
+			if(line.empty()) continue;
+			if(line.size() != 1 + 2 * models) throw runtime_error("Fila de la matriz de votos mal formada");
+			histogram.Add(line[0] == '1', count(line.begin() + 1, line.end(), '1'));
+		}
+	}
+	input.Close();
+
+	// la votacion por mayoria acierta una negativa si mas de la mitad entera no la reconoce
+	size_t models = histogram.GetModelCount();
+	TResult result;
+	result.TruePositives = histogram.TruePositives(models / 2);
+	result.TrueNegatives = histogram.TrueNegatives(models - models / 2 - 1);
+	result.Positives = histogram.GetPositives();
+	result.Negatives = histogram.GetNegatives();
+	CompressedOutput report(reportFilename);
+	if(!report.is_open())
+	{
+		throw runtime_error("Error abriendo el archivo de reporte");
+	}
+	ReportThresholds(report, histogram, auc);
+	report.close();
+	return result;
+}
+
+/** Escribe las metricas de una evaluacion
+*/
+void ModelEvaluator::ReportMetric(ostream& report, unsigned long long tp, unsigned long long tn, unsigned long long totalP, unsigned long long totalN)
+{
+	auto fp = totalP - tp;
+	auto fn = totalN - tn;
+	auto acc = (tp + tn)/(float)(totalP + totalN);
+	auto sens = tp/(float)totalP;
+	auto spec = tn/(float)totalN;
+	// los productos superan 2^64 con conjuntos grandes y la diferencia puede ser negativa
+	auto mcc = ((double)tp*tn - (double)fp*fn)/sqrt((double)(tp+fp)*(tp+fn)*(tn+fp)*(tn+fn));
+
+	// informa resultado
+	report << "True Positives: " << tp << ", True Negatives: " << tn << endl;	
+	report << "Total Samples: " << (totalP + totalN) << ", Total P-samples: " << totalP << ", Total N-samples: " << totalN << endl;
+	report << "Accuracy: " << acc << ", Sensitivity: " << sens << ", Specificity: " << spec << ", MCC: " << mcc << endl;
+}
+
+/** Escribe las metricas de cada umbral t de 0 a N: una muestra se clasifica como positiva
+    si mas de t modelos la reconocen. Con auc agrega el area bajo la curva ROC
+*/
+void ModelEvaluator::ReportThresholds(ostream& report, const VoteHistogram& histogram, bool auc)
+{
+	auto totalP = histogram.GetPositives();
+	auto totalN = histogram.GetNegatives();
+	for(size_t t=0; t<=histogram.GetModelCount(); t++)
+	{
+		report << "Threshold: " << t << endl;
+		ReportMetric(report, histogram.TruePositives(t), histogram.TrueNegatives(t), totalP, totalN);
+	}
+	if(auc) report << "AUC: " << histogram.Auc() << endl;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "Nfa.h"
+#include "VoteHistogram.h"
+#include <vector>
+#include <string>
+#include <ostream>
+
+/** Evalua un comite de modelos sobre un archivo de muestras, por grupos y sin cargarlo
+    completo, y escribe el reporte de la evaluacion. Cada muestra consulta todos los
+	modelos en orden; con EarlyVote solo hasta que la mayoria queda decidida. Los
+	registros se formatean en buffers que escribe el hilo de ReportWriter. En texto el
+	reporte lista las muestras positivas y luego las negativas, con una linea por modelo
+	consultado. csv y binary escriben la matriz de votos de todos los modelos, una fila
+	por muestra en el orden de evaluacion. sweep cuenta las muestras por cantidad de votos
+	y escribe las metricas de todos los umbrales.
+	Las muestras se evaluan en bloques de MajorityVote::ReorderEverySamples que se reparten
+	en tramos contiguos entre Jobs hilos; los tramos se concatenan en orden, de modo que el
+	reporte no depende de la cantidad de hilos
+*/
+class ModelEvaluator
+{
+public:
+	/// Contenido del reporte
+	enum TReportFormat
+	{
+		/// una linea por voto y las metricas
+		ReportText,
+		/// matriz de votos en CSV
+		ReportCsv,
+		/// matriz de votos binaria
+		ReportBinary,
+		/// solo las metricas
+		ReportMetrics,
+		/// las metricas de cada umbral de votos
+		ReportSweep
+	};
+
+	/// Conteos de una evaluacion por mayoria
+	struct TResult
+	{
+		unsigned long long TruePositives;
+		unsigned long long TrueNegatives;
+		unsigned long long Positives;
+		unsigned long long Negatives;
+		/// Modelos consultados con votacion temprana y los que consultaria la votacion completa (0 con votacion completa)
+		unsigned long long Queries;
+		unsigned long long FullQueries;
+
+		TResult() : TruePositives(0), TrueNegatives(0), Positives(0), Negatives(0), Queries(0), FullQueries(0) {}
+	};
+
+	/// Muestras que se leen por grupo del archivo de prueba
+	static const size_t ChunkSamples = 1 << 16;
+
+	TReportFormat Format;
+	/// Consulta los modelos solo hasta que la mayoria queda decidida
+	bool EarlyVote;
+	/// Agrega el area bajo la curva ROC a las metricas de los umbrales
+	bool Auc;
+	/// Hilos que evaluan las muestras (0: tantos como nucleos)
+	unsigned Jobs;
+
+	TResult Evaluate(const std::vector<Nfa>& models, std::string samplesFilename, std::string reportFilename) const;
+
+	static TResult Sweep(std::string matrixFilename, std::string reportFilename, bool auc);
+	static void ReportMetric(std::ostream& report, unsigned long long tp, unsigned long long tn, unsigned long long totalP, unsigned long long totalN);
+	static void ReportThresholds(std::ostream& report, const VoteHistogram& histogram, bool auc);
+
+	ModelEvaluator();
+};
@@ -0,0 +1,334 @@
+#include "StdAfx.h"
+#include "MultiProcessTrainer.h"
+
+#ifndef _WIN32
+#include <cerrno>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#endif
+
+using namespace std;
+
+// Mensaje de un proceso de trabajo al coordinador, seguido de Size bytes de resultado
+struct TModelResult
+{
+	unsigned Model;
+	int Status;
+	unsigned long long Size;
+};
+
+// Indica al proceso de trabajo que no hay mas modelos
+const unsigned noMoreModels = ~0u;
+
+/** Tamao redondeado a 8 bytes para alinear las imagenes consecutivas
+*/
+size_t _align8(size_t size)
+{
+	return (size + 7) & ~(size_t)7;
+}
+
+MultiProcessTrainer::MultiProcessTrainer()
+	: region(NULL), regionSize(0), Workers(1), MaxRetries(1)
+{
+}
+
+MultiProcessTrainer::~MultiProcessTrainer()
+{
+	ReleaseRegion();
+}
+
+void MultiProcessTrainer::ReleaseRegion()
+{
+	if(region == NULL) return;
+#ifndef _WIN32
+	munmap(region, regionSize);
+#else
+	free(region);
+#endif
+	region = NULL;
+	regionSize = 0;
+}
+
+/** Ordena y reduce las muestras repetidas como lo hace el entrenamiento y las copia en la
+    region compartida. Despues de esta llamada los conjuntos originales pueden liberarse
+*/
+void MultiProcessTrainer::Share(SampleSet& pos, SampleSet& neg)
+{
+	ReleaseRegion();
+	pos.Deduplicate();
+	neg.Deduplicate();
+	size_t posSize = _align8(pos.GetImageSize());
+	regionSize = posSize + neg.GetImageSize();
+
+#ifndef _WIN32
+	void* mapping = mmap(NULL, regionSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if(mapping == MAP_FAILED)
+	{
+		regionSize = 0;
+		throw runtime_error("No fue posible reservar la memoria compartida de las muestras");
+	}
+	region = (char*)mapping;
+#else
+	region = (char*)malloc(regionSize);
+	if(region == NULL)
+	{
+		regionSize = 0;
+		throw runtime_error("No fue posible reservar la memoria de las muestras");
+	}
+#endif
+
+	pos.WriteImage(region);
+	neg.WriteImage(region + posSize);
+#ifndef _WIN32
+	// los procesos de trabajo solo pueden leer las muestras
+	mprotect(region, regionSize, PROT_READ);
+#endif
+	sharedPos = SampleSet::FromImage(region);
+	sharedNeg = SampleSet::FromImage(region + posSize);
+}
+
+/** Bytes ocupados por las muestras compartidas
+*/
+size_t MultiProcessTrainer::GetSharedBytes() const
+{
+	return regionSize;
+}
+
+void MultiProcessTrainer::RunSequential(unsigned count, const TTrainModel& train, const TModelDone& done)
+{
+	for(unsigned model=0; model<count; model++)
+	{
+		done(model, train(model, sharedPos, sharedNeg));
+	}
+}
+
+#ifdef _WIN32
+
+/** Entrena los modelos 0..count-1. Sin fork() se entrenan en el proceso actual
+*/
+void MultiProcessTrainer::Run(unsigned count, const TTrainModel& train, const TModelDone& done)
+{
+	assert(region != NULL);
+	RunSequential(count, train, done);
+}
+
+#else
+
+// Estado de un proceso de trabajo visto desde el coordinador
+struct TWorker
+{
+	pid_t Pid;
+	int TaskFd;
+	int ResultFd;
+	// modelo asignado o noMoreModels
+	unsigned Model;
+};
+
+/** Escribe size bytes aunque la tuberia los acepte de a partes
+*/
+bool _writeAll(int fd, const char* data, size_t size)
+{
+	while(size > 0)
+	{
+		ssize_t written = write(fd, data, size);
+		if(written < 0 && errno == EINTR) continue;
+		if(written <= 0) return false;
+		data += written;
+		size -= written;
+	}
+	return true;
+}
+
+/** Lee size bytes; falla si el proceso termina antes
+*/
+bool _readAll(int fd, char* data, size_t size)
+{
+	while(size > 0)
+	{
+		ssize_t count = read(fd, data, size);
+		if(count < 0 && errno == EINTR) continue;
+		if(count <= 0) return false;
+		data += count;
+		size -= count;
+	}
+	return true;
+}
+
+/** Cuerpo del proceso de trabajo: entrena los modelos que recibe hasta que no hay mas
+*/
+void _workerLoop(int taskFd, int resultFd, const MultiProcessTrainer::TTrainModel& train, SampleSet& pos, SampleSet& neg)
+{
+	unsigned model;
+	while(read(taskFd, &model, sizeof(model)) == sizeof(model) && model != noMoreModels)
+	{
+		TModelResult result = { model, 0, 0 };
+		string payload;
+		try
+		{
+			payload = train(model, pos, neg);
+		}
+		catch(exception& e)
+		{
+			cout << "Error en el modelo " << model << ": " << e.what() << endl;
+			result.Status = 1;
+		}
+		cout.flush();
+		result.Size = payload.size();
+		if(!_writeAll(resultFd, (const char*)&result, sizeof(result)) || !_writeAll(resultFd, payload.data(), payload.size())) break;
+	}
+}
+
+/** Crea un proceso de trabajo
+*/
+TWorker _startWorker(const MultiProcessTrainer::TTrainModel& train, SampleSet& pos, SampleSet& neg, const vector<TWorker>& others)
+{
+	int taskPipe[2], resultPipe[2];
+	if(pipe(taskPipe) != 0 || pipe(resultPipe) != 0)
+	{
+		throw runtime_error("No fue posible crear la comunicacion con los procesos de trabajo");
+	}
+	// vacia los buffers para que el proceso hijo no repita la salida pendiente
+	cout.flush();
+	pid_t pid = fork();
+	if(pid < 0)
+	{
+		throw runtime_error("No fue posible crear un proceso de trabajo");
+	}
+	if(pid == 0)
+	{
+		close(taskPipe[1]);
+		close(resultPipe[0]);
+		for(auto it=others.cbegin(); it!=others.cend(); ++it)
+		{
+			if(it->TaskFd >= 0) close(it->TaskFd);
+			if(it->ResultFd >= 0) close(it->ResultFd);
+		}
+		_workerLoop(taskPipe[0], resultPipe[1], train, pos, neg);
+		cout.flush();
+		// sin destructores ni atexit del coordinador
+		_exit(0);
+	}
+	close(taskPipe[0]);
+	close(resultPipe[1]);
+	TWorker worker = { pid, taskPipe[1], resultPipe[0], noMoreModels };
+	return worker;
+}
+
+/** Envia el siguiente modelo pendiente al proceso o le indica que termine
+*/
+void _assignModel(TWorker& worker, list<unsigned>& pending)
+{
+	worker.Model = noMoreModels;
+	if(!pending.empty())
+	{
+		worker.Model = pending.front();
+		pending.pop_front();
+	}
+	if(write(worker.TaskFd, &worker.Model, sizeof(worker.Model)) != sizeof(worker.Model))
+	{
+		// el proceso ya termino, se detecta al leer su resultado
+	}
+}
+
+/** Entrena los modelos 0..count-1 repartiendolos entre los procesos de trabajo.
+    done() se ejecuta en el coordinador en el orden en que terminan los modelos
+*/
+void MultiProcessTrainer::Run(unsigned count, const TTrainModel& train, const TModelDone& done)
+{
+	assert(region != NULL);
+	if(Workers <= 1 || count <= 1)
+	{
+		RunSequential(count, train, done);
+		return;
+	}
+
+	// escribir a un proceso que termino no debe terminar al coordinador
+	signal(SIGPIPE, SIG_IGN);
+
+	list<unsigned> pending;
+	for(unsigned model=0; model<count; model++) pending.push_back(model);
+	vector<unsigned> retries(count, 0);
+	unsigned failed = 0;
+
+	vector<TWorker> workers;
+	for(unsigned w=0; w<Workers && w<count; w++)
+	{
+		workers.push_back(_startWorker(train, sharedPos, sharedNeg, workers));
+		_assignModel(workers.back(), pending);
+	}
+
+	size_t alive = workers.size();
+	while(alive > 0)
+	{
+		vector<pollfd> fds;
+		vector<size_t> owners;
+		for(size_t w=0; w<workers.size(); w++)
+		{
+			if(workers[w].ResultFd < 0) continue;
+			pollfd fd = { workers[w].ResultFd, POLLIN, 0 };
+			fds.push_back(fd);
+			owners.push_back(w);
+		}
+		if(poll(fds.data(), fds.size(), -1) < 0)
+		{
+			if(errno == EINTR) continue;
+			throw runtime_error("Error esperando a los procesos de trabajo");
+		}
+
+		for(size_t f=0; f<fds.size(); f++)
+		{
+			if(fds[f].revents == 0) continue;
+			TWorker& worker = workers[owners[f]];
+			TModelResult result;
+			string payload;
+			if(_readAll(worker.ResultFd, (char*)&result, sizeof(result)))
+			{
+				payload.resize((size_t)result.Size);
+				if(payload.empty() || _readAll(worker.ResultFd, &payload[0], payload.size()))
+				{
+					if(result.Status == 0) done(result.Model, payload);
+					else failed++;
+					_assignModel(worker, pending);
+					continue;
+				}
+			}
+
+			// el proceso termino: normalmente despues de recibir noMoreModels
+			close(worker.ResultFd);
+			close(worker.TaskFd);
+			worker.ResultFd = worker.TaskFd = -1;
+			int status;
+			waitpid(worker.Pid, &status, 0);
+			alive--;
+			if(worker.Model == noMoreModels) continue;
+
+			unsigned model = worker.Model;
+			cout << "El proceso de trabajo del modelo " << model << " termino en forma anormal" << endl;
+			if(retries[model]++ >= MaxRetries)
+			{
+				failed++;
+			}
+			else
+			{
+				pending.push_front(model);
+			}
+			// reemplaza al proceso si quedan modelos por entrenar
+			if(!pending.empty())
+			{
+				worker = _startWorker(train, sharedPos, sharedNeg, workers);
+				_assignModel(worker, pending);
+				alive++;
+			}
+		}
+	}
+
+	if(failed > 0)
+	{
+		throw runtime_error("No fue posible entrenar " + boost::lexical_cast<string>(failed) + " modelos");
+	}
+}
+
+#endif
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "SampleSet.h"
+#include <functional>
+#include <vector>
+#include <string>
+
+/** Entrena un conjunto de modelos en varios procesos de trabajo.
+    El coordinador copia las muestras una sola vez en una region de memoria compartida
+	de solo lectura antes de crear los procesos, que las leen en su lugar sin copiarlas,
+	de modo que la memoria de las muestras no crece con la cantidad de procesos.
+	Los indices de los modelos se reparten a demanda; si un proceso termina en forma
+	anormal su modelo se reasigna a un proceso nuevo. Sin fork() (Windows) los modelos
+	se entrenan uno tras otro en el proceso actual. El resultado de cada modelo, por
+	ejemplo el modelo serializado, vuelve al coordinador por la tuberia del proceso
+*/
+class MultiProcessTrainer
+{
+public:
+	/// Entrena un modelo con las muestras compartidas y retorna su resultado, se ejecuta en un proceso de trabajo
+	typedef std::function<std::string(unsigned model, SampleSet& pos, SampleSet& neg)> TTrainModel;
+	/// Se ejecuta en el coordinador cada vez que termina un modelo, con su resultado
+	typedef std::function<void(unsigned model, const std::string& result)> TModelDone;
+
+private:
+	char* region;
+	size_t regionSize;
+	SampleSet sharedPos;
+	SampleSet sharedNeg;
+
+	void ReleaseRegion();
+	void RunSequential(unsigned count, const TTrainModel& train, const TModelDone& done);
+
+public:
+	/// Cantidad de procesos de trabajo
+	unsigned Workers;
+	/// Veces que se reintenta un modelo cuyo proceso termino en forma anormal
+	unsigned MaxRetries;
+
+	void Share(SampleSet& pos, SampleSet& neg);
+	size_t GetSharedBytes() const;
+	void Run(unsigned count, const TTrainModel& train, const TModelDone& done);
+
+	MultiProcessTrainer();
+	~MultiProcessTrainer();
+};
@@ -0,0 +1,246 @@
+#include "StdAfx.h"
+#include "NegativePrefilter.h"
+
+using namespace std;
+
+typedef NegativePrefilter::TToken TToken;
+
+NegativePrefilter::NegativePrefilter()
+	: negSamples(NULL), disabled(false), requiredMemory(0), Tokens(0), Candidates(0), Rejected(0), MemoryLimit(0)
+{
+}
+
+/** Fija el conjunto de muestras negativas y calcula el inicio de cada una.
+    Cada muestra de longitud L ocupa L+1 posiciones
+*/
+void NegativePrefilter::SetSamples(const SampleSet& negativeSamples)
+{
+	negSamples = &negativeSamples;
+	offsets.clear();
+	size_t positions = 0;
+	for(size_t n=0; n<negativeSamples.size(); n++)
+	{
+		offsets.push_back(positions);
+		positions += negativeSamples[n].size() + 1;
+	}
+	offsets.push_back(positions);
+	Tokens = 0;
+}
+
+/** Agrega las posiciones de las muestras agregadas al final del conjunto desde la
+    ultima llamada, sin recorrer las anteriores
+*/
+void NegativePrefilter::AppendSamples()
+{
+	assert(negSamples != NULL);
+	size_t positions = offsets.back();
+	for(size_t n=offsets.size()-1; n<negSamples->size(); n++)
+	{
+		positions += (*negSamples)[n].size() + 1;
+		offsets.push_back(positions);
+	}
+	Tokens = 0;
+}
+
+/** Recalcula los vectores de estados alcanzables para el automata actual.
+    Debe invocarse cada vez que el automata cambia. Si los vectores superan MemoryLimit
+	se liberan y el prefiltro queda desactivado hasta que vuelvan a caber
+*/
+void NegativePrefilter::Update(const Nfa& nfa)
+{
+	assert(negSamples != NULL);
+	Tokens = nfa.GetMaxStates() / Nfa::BitsPerToken;
+	size_t total = offsets.back() * Tokens;
+	forbidden.assign(Tokens, 0);
+	requiredMemory = 2 * total * sizeof(TToken);
+	disabled = MemoryLimit > 0 && requiredMemory > MemoryLimit;
+	if(disabled)
+	{
+		vector<TToken>().swap(forward);
+		vector<TToken>().swap(backward);
+		return;
+	}
+	forward.assign(total, 0);
+	backward.assign(total, 0);
+
+	for(size_t n=0; n<negSamples->size(); n++)
+	{
+		size_t len = (*negSamples)[n].size();
+		memcpy(&forward[offsets[n] * Tokens], nfa.GetInitial(), Tokens * sizeof(TToken));
+		PropagateForward(nfa, n, 0);
+		memcpy(&backward[(offsets[n] + len) * Tokens], nfa.GetFinal(), Tokens * sizeof(TToken));
+		PropagateBackward(nfa, n, len);
+	}
+}
+
+/** Actualiza los vectores de estados despues de mezclar removedState en keptState.
+    Hasta la primera posicion de una muestra que alcanza alguno de los dos estados los
+	vectores hacia adelante no cambian, y desde ella basta reemplazar removedState por
+	keptState y volver a propagar; hacia atras es igual desde la ultima posicion. Las
+	muestras que no alcanzan ninguno de los dos estados no se recorren
+*/
+void NegativePrefilter::UpdateMerged(const Nfa& nfa, unsigned keptState, unsigned removedState)
+{
+	if(disabled || Tokens == 0 || Tokens != nfa.GetMaxStates() / Nfa::BitsPerToken)
+	{
+		Update(nfa);
+		return;
+	}
+
+	for(size_t n=0; n<negSamples->size(); n++)
+	{
+		size_t len = (*negSamples)[n].size();
+		TToken* fwd = &forward[offsets[n] * Tokens];
+		for(size_t p=0; p<=len; p++)
+		{
+			auto current = (Nfa::TTokenVector)(fwd + p*Tokens);
+			if(!_TestBit(current, keptState) && !_TestBit(current, removedState)) continue;
+			_OrAndClearSecondBit(current, keptState, removedState);
+			PropagateForward(nfa, n, p);
+			break;
+		}
+
+		TToken* bwd = &backward[offsets[n] * Tokens];
+		for(size_t p=len+1; p>0; p--)
+		{
+			auto current = (Nfa::TTokenVector)(bwd + (p-1)*Tokens);
+			if(!_TestBit(current, keptState) && !_TestBit(current, removedState)) continue;
+			_OrAndClearSecondBit(current, keptState, removedState);
+			PropagateBackward(nfa, n, p-1);
+			break;
+		}
+	}
+}
+
+/** Calcula hacia adelante los estados alcanzados despues de cada prefijo de la muestra n
+    a partir de la posicion from, que ya debe estar calculada
+*/
+void NegativePrefilter::PropagateForward(const Nfa& nfa, size_t n, size_t from)
+{
+	auto sample = (*negSamples)[n];
+	TToken* fwd = &forward[offsets[n] * Tokens];
+	size_t len = sample.size();
+	for(size_t p=from; p<len; p++)
+	{
+		const TToken* current = fwd + p*Tokens;
+		TToken* next = fwd + (p+1)*Tokens;
+		memset(next, 0, Tokens * sizeof(TToken));
+		bool any = false;
+		unsigned bitIdx = 0;
+		for(unsigned tokenIdx=0; tokenIdx<Tokens; tokenIdx++)
+		{
+			TToken fetch = current[tokenIdx];
+			unsigned long idx;
+			while(_BitScanForward64(&idx, fetch))
+			{
+				_ClearBit(&fetch, idx);
+				any = true;
+				auto s = nfa.GetSuccesors(bitIdx + idx, sample[p]);
+				for(unsigned t=0; t<Tokens; t++) next[t] |= s[t];
+			}
+			bitIdx += Nfa::BitsPerToken;
+		}
+		// el resto de posiciones quedan vacias
+		if(!any)
+		{
+			memset(next, 0, (len - p) * Tokens * sizeof(TToken));
+			break;
+		}
+	}
+}
+
+/** Calcula hacia atras los estados desde los que cada sufijo de la muestra n llega a un
+    final a partir de la posicion from, que ya debe estar calculada
+*/
+void NegativePrefilter::PropagateBackward(const Nfa& nfa, size_t n, size_t from)
+{
+	auto sample = (*negSamples)[n];
+	TToken* bwd = &backward[offsets[n] * Tokens];
+	for(size_t p=from; p>0; p--)
+	{
+		const TToken* current = bwd + p*Tokens;
+		TToken* prev = bwd + (p-1)*Tokens;
+		memset(prev, 0, Tokens * sizeof(TToken));
+		bool any = false;
+		unsigned bitIdx = 0;
+		for(unsigned tokenIdx=0; tokenIdx<Tokens; tokenIdx++)
+		{
+			TToken fetch = current[tokenIdx];
+			unsigned long idx;
+			while(_BitScanForward64(&idx, fetch))
+			{
+				_ClearBit(&fetch, idx);
+				any = true;
+				auto s = nfa.GetPredecessors(bitIdx + idx, sample[p-1]);
+				for(unsigned t=0; t<Tokens; t++) prev[t] |= s[t];
+			}
+			bitIdx += Nfa::BitsPerToken;
+		}
+		if(!any)
+		{
+			memset(bwd, 0, p * Tokens * sizeof(TToken));
+			break;
+		}
+	}
+}
+
+/** Calcula los estados que no pueden mezclarse con el estado suministrado.
+    Un estado esta prohibido si comparte alguna posicion de una muestra negativa
+	en la direccion contraria
+*/
+void NegativePrefilter::PrepareFor(unsigned state)
+{
+	GetForbidden(state, &forbidden[0]);
+}
+
+/** Calcula los estados que no pueden mezclarse con el estado suministrado sin modificar
+    el prefiltro, para consultarlo desde varios hilos. forbiddenStates debe tener tantos
+	tokens como los vectores de estados del automata
+*/
+void NegativePrefilter::GetForbidden(unsigned state, TToken* forbiddenStates) const
+{
+	_ClearAllBits(forbiddenStates, Tokens);
+	if(disabled) return;
+	size_t positions = offsets.back();
+	const TToken* fwd = forward.data();
+	const TToken* bwd = backward.data();
+	for(size_t p=0; p<positions; p++, fwd+=Tokens, bwd+=Tokens)
+	{
+		if(_TestBit((const Nfa::TTokenVector)fwd, state))
+		{
+			for(unsigned t=0; t<Tokens; t++) forbiddenStates[t] |= bwd[t];
+		}
+		if(_TestBit((const Nfa::TTokenVector)bwd, state))
+		{
+			for(unsigned t=0; t<Tokens; t++) forbiddenStates[t] |= fwd[t];
+		}
+	}
+}
+
+/** Indica si la mezcla del estado preparado con el estado suministrado reconoce
+    con seguridad alguna muestra negativa
+*/
+bool NegativePrefilter::IsRejected(unsigned state)
+{
+	Candidates++;
+	if(_TestBit(&forbidden[0], state))
+	{
+		Rejected++;
+		return true;
+	}
+	return false;
+}
+
+/** Indica si la ultima actualizacion supero MemoryLimit
+*/
+bool NegativePrefilter::IsDisabled() const
+{
+	return disabled;
+}
+
+/** Bytes que requieren los vectores de estados en la ultima actualizacion
+*/
+size_t NegativePrefilter::GetRequiredMemory() const
+{
+	return requiredMemory;
+}
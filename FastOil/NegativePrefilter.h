@@ -0,0 +1,61 @@
+#pragma once
+
+#include "Nfa.h"
+#include "SampleSet.h"
+#include <vector>
+
+/** Prefiltro de mezclas basado en las muestras negativas.
+    Para cada muestra negativa y cada posicion guarda los estados alcanzables desde los
+	iniciales con el prefijo (hacia adelante) y los estados desde los que el sufijo llega
+	a un estado final (hacia atras). Si un estado alcanza una posicion hacia adelante y
+	el otro la misma posicion hacia atras, al mezclarlos el automata reconoce la muestra
+	negativa, por lo que la mezcla se descarta sin ejecutarla. Nunca descarta una mezcla
+	que la verificacion completa aceptaria.
+*/
+class NegativePrefilter
+{
+public:
+	typedef Nfa::TToken TToken;
+
+private:
+	const SampleSet* negSamples;
+	bool disabled;
+	size_t requiredMemory;
+
+	// Inicio de cada muestra en el arreglo de posiciones
+	std::vector<size_t> offsets;
+
+	// Tokens por vector de estados del automata analizado
+	unsigned Tokens;
+
+	// Vectores de estados por posicion: [posicion][token]
+	std::vector<TToken> forward;
+	std::vector<TToken> backward;
+
+	// Estados que no pueden mezclarse con el estado preparado
+	std::vector<TToken> forbidden;
+
+	void PropagateForward(const Nfa& nfa, size_t n, size_t from);
+	void PropagateBackward(const Nfa& nfa, size_t n, size_t from);
+
+public:
+	/// Candidatas consultadas al prefiltro
+	unsigned long long Candidates;
+	/// Candidatas descartadas por el prefiltro
+	unsigned long long Rejected;
+	/// Memoria maxima de los vectores de estados en bytes (0: sin limite). Si el automata y
+	/// las muestras la superan el prefiltro se desactiva y no descarta ninguna mezcla
+	size_t MemoryLimit;
+
+	void SetSamples(const SampleSet& negativeSamples);
+	void AppendSamples();
+	void Update(const Nfa& nfa);
+	void UpdateMerged(const Nfa& nfa, unsigned keptState, unsigned removedState);
+	void PrepareFor(unsigned state);
+	bool IsRejected(unsigned state);
+	void GetForbidden(unsigned state, TToken* forbiddenStates) const;
+	bool IsDisabled() const;
+	size_t GetRequiredMemory() const;
+
+	NegativePrefilter();
+};
@@ -1,5 +1,6 @@
 #include "StdAfx.h"
 #include "Nfa.h"
+#include "Profiler.h"
 
 using namespace std;
 
@@ -62,8 +63,29 @@ Nfa::Nfa(unsigned alpha)
 	Clear();
 }
 
+/** Construye un automata vacio con espacio para reserveStates estados, en una sola
+    asignacion. Sirve para cargar un automata de tamano conocido sin redimensionarlo
+*/
+Nfa::Nfa(unsigned alpha, unsigned reserveStates)
+	: 	
+	ActiveStates(NULL), 
+	Initial(NULL),
+	Final(NULL),
+	Predecessors(NULL),
+	Succesors(NULL), 
+	AllMemory(NULL),
+	AlphabetLenght(alpha),
+	Tokens(0),
+	TotalTokens(0),
+	MaxStates(0)
+{	
+	ResizeFor(max(1u, reserveStates));
+	Clear();
+}
+
 Nfa::Nfa(const Nfa& nfa)
 	:	
+	AlphabetLenght(0),
 	ActiveStates(NULL), 
 	Tokens(0),
 	TotalTokens(0),
@@ -77,6 +99,12 @@ Nfa::Nfa(const Nfa& nfa)
 	CloneFrom(nfa);
 }
 
+Nfa& Nfa::operator=(const Nfa& nfa)
+{
+	if(this != &nfa) CloneFrom(nfa);
+	return *this;
+}
+
 Nfa::~Nfa(void)
 {
 	free(AllMemory);
@@ -90,7 +118,16 @@ void Nfa::Clear()
 
 void Nfa::CloneFrom(const Nfa& nfa)
 {
-	AlphabetLenght = nfa.AlphabetLenght;
+	ProfileScope profile(Profiler::PhaseClone);
+	if(AlphabetLenght != nfa.AlphabetLenght || MaxStates != nfa.MaxStates)
+	{
+		// con otras dimensiones la disposicion anterior no sirve, se descarta sin reubicarla
+		free(AllMemory);
+		AllMemory = NULL;
+		Tokens = 0;
+		MaxStates = 0;
+		AlphabetLenght = nfa.AlphabetLenght;
+	}
 	ResizeFor(nfa.MaxStates);
 	TotalTokens = nfa.TotalTokens;
 	auto totalSize = TotalTokens * sizeof(TToken);
@@ -100,6 +137,51 @@ void Nfa::CloneFrom(const Nfa& nfa)
 	assert(AlphabetLenght == nfa.AlphabetLenght);
 }
 
+/** Escribe la representacion binaria del automata. Se vuelca directamente la memoria
+    empaquetada por lo que el archivo solo es valido en la misma arquitectura
+*/
+void Nfa::Save(std::ostream& out) const
+{
+	unsigned tokenSize = sizeof(TToken);
+	out.write((const char*)&tokenSize, sizeof(tokenSize));
+	out.write((const char*)&AlphabetLenght, sizeof(AlphabetLenght));
+	out.write((const char*)&MaxStates, sizeof(MaxStates));
+	out.write((const char*)&TotalTokens, sizeof(TotalTokens));
+	out.write((const char*)AllMemory, TotalTokens * sizeof(TToken));
+}
+
+/** Lee un automata escrito con Save() reemplazando el contenido actual
+*/
+void Nfa::Load(std::istream& in)
+{
+	unsigned tokenSize, alpha, maxStates, totalTokens;
+	in.read((char*)&tokenSize, sizeof(tokenSize));
+	in.read((char*)&alpha, sizeof(alpha));
+	in.read((char*)&maxStates, sizeof(maxStates));
+	in.read((char*)&totalTokens, sizeof(totalTokens));
+	if(!in || tokenSize != sizeof(TToken))
+	{
+		throw runtime_error("Formato de automata binario invalido");
+	}
+
+	// se descarta la memoria anterior para no reubicar su contenido
+	free(AllMemory);
+	AllMemory = NULL;
+	Tokens = 0;
+	MaxStates = 0;
+	AlphabetLenght = alpha;
+	ResizeFor(maxStates);
+	if(TotalTokens != totalTokens)
+	{
+		throw runtime_error("Formato de automata binario invalido, dimensiones incorrectas");
+	}
+	in.read((char*)AllMemory, TotalTokens * sizeof(TToken));
+	if(!in)
+	{
+		throw runtime_error("Formato de automata binario invalido, archivo incompleto");
+	}
+}
+
 size_t Nfa::GetVectorSize() const
 {
 	return Tokens * sizeof(Nfa::TToken);
@@ -169,15 +251,27 @@ bool Nfa::AnyAndTokenVector(const Nfa::TTokenVector dest, const Nfa::TTokenVecto
 */
 bool Nfa::IsMatch(Nfa::TSampleConstIter begin, Nfa::TSampleConstIter end) const
 {
-	TTokenVector next = CreateTokenVector();
-	TTokenVector current = CreateTokenVector();
+	return _IsMatch(begin, end);
+}
+
+/** Simula el automata sobre la muestra [begin, end) con simbolos de cualquier ancho
+*/
+template<class TSymbolIn>
+bool Nfa::_IsMatch(const TSymbolIn* begin, const TSymbolIn* end) const
+{
+	// los dos vectores de estados van en la pila mientras quepan; evita reservar memoria en cada evaluacion
+	TToken stackTokens[2 * MatchStackTokens];
+	TTokenVector heapTokens = Tokens > MatchStackTokens ? AllocTokens(2 * Tokens) : NULL;
+	TTokenVector current = heapTokens != NULL ? heapTokens : stackTokens;
+	TTokenVector next = current + Tokens;
 	CloneTokenVector(current, Initial);
 		
-	for (auto i=begin; i!=end; i++)
+	bool any = true;
+	for (auto i=begin; i!=end && any; i++)
 	{
 		unsigned sym = *i;
 		ClearTokenVector(next);
-		bool any = false;		
+		any = false;		
 		unsigned BitIdx = 0;
 		for(unsigned tokenIdx=0; tokenIdx<Tokens; tokenIdx++)
 		{
@@ -193,29 +287,42 @@ bool Nfa::IsMatch(Nfa::TSampleConstIter begin, Nfa::TSampleConstIter end) const
 			}
 			BitIdx += BitsPerToken;
 		}		
-		if(!any) return false;
 		std::swap(next, current);
 	}	
 	
-	auto match = AnyAndTokenVector(current, Final);
+	bool match = false;
+	if(any) match = AnyAndTokenVector(current, Final);
 	
-	free(next);
-	free(current);
-
+	if(heapTokens != NULL) free(heapTokens);
 	return match;
 }
 
+/** Igual que IsMatch sobre simbolos de 8 bits
+*/
+bool Nfa::IsMatch(const Nfa::TSymbol8* begin, const Nfa::TSymbol8* end) const
+{
+	return _IsMatch(begin, end);
+}
+
+/** Igual que IsMatch sobre simbolos de 16 bits
+*/
+bool Nfa::IsMatch(const Nfa::TSymbol16* begin, const Nfa::TSymbol16* end) const
+{
+	return _IsMatch(begin, end);
+}
+
 /** Indica si una muestra es reconocida por el automata
 */
 bool Nfa::IsMatch( const TSample& sample ) const
 {
-	return IsMatch(sample.begin(), sample.end());
+	return IsMatch(sample.data(), sample.data() + sample.size());
 }
 
 /** Combina los estados suministrados. El segundo estado es eliminado
 */
 void Nfa::Merge( unsigned ns1, unsigned ns2 )
 {
+	ProfileScope profile(Profiler::PhaseMerge);
 	assert(_TestBit(ActiveStates, ns1));
 	assert(_TestBit(ActiveStates, ns2));
 	
@@ -279,7 +386,7 @@ void Nfa::ActivateState( unsigned st )
 {
 	if(st >= MaxStates)
 	{
-		ResizeFor(MaxStates * 2);
+		ResizeFor(max(MaxStates * 2, st + 1));
 	}
 
 	// si no estaba activo se realiza algo de limpieza
@@ -297,31 +404,34 @@ void Nfa::ActivateState( unsigned st )
 
 void Nfa::_MoveActiveTokenVectors(TTokenVector dest, const TTokenVector source, unsigned beforeTokens, size_t beforeVectorSize)
 {		
-	unsigned bitToken = 0;
-	for(unsigned it=0; it<beforeTokens; it++)
+	// Se recorren los estados y simbolos de mayor a menor. Al crecer la nueva posicion
+	// de cada vector nunca es menor que la anterior, por lo que se puede mover dentro
+	// del mismo bloque de memoria sin pisar vectores que aun no fueron movidos
+	for(unsigned it=beforeTokens; it>0; it--)
 	{
-		TToken fetch = ActiveStates[beforeTokens-it-1];
+		TToken fetch = ActiveStates[it-1];
 		unsigned long idx = 0;
 		
 		while(_BitScanReverse64(&idx, fetch))
 		{
 			_ClearBit(&fetch, idx);
-			unsigned state = idx + bitToken;
+			unsigned state = idx + (it-1)*BitsPerToken;
 			
-			for(TSymbol sym=0; sym<AlphabetLenght; sym++)
+			for(TSymbol sym=AlphabetLenght; sym>0; sym--)
 			{
-				auto symr = AlphabetLenght-sym-1;
-				auto n_old = _GetIndex(state, sym, beforeTokens);
-				auto n_new = _GetIndex(state, sym, Tokens);
-				memcpy(dest+n_new, source+n_old, beforeVectorSize);
+				auto n_old = _GetIndex(state, sym-1, beforeTokens);
+				auto n_new = _GetIndex(state, sym-1, Tokens);
+				memmove(dest+n_new, source+n_old, beforeVectorSize);
+				// los estados agregados no tienen transiciones
+				_ClearAllBits(dest+n_new+beforeTokens, Tokens-beforeTokens);
 			}
 		}
-		bitToken+=BitsPerToken;
 	}
 }
 
 void Nfa::ResizeFor(unsigned states)
 {
+	ProfileScope profile(Profiler::PhaseResize);
 	unsigned beforeTokens = Tokens;
 	unsigned beforeMaxStates = MaxStates;
 	size_t beforeVectorSize = GetVectorSize();
@@ -340,28 +450,33 @@ void Nfa::ResizeFor(unsigned states)
 	Tokens = (states - 1) / BitsPerToken + 1;	
 	MaxStates = Tokens * BitsPerToken;
 	TotalTokens = Tokens*3 + Tokens*MaxStates*AlphabetLenght*2;
+
+	// solo se puede crecer, para reducir se debe descartar la memoria (ver CloneFrom)
+	assert(Tokens >= beforeTokens);
+	if(Tokens == beforeTokens) return;
 	
+	// realloc conserva el contenido anterior al inicio del bloque, aunque lo reubique.
+	// Por eso las regiones anteriores se ubican por desplazamiento y no por puntero
 	AllMemory = ReallocTokens(AllMemory, TotalTokens);
+	auto beforeInitial = &AllMemory[beforeTokens*1];
+	auto beforeFinal = &AllMemory[beforeTokens*2];
+	auto beforePredecessors = &AllMemory[beforeTokens*3];
+	auto beforeSuccesors = &AllMemory[beforeTokens*3 + beforeTokens*beforeMaxStates*AlphabetLenght];
 
-	auto beforeActiveStates = ActiveStates;
 	ActiveStates = &AllMemory[Tokens*0];
-
-	auto beforeInitial = Initial;
 	Initial = &AllMemory[Tokens*1];
-
-	auto beforeFinal = Final;
 	Final = &AllMemory[Tokens*2];
-
-	auto beforePredecessors = Predecessors;
 	Predecessors = &AllMemory[Tokens*3 + Tokens*MaxStates*AlphabetLenght*0];
-	
-	auto beforeSuccesors = Succesors;
 	Succesors = &AllMemory[Tokens*3 + Tokens*MaxStates*AlphabetLenght*1];
 
+	// primero las regiones que estan mas adelante en el bloque
 	_MoveActiveTokenVectors(Succesors, beforeSuccesors, beforeTokens, beforeVectorSize);
 	_MoveActiveTokenVectors(Predecessors, beforePredecessors, beforeTokens, beforeVectorSize);
-	memcpy(Final, beforeFinal, beforeVectorSize);
-	memcpy(Initial, beforeInitial, beforeVectorSize);
+	memmove(Final, beforeFinal, beforeVectorSize);
+	memmove(Initial, beforeInitial, beforeVectorSize);
+	_ClearAllBits(Final + beforeTokens, Tokens - beforeTokens);
+	_ClearAllBits(Initial + beforeTokens, Tokens - beforeTokens);
+	_ClearAllBits(ActiveStates + beforeTokens, Tokens - beforeTokens);
 }
 
 /** Aade la informacion necesaria a la estructura de datos para que el automata
@@ -379,6 +494,34 @@ void Nfa::SetTransition( unsigned src, unsigned dest, TSymbol sym )
 	_SetBit(_GetPred(dest, sym), src);
 }
 
+/** Asegura espacio para los estados 0 a states-1 con a lo sumo una redimension
+*/
+void Nfa::Reserve(unsigned states)
+{
+	if(states > MaxStates) ResizeFor(states);
+}
+
+/** Agrega un bloque de transiciones. El espacio para el mayor estado se reserva una
+    sola vez antes de activar los estados
+*/
+void Nfa::SetTransitions(const std::vector<TTransition>& transitions)
+{
+	unsigned states = 0;
+	for(auto t=transitions.cbegin(); t!=transitions.cend(); ++t)
+	{
+		assert(t->Symbol < GetAlphabetLenght());
+		states = max(states, max(t->Source, t->Destination) + 1);
+	}
+	Reserve(states);
+	for(auto t=transitions.cbegin(); t!=transitions.cend(); ++t)
+	{
+		ActivateState(t->Source);
+		ActivateState(t->Destination);
+		_SetBit(_GetSuc(t->Source, t->Symbol), t->Destination);
+		_SetBit(_GetPred(t->Destination, t->Symbol), t->Source);
+	}
+}
+
 /** Ajusta el estado como estado inicial
 */
 void Nfa::SetInitial( unsigned st )
@@ -505,6 +648,18 @@ unsigned Nfa::GetInactiveState() const
 	return bit;
 }
 
+/** Obtiene la cantidad de estados activos
+*/
+unsigned Nfa::GetActiveStateCount() const
+{
+	unsigned count = 0;
+	for(unsigned token=0; token<Tokens; token++)
+	{
+		count += (unsigned)__popcnt64(ActiveStates[token]);
+	}
+	return count;
+}
+
 /** Obtiene el indice para ser usado con los vectores de predecesores y sucesores
 */
 unsigned Nfa::_GetIndex( unsigned st, TSymbol sym ) const
@@ -1,20 +1,30 @@
 #pragma once
 
 #include <vector>
+#include <iosfwd>
 
 /** Representa un automata no determinista
 */
 class Nfa
 {
+	// acceso a las primitivas privadas para los microbenchmarks
+	friend class NfaKernelBench;
+
 public:
 	typedef unsigned TSymbol;
 	typedef __int64 TToken;
 	typedef std::vector<TSymbol> TSample;
 	typedef TSample::iterator TSampleIter;
-	typedef TSample::const_iterator TSampleConstIter;
+	// las muestras se recorren con punteros para aceptar tanto vectores como vistas de SampleSet
+	typedef const TSymbol* TSampleConstIter;
+	// anchos reducidos con que SampleSet guarda los simbolos de alfabetos pequenos
+	typedef unsigned char TSymbol8;
+	typedef unsigned short TSymbol16;
 	typedef TToken* TTokenVector;
 
 	static const unsigned BitsPerToken = sizeof(TToken) * 8;
+	// tokens por vector que IsMatch aloja en la pila (4096 estados)
+	static const unsigned MatchStackTokens = 64;
 
 private:
 
@@ -69,16 +79,35 @@ private:
 	void ClearTokenVector(TTokenVector dest) const;
 	void OrTokenVector(TTokenVector dest, const TTokenVector v) const;
 	bool AnyAndTokenVector(const TTokenVector dest, const TTokenVector v) const;
+
+	// Simulacion del automata sobre simbolos de cualquier ancho
+	template<class TSymbolIn>
+	bool _IsMatch(const TSymbolIn* begin, const TSymbolIn* end) const;
 	
 public:
+	/// Transicion de un bloque cargado con SetTransitions()
+	struct TTransition
+	{
+		unsigned Source;
+		unsigned Destination;
+		TSymbol Symbol;
+	};
+
 	Nfa(unsigned alpha);
+	Nfa(unsigned alpha, unsigned reserveStates);
 	Nfa(const Nfa& c);
+	Nfa& operator=(const Nfa& c);
 	~Nfa(void);
 
 	void Clear();
 	void CloneFrom(const Nfa& c);
 
+	void Save(std::ostream& out) const;
+	void Load(std::istream& in);
+
+	void Reserve(unsigned states);
 	void SetTransition(unsigned src, unsigned dest, TSymbol sym);
+	void SetTransitions(const std::vector<TTransition>& transitions);
 	void SetInitial(unsigned st);
 	void SetFinal(unsigned st);
 
@@ -89,6 +118,8 @@ public:
 
 	bool IsMatch(TSampleConstIter begin, TSampleConstIter end) const;
 	bool IsMatch(const TSample& sample) const;
+	bool IsMatch(const TSymbol8* begin, const TSymbol8* end) const;
+	bool IsMatch(const TSymbol16* begin, const TSymbol16* end) const;
 	void Merge(unsigned ns1, unsigned ns2);		
 	
 	const TTokenVector GetPredecessors(unsigned state, TSymbol sym) const;
@@ -98,6 +129,7 @@ public:
 	const TTokenVector GetActiveStates() const;
 		
 	unsigned GetInactiveState() const;	
+	unsigned GetActiveStateCount() const;
 	unsigned GetMaxStates() const;	
 	unsigned GetAlphabetLenght() const;		
 };
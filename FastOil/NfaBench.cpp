@@ -0,0 +1,242 @@
+/**
+	Microbenchmarks de las primitivas de Nfa.
+	Se construye como un ejecutable separado (make bench) y mide cada primitiva para
+	distintas cantidades de estados, longitudes de alfabeto y densidades de transiciones.
+	Cada medicion hace un calentamiento y luego varias repeticiones de un lote de
+	operaciones, e informa nanosegundos y ciclos por operacion con su dispersion.
+*/
+
+#include "StdAfx.h"
+#include "Nfa.h"
+
+using namespace std;
+using boost::lexical_cast;
+
+typedef chrono::steady_clock TClock;
+
+/** Envoltorio de las primitivas privadas de Nfa
+*/
+class NfaKernelBench
+{
+public:
+	static void ResizeFor(Nfa& nfa, unsigned states) { nfa.ResizeFor(states); }
+	static void OrTokenVector(const Nfa& nfa, Nfa::TTokenVector dest, const Nfa::TTokenVector v) { nfa.OrTokenVector(dest, v); }
+	static bool AnyAndTokenVector(const Nfa& nfa, const Nfa::TTokenVector dest, const Nfa::TTokenVector v) { return nfa.AnyAndTokenVector(dest, v); }
+	static Nfa::TTokenVector CreateTokenVector(const Nfa& nfa) { return nfa.CreateTokenVector(); }
+};
+
+struct BenchConfig
+{
+	unsigned States;
+	unsigned Alpha;
+	double Density;
+};
+
+struct BenchResult
+{
+	double MeanNs;
+	double StdDevNs;
+	double MinNs;
+	double MedianNs;
+	double MeanCycles;
+};
+
+unsigned warmupReps = 3;
+unsigned measureReps = 15;
+mt19937 rng(12345);
+
+// evita que el compilador elimine operaciones cuyo resultado no se usa
+volatile unsigned long long sink = 0;
+
+/** Mide una operacion. setup() se ejecuta antes de cada repeticion sin medirse y
+    op() se ejecuta batch veces por repeticion
+*/
+BenchResult Measure(unsigned batch, function<void()> setup, function<void()> op)
+{
+	vector<double> ns, cycles;
+	for(unsigned r=0; r<warmupReps+measureReps; r++)
+	{
+		setup();
+		auto c0 = __rdtsc();
+		auto t0 = TClock::now();
+		for(unsigned b=0; b<batch; b++) op();
+		auto t1 = TClock::now();
+		auto c1 = __rdtsc();
+		if(r < warmupReps) continue;
+		ns.push_back(chrono::duration_cast<chrono::nanoseconds>(t1 - t0).count() / (double)batch);
+		cycles.push_back((c1 - c0) / (double)batch);
+	}
+
+	BenchResult result;
+	double sum = 0, sumCycles = 0;
+	for(size_t i=0; i<ns.size(); i++) { sum += ns[i]; sumCycles += cycles[i]; }
+	result.MeanNs = sum / ns.size();
+	result.MeanCycles = sumCycles / ns.size();
+	double var = 0;
+	for(size_t i=0; i<ns.size(); i++) var += (ns[i] - result.MeanNs) * (ns[i] - result.MeanNs);
+	result.StdDevNs = ns.size() > 1 ? sqrt(var / (ns.size() - 1)) : 0;
+	sort(ns.begin(), ns.end());
+	result.MinNs = ns.front();
+	result.MedianNs = ns[ns.size() / 2];
+	return result;
+}
+
+/** Construye un automata aleatorio: cada estado tiene Density*States sucesores
+    por simbolo en promedio (al menos uno)
+*/
+Nfa* BuildRandomNfa(const BenchConfig& config)
+{
+	auto nfa = new Nfa(config.Alpha);
+	nfa->Clear();
+	uniform_int_distribution<unsigned> stateDist(0, config.States - 1);
+	unsigned perSymbol = max(1u, (unsigned)(config.Density * config.States));
+	for(unsigned st=0; st<config.States; st++)
+	{
+		for(Nfa::TSymbol sym=0; sym<config.Alpha; sym++)
+		{
+			for(unsigned k=0; k<perSymbol; k++) nfa->SetTransition(st, stateDist(rng), sym);
+		}
+		if(st % 8 == 0) nfa->SetInitial(st);
+		if(st % 3 == 0) nfa->SetFinal(st);
+	}
+	return nfa;
+}
+
+void Report(ostream& out, bool json, const string& primitive, const BenchConfig& config, unsigned batch, const BenchResult& r)
+{
+#ifndef _NOT_USE_AVX256
+	const char* simd = "avx256";
+#else
+	const char* simd = "scalar";
+#endif
+	if(json)
+	{
+		out << "{\"primitive\":\"" << primitive << "\",\"simd\":\"" << simd << "\",\"states\":" << config.States
+			<< ",\"alphabet\":" << config.Alpha << ",\"density\":" << config.Density << ",\"reps\":" << measureReps
+			<< ",\"batch\":" << batch << ",\"mean_ns\":" << r.MeanNs << ",\"stddev_ns\":" << r.StdDevNs
+			<< ",\"min_ns\":" << r.MinNs << ",\"median_ns\":" << r.MedianNs << ",\"mean_cycles\":" << r.MeanCycles << "}" << endl;
+	}
+	else
+	{
+		out << primitive << "," << simd << "," << config.States << "," << config.Alpha << "," << config.Density << ","
+			<< measureReps << "," << batch << "," << r.MeanNs << "," << r.StdDevNs << "," << r.MinNs << ","
+			<< r.MedianNs << "," << r.MeanCycles << endl;
+	}
+}
+
+void RunConfig(ostream& out, bool json, const BenchConfig& config)
+{
+	auto nfa = BuildRandomNfa(config);
+	Nfa copy(*nfa);
+
+	// muestras aleatorias de longitud 32
+	vector<Nfa::TSample> samples(64);
+	uniform_int_distribution<Nfa::TSymbol> symDist(0, config.Alpha - 1);
+	for(auto it=samples.begin(); it!=samples.end(); ++it)
+	{
+		it->resize(32);
+		for(auto s=it->begin(); s!=it->end(); ++s) *s = symDist(rng);
+	}
+
+	size_t sampleIdx = 0;
+	Report(out, json, "IsMatch", config, (unsigned)samples.size(), Measure((unsigned)samples.size(), []{},
+		[&]{ sink += nfa->IsMatch(samples[sampleIdx++ % samples.size()]); }));
+
+	Report(out, json, "CloneFrom", config, 1, Measure(1, []{}, [&]{ copy.CloneFrom(*nfa); }));
+
+	// cada mezcla parte de una copia fresca del automata
+	uniform_int_distribution<unsigned> stateDist(0, config.States - 1);
+	unsigned s1 = 0, s2 = 1;
+	Report(out, json, "Merge", config, 1, Measure(1,
+		[&]{ copy.CloneFrom(*nfa); s1 = stateDist(rng); do { s2 = stateDist(rng); } while(s2 == s1); },
+		[&]{ copy.Merge(s1, s2); }));
+
+	Report(out, json, "ResizeFor", config, 1, Measure(1,
+		[&]{ copy.CloneFrom(*nfa); },
+		[&]{ NfaKernelBench::ResizeFor(copy, copy.GetMaxStates() * 2); }));
+
+	auto dest = NfaKernelBench::CreateTokenVector(*nfa);
+	auto empty = NfaKernelBench::CreateTokenVector(*nfa);
+	unsigned tokens = nfa->GetMaxStates() / Nfa::BitsPerToken;
+	_ClearAllBits(dest, tokens);
+	_ClearAllBits(empty, tokens);
+	unsigned vectorIdx = 0;
+	const unsigned batch = 1024;
+	Report(out, json, "OrTokenVector", config, batch, Measure(batch, []{},
+		[&]{ NfaKernelBench::OrTokenVector(*nfa, dest, nfa->GetSuccesors(vectorIdx++ % config.States, 0)); }));
+
+	// el peor caso recorre todo el vector sin encontrar interseccion
+	Report(out, json, "AnyAndTokenVector", config, batch, Measure(batch, []{},
+		[&]{ sink += NfaKernelBench::AnyAndTokenVector(*nfa, empty, nfa->GetSuccesors(vectorIdx++ % config.States, 0)); }));
+	free(dest);
+	free(empty);
+	delete nfa;
+}
+
+vector<double> ParseDoubleList(string list)
+{
+	vector<string> splits;
+	boost::split(splits, list, [](char c){ return c == ','; });
+	vector<double> values;
+	for(auto it=splits.cbegin(); it!=splits.cend(); ++it) values.push_back(lexical_cast<double>(*it));
+	return values;
+}
+
+int main(int argc, char* argv[])
+{
+	vector<double> statesGrid = ParseDoubleList("64,256,1024,2048");
+	vector<double> alphaGrid = ParseDoubleList("2,4,20");
+	vector<double> densityGrid = ParseDoubleList("0.01,0.1");
+	string outFilename;
+	bool json = false;
+
+	for(int i=1; i<argc; i++)
+	{
+		string opt = argv[i];
+		if(boost::starts_with(opt, "--states=")) statesGrid = ParseDoubleList(opt.substr(9));
+		else if(boost::starts_with(opt, "--alphabets=")) alphaGrid = ParseDoubleList(opt.substr(12));
+		else if(boost::starts_with(opt, "--densities=")) densityGrid = ParseDoubleList(opt.substr(12));
+		else if(boost::starts_with(opt, "--reps=")) measureReps = lexical_cast<unsigned>(opt.substr(7));
+		else if(boost::starts_with(opt, "--warmup=")) warmupReps = lexical_cast<unsigned>(opt.substr(9));
+		else if(boost::starts_with(opt, "--out=")) outFilename = opt.substr(6);
+		else if(opt == "--json") json = true;
+		else
+		{
+			cout << "fastoil-bench [--states=L] [--alphabets=L] [--densities=L] [--reps=N] [--warmup=N] [--out=<file>] [--json]" << endl;
+			return 1;
+		}
+	}
+	if(measureReps == 0)
+	{
+		cout << "--reps debe ser mayor que cero" << endl;
+		return 1;
+	}
+	// la mezcla necesita dos estados distintos
+	if(any_of(statesGrid.cbegin(), statesGrid.cend(), [](double s){ return s < 2; }))
+	{
+		cout << "--states requiere al menos 2 estados" << endl;
+		return 1;
+	}
+
+	ofstream file;
+	if(!outFilename.empty())
+	{
+		file.open(outFilename);
+		if(!file.is_open())
+		{
+			cout << "No fue posible crear el archivo de resultados" << endl;
+			return 1;
+		}
+	}
+	ostream& out = outFilename.empty() ? cout : file;
+	if(!json) out << "primitive,simd,states,alphabet,density,reps,batch,mean_ns,stddev_ns,min_ns,median_ns,mean_cycles" << endl;
+
+	for(auto st=statesGrid.cbegin(); st!=statesGrid.cend(); ++st)
+	for(auto al=alphaGrid.cbegin(); al!=alphaGrid.cend(); ++al)
+	for(auto de=densityGrid.cbegin(); de!=densityGrid.cend(); ++de)
+	{
+		BenchConfig config = { (unsigned)*st, (unsigned)*al, *de };
+		RunConfig(out, json, config);
+	}
+	return 0;
+}
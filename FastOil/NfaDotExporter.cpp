@@ -1,5 +1,8 @@
 #include "StdAfx.h"
 #include "NfaDotExporter.h"
+#include "CompressedInput.h"
+#include "CompressedOutput.h"
+#include "ReportWriter.h"
 
 using namespace std;
 using namespace boost::algorithm;
@@ -9,213 +12,358 @@ const string initialStyle = "style=\"filled\"";
 const string finalStyle = "style=\"bold,dashed\"";
 const string initialFinalStyle = "style=\"filled,bold,dashed\"";
 
-void NfaDotExporter::Export(const Nfa& nfa, std::string filename)
+// tamano a partir del cual se vuelca el buffer de salida
+const size_t exportBufferSize = 1 << 20;
+
+// Numera los estados activos en orden creciente: states[n] es el estado del numero n y
+// number[estado] su numero
+void _numberActiveStates(const Nfa& nfa, vector<unsigned>& states, vector<unsigned>& number)
 {
-	ofstream out(filename);
-	
-	out << "digraph \"NDFA\" {" << endl;
-	out << "  rankdir=LR" << endl;
-	out << "  node [shape=box width=0.1 height=0.1 fontname=Arial]" << endl;
-	out << "  edge [fontname=Arial]" << endl;
+	auto active = nfa.GetActiveStates();
+	unsigned tokens = nfa.GetMaxStates() / Nfa::BitsPerToken;
+	states.clear();
+	number.assign(nfa.GetMaxStates(), 0);
+	for(unsigned token=0; token<tokens; token++)
+	{
+		Nfa::TToken fetch = active[token];
+		unsigned long idx;
+		while(_BitScanForward64(&idx, fetch))
+		{
+			_ClearBit(&fetch, idx);
+			unsigned state = token * Nfa::BitsPerToken + idx;
+			number[state] = (unsigned)states.size();
+			states.push_back(state);
+		}
+	}
+}
 
-	map<unsigned, unsigned> active;
-	for (unsigned i=0; i<nfa.GetMaxStates(); i++)
+// Obtiene las transiciones del estado src hacia estados activos como numero del destino
+// por la longitud del alfabeto mas el simbolo, en orden creciente: por destino y simbolo
+void _transitionsFrom(const Nfa& nfa, unsigned src, const vector<unsigned>& number, vector<unsigned long long>& keys)
+{
+	auto active = nfa.GetActiveStates();
+	unsigned tokens = nfa.GetMaxStates() / Nfa::BitsPerToken;
+	unsigned alpha = nfa.GetAlphabetLenght();
+	keys.clear();
+	for(Nfa::TSymbol sym=0; sym<alpha; sym++)
 	{
-		// contar estados activos
-		if(nfa.IsActiveState(i))
+		auto successors = nfa.GetSuccesors(src, sym);
+		for(unsigned token=0; token<tokens; token++)
 		{
-			active[(unsigned)active.size()] = i;
-		}		
-	}
-
-	out << "/* Estados */" << endl;		
-	for (auto i=active.begin(); i!=active.end(); i++)
-	{	
-		auto isInitial = nfa.IsInitial(i->second);
-		auto isFinal = nfa.IsFinal(i->second);
-		
-		string fmt;
-		if (isInitial && !isFinal) fmt = initialStyle;
-		else if (!isInitial && isFinal) fmt = finalStyle;
-		else if (isInitial && isFinal) fmt = initialFinalStyle;
-		
-		out << " s" << i->first << " [label=\"" << i->first << "\" " << fmt << "] " 
-			<< "/* I:"<< isInitial
-			<< " F:" << isFinal			
-			<< " ORG:" << i->second
-			<< " */" << endl;
-	}
-
-	list<string> l;
-	out << "/* Transiciones */" << endl;
-	for (auto i=active.begin(); i!=active.end(); i++)
-	{		
-		for (auto k=active.begin(); k!=active.end(); k++)
-		{			
-			l.clear();
-			for (Nfa::TSymbol j = 0; j<nfa.GetAlphabetLenght(); j++)
+			Nfa::TToken fetch = successors[token] & active[token];
+			unsigned long idx;
+			while(_BitScanForward64(&idx, fetch))
 			{
-				auto s = nfa.GetSuccesors(i->second, j);
-				if (!_TestBit(s, k->second)) continue;
-				l.push_back(lexical_cast<string>(j));
+				_ClearBit(&fetch, idx);
+				keys.push_back((unsigned long long)number[token * Nfa::BitsPerToken + idx] * alpha + sym);
 			}
-			if (l.size() > 0)
+		}
+	}
+	sort(keys.begin(), keys.end());
+}
+
+// Vuelca el buffer si alcanzo el tamano de escritura
+void _flushExport(ostream& out, string& buffer, bool force)
+{
+	if(!force && buffer.size() < exportBufferSize) return;
+	out.write(buffer.data(), buffer.size());
+	buffer.clear();
+}
+
+/** Escribe el modelo en formato dot. Las transiciones se obtienen recorriendo los bits
+    de los sucesores de cada estado, el costo sigue a la cantidad de transiciones
+*/
+void NfaDotExporter::Export(const Nfa& nfa, std::string filename)
+{
+	ofstream out(filename);
+	vector<unsigned> states, number;
+	_numberActiveStates(nfa, states, number);
+	string buffer;
+	buffer.reserve(exportBufferSize + 256);
+
+	buffer += "digraph \"NDFA\" {\n";
+	buffer += "  rankdir=LR\n";
+	buffer += "  node [shape=box width=0.1 height=0.1 fontname=Arial]\n";
+	buffer += "  edge [fontname=Arial]\n";
+
+	buffer += "/* Estados */\n";
+	for(unsigned n=0; n<states.size(); n++)
+	{
+		auto isInitial = nfa.IsInitial(states[n]);
+		auto isFinal = nfa.IsFinal(states[n]);
+
+		const string* fmt = NULL;
+		if (isInitial && !isFinal) fmt = &initialStyle;
+		else if (!isInitial && isFinal) fmt = &finalStyle;
+		else if (isInitial && isFinal) fmt = &initialFinalStyle;
+
+		buffer += " s";
+		ReportWriter::AppendNumber(buffer, n);
+		buffer += " [label=\"";
+		ReportWriter::AppendNumber(buffer, n);
+		buffer += "\" ";
+		if(fmt != NULL) buffer += *fmt;
+		buffer += isInitial ? "] /* I:1" : "] /* I:0";
+		buffer += isFinal ? " F:1 ORG:" : " F:0 ORG:";
+		ReportWriter::AppendNumber(buffer, states[n]);
+		buffer += " */\n";
+		_flushExport(out, buffer, false);
+	}
+
+	buffer += "/* Transiciones */\n";
+	unsigned alpha = nfa.GetAlphabetLenght();
+	vector<unsigned long long> keys;
+	for(unsigned n=0; n<states.size(); n++)
+	{
+		_transitionsFrom(nfa, states[n], number, keys);
+		// una arista por destino con sus simbolos separados por comas
+		for(size_t k=0; k<keys.size(); )
+		{
+			auto dest = keys[k] / alpha;
+			buffer += "  s";
+			ReportWriter::AppendNumber(buffer, n);
+			buffer += " -> s";
+			ReportWriter::AppendNumber(buffer, dest);
+			buffer += " [label=\"";
+			for(bool first=true; k<keys.size() && keys[k] / alpha == dest; k++, first=false)
 			{
-				string str;
-				auto syms = join(l, ","); // une por comas 2,3,7,22,....
-				out << "  s" << i->first << " -> s" << k->first << " [label=\"" << syms << "\"]" << endl;
+				if(!first) buffer += ',';
+				ReportWriter::AppendNumber(buffer, keys[k] % alpha);
 			}
+			buffer += "\"]\n";
 		}
+		_flushExport(out, buffer, false);
 	}
-	out << "}" << endl;
+	buffer += "}\n";
+	_flushExport(out, buffer, true);
 	out.close();
 }
 
-
 vector<string> _splitBySpaces(const string& line);
 
+/** Escribe el modelo en texto plano; se comprime si el nombre termina en .gz o .zst
+*/
 void NfaDotExporter::ExportDestinoPlainText(const Nfa& nfa, std::string filename)
 {
-	ofstream out(filename);	
-	map<unsigned, unsigned> active;
+	CompressedOutput out(filename);	
+	ExportDestinoPlainText(nfa, out);
+	out.close();
+}
+
+/** Escribe el modelo en texto plano en un flujo. Como Export(), recorre los bits de los
+    sucesores y escribe a traves de un buffer grande
+*/
+void NfaDotExporter::ExportDestinoPlainText(const Nfa& nfa, std::ostream& out)
+{
+	vector<unsigned> states, number;
+	_numberActiveStates(nfa, states, number);
+	string buffer;
+	buffer.reserve(exportBufferSize + 256);
+
+	buffer += "# Alfabeto\n";
+	ReportWriter::AppendNumber(buffer, nfa.GetAlphabetLenght());
+	buffer += '\n';
+
+	buffer += "# Numero de estados\n";
+	ReportWriter::AppendNumber(buffer, states.size());
+	buffer += '\n';
 
-	out << "# Alfabeto" << endl;	
-	out << nfa.GetAlphabetLenght() << endl;
-	
-	out << "# Numero de estados" << endl;	
-	for (unsigned i=0; i<nfa.GetMaxStates(); i++)
+	buffer += "# Estados iniciales\n";
+	for(unsigned n=0; n<states.size(); n++)
 	{
-		// contar estados activos
-		if(nfa.IsActiveState(i))
-		{
-			active[(unsigned)active.size()] = i;
-		}		
+		if(!nfa.IsInitial(states[n])) continue;
+		ReportWriter::AppendNumber(buffer, n);
+		buffer += ' ';
+	}
+	buffer += '\n';
+
+	buffer += "# Estados finales\n";
+	for(unsigned n=0; n<states.size(); n++)
+	{
+		if(!nfa.IsFinal(states[n])) continue;
+		ReportWriter::AppendNumber(buffer, n);
+		buffer += ' ';
 	}
-	out << active.size() << endl;
+	buffer += '\n';
 
-	out << "# Estados iniciales" << endl;	
-	for (auto i=active.begin(); i!=active.end(); i++)
+	// la cantidad de transiciones precede a la lista, se cuentan sin escribirlas
+	buffer += "# Descripcion de las transiciones\n";
+	auto active = nfa.GetActiveStates();
+	unsigned tokens = nfa.GetMaxStates() / Nfa::BitsPerToken;
+	unsigned long long transitions = 0;
+	for(unsigned n=0; n<states.size(); n++)
 	{
-		if(nfa.IsInitial(i->second)) 
+		for(Nfa::TSymbol sym=0; sym<nfa.GetAlphabetLenght(); sym++)
 		{
-			out << i->first << " ";
-		}				
-	}	
-	out << endl;
+			auto successors = nfa.GetSuccesors(states[n], sym);
+			for(unsigned token=0; token<tokens; token++) transitions += __popcnt64(successors[token] & active[token]);
+		}
+	}
+	ReportWriter::AppendNumber(buffer, transitions);
+	buffer += '\n';
 
-	out << "# Estados finales" << endl;	
-	for (auto i=active.begin(); i!=active.end(); i++)
+	unsigned alpha = nfa.GetAlphabetLenght();
+	vector<unsigned long long> keys;
+	for(unsigned n=0; n<states.size(); n++)
 	{
-		if(nfa.IsFinal(i->second))
+		_transitionsFrom(nfa, states[n], number, keys);
+		for(auto k=keys.cbegin(); k!=keys.cend(); ++k)
 		{
-			out << i->first << " ";
-		}		
-	}	
-	out << endl;
-
-	out << "# Descripcion de las transiciones" << endl;
-	ostringstream buffer;
-	int transitions = 0;	
-	for (auto i=active.begin(); i!=active.end(); i++)
-	{ 
-		for (auto k=active.begin(); k!=active.end(); k++)
-		{			
-			for (Nfa::TSymbol j = 0; j<nfa.GetAlphabetLenght(); j++)
-			{
-				// estado(st1) con estado(st2) con simbolo(j)
-				if(!nfa.ExistTransition(i->second, k->second, j)) continue;				
-				buffer << i->first << " " << k->first << " " << j << endl;
-				transitions++;
-			}			
-		}		
-	}
-	out << transitions << endl;
-	out << buffer.str();
-	out.close();
+			// estado(st1) con estado(st2) con simbolo(j)
+			ReportWriter::AppendNumber(buffer, n);
+			buffer += ' ';
+			ReportWriter::AppendNumber(buffer, *k / alpha);
+			buffer += ' ';
+			ReportWriter::AppendNumber(buffer, *k % alpha);
+			buffer += '\n';
+		}
+		_flushExport(out, buffer, false);
+	}
+	_flushExport(out, buffer, true);
 }
 
+/** Lee un modelo en texto plano, comprimido o no
+*/
 Nfa NfaDotExporter::ImportDestinoPlainText(std::string filename)
 {
-	ifstream file(filename);
-	if(!file.is_open())
+	CompressedInput input;
+	if(!input.Open(filename))
 	{
 		throw runtime_error("No fue posible abrir el modelo");
 	}
-	int stateCount;
-	int transitionCount;
-	int currentTransition;
-	string line;
-	Nfa ndfa(1);
-
-	// maquina de estados de lectura de archivo
-	enum { header_alphabet, header_states, header_initial, header_final, header_transitions_count, body_transitions } state;
-	state = header_alphabet;
+	istream file(&input);
+	// los errores de descompresion se propagan en lugar de terminar la lectura
+	file.exceptions(ios::badbit);
+	auto ndfa = ImportDestinoPlainText(file);
+	input.Close();
+	return ndfa;
+}
 
-	while(!file.eof())
+/** Lee un modelo en texto plano desde un flujo. El automata se construye con el espacio
+    para la cantidad de estados de la cabecera y las transiciones se cargan en un solo
+	bloque, sin redimensionarlo
+*/
+Nfa NfaDotExporter::ImportDestinoPlainText(std::istream& file)
+{
+	string line;
+	// Lee la siguiente linea omitiendo lineas vacias o con comentarios
+	auto nextLine = [&]() -> bool
 	{
-		// Leemos la informacion de cabecera
-		getline(file, line);
-		trim(line);
+		while(getline(file, line))
+		{
+			trim(line);
+			if(line.size() != 0 && line[0] != '#') return true;
+		}
+		return false;
+	};
 
-		// Omitimos lineas vacias o con comentarios
-		if(line.size() == 0 || line[0] == '#') continue;
+	// la cabecera indica el alfabeto y la cantidad de estados antes que cualquier estado
+	if(!nextLine())
+	{
+		throw runtime_error("El modelo no indica la longitud del alfabeto");
+	}
+	int alpha = lexical_cast<int>(line);
+	if(!nextLine())
+	{
+		throw runtime_error("El modelo no indica la cantidad de estados");
+	}
+	int stateCount = lexical_cast<int>(line);
+	if(alpha <= 0 || stateCount < 0)
+	{
+		throw runtime_error("Cabecera del modelo invalida");
+	}
+	Nfa ndfa(alpha, stateCount);
 
-		if(state == header_alphabet)
+	auto parseState = [stateCount](const string& item) -> unsigned
+	{
+		auto st = lexical_cast<int>(item);
+		if(st < 0 || st >= stateCount)
 		{
-			vector<string> splits;
-			int alpha = lexical_cast<int>(line);
-			ndfa = Nfa(alpha);
-			state = header_states;
+			throw runtime_error("Numero de estado invalido");
 		}
-		else if(state == header_states)
+		return (unsigned)st;
+	};
+	if(nextLine())
+	{
+		auto splits = _splitBySpaces(line);
+		for_each(splits.begin(), splits.end(), [&](string item){ ndfa.SetInitial(parseState(item)); });
+	}
+	if(nextLine())
+	{
+		auto splits = _splitBySpaces(line);
+		for_each(splits.begin(), splits.end(), [&](string item){ ndfa.SetFinal(parseState(item)); });
+	}
+	if(!nextLine()) return ndfa;
+	int transitionCount = lexical_cast<int>(line);
+
+	vector<Nfa::TTransition> transitions;
+	transitions.reserve(max(0, transitionCount));
+	while(nextLine())
+	{
+		auto splits = _splitBySpaces(line);
+		if(splits.size() < 3)
 		{
-			stateCount = lexical_cast<int>(line);
-			state = header_initial;
+			throw runtime_error("Transicion incompleta");
 		}
-		else if(state == header_initial)
+		auto src = lexical_cast<int>(splits[0]);
+		auto dst = lexical_cast<int>(splits[1]);						
+		auto sym = lexical_cast<unsigned>(splits[2]);			
+		if(src < 0 || src >= stateCount) 
 		{
-			auto splits = _splitBySpaces(line);
-			for_each(splits.begin(), splits.end(), [&ndfa](string item){ ndfa.SetInitial(lexical_cast<int>(item)); });
-			state = header_final;
+			throw runtime_error("Numero de estado fuente invalido");
 		}
-		else if(state == header_final)
+		if(dst < 0 || dst >= stateCount) 
 		{
-			auto splits = _splitBySpaces(line);
-			for_each(splits.begin(), splits.end(), [&ndfa](string item){ ndfa.SetFinal(lexical_cast<int>(item)); });
-			state = header_transitions_count;
+			throw runtime_error("Numero de estado destino invalido");
 		}
-		else if(state == header_transitions_count)
+		if(sym >= ndfa.GetAlphabetLenght()) 
 		{
-			transitionCount = lexical_cast<int>(line);
-			currentTransition = 0;
-			state = body_transitions;
+			throw runtime_error("Codigo de simbolo invalido");
 		}
-		else if(state == body_transitions)
+		if((int)transitions.size() >= transitionCount)
 		{
-			auto splits = _splitBySpaces(line);
-			auto src = lexical_cast<int>(splits[0]);
-			auto dst = lexical_cast<int>(splits[1]);						
-			auto sym = lexical_cast<unsigned>(splits[2]);			
-			if(src >= stateCount) 
-			{
-				throw runtime_error("Numero de estado fuente invalido");
-			}
-			if(dst >= stateCount) 
-			{
-				throw runtime_error("Numero de estado destino invalido");
-			}
-			if(sym >= ndfa.GetAlphabetLenght()) 
-			{
-				throw runtime_error("Codigo de simbolo invalido");
-			}
-			if(currentTransition >= transitionCount)
-			{
-				throw runtime_error("Cantidad de transiciones incorrecta");
-			}
-			ndfa.SetTransition(src, dst, sym);
-			currentTransition++;			
+			throw runtime_error("Cantidad de transiciones incorrecta");
 		}
+		Nfa::TTransition transition;
+		transition.Source = src;
+		transition.Destination = dst;
+		transition.Symbol = sym;
+		transitions.push_back(transition);
 	}
-	file.close();
+	ndfa.SetTransitions(transitions);
 	return ndfa;
+}
+
+/** Lee los nombres de los modelos de un manifiesto, uno por linea. Omite las lineas
+    vacias y los comentarios que empiezan con #
+*/
+vector<string> NfaDotExporter::ReadManifest(std::string manifestFilename)
+{
+	ifstream manifest(manifestFilename);
+	if(!manifest.is_open())
+	{
+		throw runtime_error("Error with manifest file");
+	}
+	vector<string> models;
+	string line;
+	while(!manifest.eof())
+	{
+		getline(manifest, line);
+		trim(line);
+		if(line.size() == 0 || line[0] == '#') continue;
+		models.push_back(line);
+	}
+	manifest.close();
+	return models;
+}
+
+/** Carga los modelos indicados en el manifiesto, en su orden
+*/
+void NfaDotExporter::ImportManifest(std::string manifestFilename, std::vector<Nfa>& models)
+{
+	auto files = ReadManifest(manifestFilename);
+	for(auto i = files.begin(); i!=files.end(); i++)
+	{
+		models.push_back(ImportDestinoPlainText(*i));
+	}
 }
\ No newline at end of file
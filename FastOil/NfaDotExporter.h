@@ -2,6 +2,7 @@
 
 #include <string>
 #include <vector>
+#include <iosfwd>
 #include "Nfa.h"
 
 class NfaDotExporter
@@ -9,6 +10,10 @@ class NfaDotExporter
 public:	
 	static void Export(const Nfa& nfa, std::string filename);
 	static void ExportDestinoPlainText(const Nfa& nfa, std::string filename);
+	static void ExportDestinoPlainText(const Nfa& nfa, std::ostream& out);
 	static Nfa ImportDestinoPlainText(std::string filename);		
+	static Nfa ImportDestinoPlainText(std::istream& file);
+	static std::vector<std::string> ReadManifest(std::string manifestFilename);
+	static void ImportManifest(std::string manifestFilename, std::vector<Nfa>& models);
 };
 
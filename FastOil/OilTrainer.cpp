@@ -1,6 +1,7 @@
 #include "stdafx.h"
 #include "OilTrainer.h"
 #include "NfaDotExporter.h"
+#include "Profiler.h"
 
 using namespace std;
 using boost::lexical_cast;
@@ -9,46 +10,49 @@ typedef OilTrainer::TSample TSample;
 typedef OilTrainer::TSamples TSamples;
 typedef OilTrainer::TSymbol TSymbol;
 
-/** Cuenta el numero de muestras de una secuencia que son reconocidas por un automata
+// sin limite de mezclas candidatas por estado
+const unsigned noCandidateCap = ~0u;
+// primer limite de candidatas por estado del presupuesto de tiempo, luego se divide por 4
+const unsigned firstCandidateCap = 64;
+// muestras minimas para estimar el ritmo de entrenamiento
+const size_t budgetMinSamples = 4;
+
+/** Cuenta el numero de muestras del rango [begin, end) de un conjunto que son reconocidas por un automata.
+    Cada muestra cuenta tantas veces como su peso, igual que en el conjunto con repeticiones
 */
-int _countMatches(TSamples::const_iterator begin, TSamples::const_iterator end, const Nfa& nfa)
+int _countMatches(const SampleSet& samples, size_t begin, size_t end, const Nfa& nfa)
 {
 	int count = 0;
-	for (auto it=begin; it!=end; ++it)
+	for (size_t i=begin; i<end; i++)
 	{
-		bool match = nfa.IsMatch(*it);
-		if(match) count++;
+		auto sample = samples[i];
+		bool match = sample.IsMatchedBy(nfa);
+		if(match) count += samples.GetWeight(i);
 	}
 	return count;
 }
 
-/** Cuenta el numero de muestras de una secuencia que son reconocidas por un automata
-*/
-int _countMatches(const TSamples& samples, const Nfa& nfa)
-{	
-	return _countMatches(samples.cbegin(), samples.cend(), nfa);
-}
-
 /** Indica si alguna muestra es reconocida por el automata
 */
-bool _anyMatch(const TSamples& samples, const Nfa& nfa)
+bool _anyMatch(const SampleSet& samples, const Nfa& nfa)
 {	
-	for (auto it=samples.cbegin(); it!=samples.cend(); ++it)
+	for (size_t i=0; i<samples.size(); i++)
 	{
-		auto match = nfa.IsMatch(*it);
+		auto sample = samples[i];
+		auto match = sample.IsMatchedBy(nfa);
 		if(match) return true;
 	}
 	return false;
 }
 
-
-/** Indica si todas las muestras son reconocidas por un automata
+/** Indica si todas las muestras del rango [begin, end) son reconocidas por un automata
 */
-bool _allMatch(TSamples::const_iterator begin, TSamples::const_iterator end, const Nfa& nfa)
+bool _allMatch(const SampleSet& samples, size_t begin, size_t end, const Nfa& nfa)
 {
-	for (auto it=begin; it!=end; ++it)
+	for (size_t i=begin; i<end; i++)
 	{
-		auto match = nfa.IsMatch(*it);
+		auto sample = samples[i];
+		auto match = sample.IsMatchedBy(nfa);
 		if(!match) return false;
 	}
 	return true;
@@ -57,9 +61,9 @@ bool _allMatch(TSamples::const_iterator begin, TSamples::const_iterator end, con
 
 /** Indica si todas las muestras son reconocidas por un automata
 */
-bool _allMatch(const TSamples& samples, const Nfa& nfa)
+bool _allMatch(const SampleSet& samples, const Nfa& nfa)
 {
-	return _allMatch(samples.cbegin(), samples.cend(), nfa);
+	return _allMatch(samples, 0, samples.size(), nfa);
 }
 
 /** Comparador de muestras usado para ordenar las muestras en forma lexicografica.
@@ -72,14 +76,45 @@ bool _sampleComparer(const TSample& sample1, const TSample sample2)
 	else return sample1.size() < sample2.size();
 }
 
-/** Entrena un nuevo modelo de automata no determinista usando las muestras positivas y negativas que se le suministren
+/** Entrena un nuevo modelo a partir de muestras en vectores. Las muestras quedan
+    ordenadas como en el entrenamiento
+*/
+Nfa* OilTrainer::Train(TSamples& positiveSamples, TSamples& negativeSamples, unsigned alpha )
+{
+	// Asegura orden lexicografico
+	sort(positiveSamples.begin(), positiveSamples.end(), _sampleComparer);
+	sort(negativeSamples.begin(), negativeSamples.end(), _sampleComparer);
+
+	SampleSet pos(positiveSamples), neg(negativeSamples);
+	return Train(pos, neg, alpha);
+}
+
+/** Semillas de los automatas de un comite: valores sucesivos de un minstd_rand iniciado con la
+    semilla del comite. Con la misma semilla train_multiple y fastoil_train entrenan el mismo comite
+*/
+vector<int> OilTrainer::CommitteeSeeds(unsigned seed, unsigned count)
+{
+	minstd_rand engine(seed);
+	vector<int> seeds(count);
+	// minstd_rand entrega valores en [1, 2^31-2], siempre validos como Seed
+	for(unsigned j=0; j<count; j++) seeds[j] = (int)engine();
+	return seeds;
+}
+
+/** Entrena un nuevo modelo de automata no determinista usando las muestras positivas y negativas que se le suministren.
+    Los conjuntos se ordenan y sus muestras repetidas se reducen a una sola con peso, el modelo es
+	el mismo que con las repeticiones. Los conjuntos externos (de solo lectura) deben venir asi preparados
 	@posSamples Muestras positivas
 	@negSamples Muestras negativas
-	@len Longitud de cada muestra
 	@alpha Longitud del alfabeto
 */
-Nfa* OilTrainer::Train(TSamples& positiveSamples, TSamples& negativeSamples, unsigned alpha )
+Nfa* OilTrainer::Train(SampleSet& positiveSamples, SampleSet& negativeSamples, unsigned alpha )
 {
+	// descarta una sesion incremental previa
+	delete nfa;
+	delete testNfa;
+	delete bestNfa;
+
 	nfa = new Nfa(alpha);
 	testNfa = new Nfa(alpha);
 	bestNfa = new Nfa(alpha);
@@ -88,48 +123,101 @@ Nfa* OilTrainer::Train(TSamples& positiveSamples, TSamples& negativeSamples, uns
 	testNfa->Clear();
 	bestNfa->Clear();
 	
-	// Asegura orden lexicografico
-	sort(positiveSamples.begin(), positiveSamples.end(), _sampleComparer);
-	sort(negativeSamples.begin(), negativeSamples.end(), _sampleComparer);
+	// Asegura orden lexicografico y muestras sin repetir
+	positiveSamples.Deduplicate();
+	negativeSamples.Deduplicate();
+	auto conflicts = SampleSet::CountCommon(positiveSamples, negativeSamples);
+	if(conflicts > 0)
+	{
+		throw runtime_error(lexical_cast<string>(conflicts) + " muestras estan etiquetadas como positivas y negativas");
+	}
 
 	posSamples = &positiveSamples;
 	negSamples = &negativeSamples;
-	
-	int currentPosSample=0;
-	for (auto currentPosSampleIter=posSamples->cbegin(); currentPosSampleIter != posSamples->cend(); ++currentPosSampleIter)
+	if(UseNegativePrefilter) prefilter.SetSamples(negativeSamples);
+
+	// sin semilla propia depende de srand() para conservar el comportamiento de --seed
+	randomIds.clear();
+	rng.seed(Seed >= 0 ? (unsigned)Seed : (unsigned)rand());
+	Profiler::BeginRun();
+
+	size_t currentPosSample=0;
+	if(!ResumeFilename.empty())
+	{
+		currentPosSample = LoadCheckpoint(ResumeFilename);
+		if(nfa->GetAlphabetLenght() != alpha)
+		{
+			throw runtime_error("El punto de control no corresponde a la longitud del alfabeto");
+		}
+		if(ShowProgress) cout << "Reanudando desde la muestra " << currentPosSample << " de " << posSamples->size() << endl;
+	}
+	auto lastCheckpointTime = time(NULL);
+	StartBudget(currentPosSample);
+
+	for (auto currentPosSampleIdx=currentPosSample; currentPosSampleIdx < posSamples->size(); currentPosSampleIdx++)
 	{		
-		auto acceptPos = nfa->IsMatch(*currentPosSampleIter);
+		auto sample = (*posSamples)[currentPosSampleIdx];
+		auto acceptPos = sample.IsMatchedBy(*nfa);
 		if(!acceptPos)
 		{
-			CoreceMatch(currentPosSampleIter);			
-			DoAllMergesPossible(currentPosSampleIter);			
+			CoreceMatch(currentPosSampleIdx);			
+			DoAllMergesPossible(currentPosSampleIdx);			
 		}
 		currentPosSample++;
+		if(!acceptPos) Profiler::Record(currentPosSample, *nfa);
+		UpdateBudget(currentPosSample);
 
 		if(ShowProgress)
 		{
 			//NfaDotExporter::Export(*nfa, "nfa" + lexical_cast<string>(currentPosSample) + ".dot");
 			cout << "Procesada muestra " << currentPosSample << " de " << posSamples->size() << " (" << (currentPosSample*100L/posSamples->size()) << "%)" << endl;
 		}
+
+		if(!CheckpointFilename.empty())
+		{
+			auto now = time(NULL);
+			bool bySamples = CheckpointEverySamples > 0 && currentPosSample % CheckpointEverySamples == 0;
+			bool bySeconds = CheckpointEverySeconds > 0 && now - lastCheckpointTime >= (time_t)CheckpointEverySeconds;
+			if(bySamples || bySeconds)
+			{
+				SaveCheckpoint(CheckpointFilename, currentPosSample);
+				lastCheckpointTime = now;
+			}
+		}
+	}
+
+	Profiler::Record(currentPosSample, *nfa);
+
+	if(ShowProgress && UseNegativePrefilter)
+	{
+		auto c = prefilter.Candidates;
+		cout << "Prefiltro: descartadas " << prefilter.Rejected << " de " << c << " mezclas candidatas (" << (c == 0 ? 0 : prefilter.Rejected*100/c) << "%)" << endl;
 	}
 
 	delete testNfa;
 	delete bestNfa;
+	testNfa = NULL;
+	bestNfa = NULL;
+	ReleaseSpeculative();
 	
 	// Asegura que reconoce todas las muestras positivas
 	assert(_allMatch(positiveSamples, *nfa));
 	// Asegura que no reconoce ninguna muestra negativa
 	assert(!_anyMatch(negativeSamples, *nfa));
 
-	return nfa;
+	// el modelo pasa a ser propiedad del llamador
+	auto result = nfa;
+	nfa = NULL;
+	return result;
 }
 
 /** Agrega estados al automata de tal manera que lo fuerza a reconocer una nueva muestra positiva
 */
-void OilTrainer::CoreceMatch(TSamples::const_iterator currentPosSampleIterator)
+void OilTrainer::CoreceMatch(size_t currentPosSampleIdx)
 {
+	ProfileScope profile(Profiler::PhaseCoerce);
 	// muestra positiva actual
-	const TSample& currentPosSample = *currentPosSampleIterator;
+	auto currentPosSample = (*posSamples)[currentPosSampleIdx];
 	
 	// apartir de este momento los nuevos estados empezaran ubicarse desde este indice
 	// en el vector de identificadores aleatorios
@@ -141,58 +229,103 @@ void OilTrainer::CoreceMatch(TSamples::const_iterator currentPosSampleIterator)
 	randomIds.push_back(lastStateId);
 
 	// inserta estados en los espacios inactivos	
-	for(auto symIter=currentPosSample.cbegin(); symIter!=currentPosSample.cend(); symIter++)
+	for(size_t symIdx=0; symIdx<currentPosSample.size(); symIdx++)
 	{
 		auto inactiveStateId = nfa->GetInactiveState();
-		nfa->SetTransition(lastStateId, inactiveStateId, *symIter);	
+		nfa->SetTransition(lastStateId, inactiveStateId, currentPosSample[symIdx]);	
 		lastStateId = inactiveStateId;
 		randomIds.push_back(lastStateId);
 	}
 	nfa->SetFinal(lastStateId);
 
 	// Aseguramos que reconocemos la nueva muestra
-	assert(nfa->IsMatch(currentPosSample));	
+	assert(currentPosSample.IsMatchedBy(*nfa));	
 }
 
 /** Realiza todas las mezclas de estados posibles sobre el automata
 	@sampleBegin Inicio de muestra positiva actual
 	@sampleEnd Fin de muestra positiva actual
 */
-void OilTrainer::DoAllMergesPossible(TSamples::const_iterator currentPosSampleIterator)
+void OilTrainer::DoAllMergesPossible(size_t currentPosSampleIdx)
 {
-	auto nextPosSampleIterator = currentPosSampleIterator + 1;
+	// sin presupuesto de tiempo los estados nuevos quedan sin mezclar, el modelo sigue siendo consistente
+	if(candidateCap == 0) return;
+	auto nextPosSample = currentPosSampleIdx + 1;
 	vector<int>::iterator it = randomIds.begin() + statesAddedBeginInRandom;
-	if(!DoNotUseRandomSort)	random_shuffle(it, randomIds.end()); // revuelve los nuevos elementos aadidos
+	if(!DoNotUseRandomSort)	shuffle(it, randomIds.end(), rng); // revuelve los nuevos elementos a�adidos
 	unsigned totalLenght = (unsigned)randomIds.size();
 	int mergeCounter = 0;
+	if(UseNegativePrefilter) UpdatePrefilter();
+
+	// las posibles mezclas se muestran en orden solo en el modo secuencial
+	// con candidatas limitadas por el presupuesto de tiempo tambien es secuencial
+	if(Threads > 1 && !ShowPossibleMerges && candidateCap == noCandidateCap)
+	{
+		DoAllMergesSpeculative(currentPosSampleIdx);
+		return;
+	}
 
 	// nuevos estados en orden aleatorio
+	bool skipSearch = SkipSearchBestMerge || budgetSkipSearch;
 	for (unsigned i=statesAddedBeginInRandom; i<totalLenght; /* ver final del ciclo para ver como avanza */)
 	{		
+		if(candidateCap == 0) break;
 		int bestScore = -1;
 		int bestJ = -1;
 
 		int s1 = randomIds[i];
+		if(UseNegativePrefilter) 
+		{
+			ProfileScope profile(Profiler::PhasePrefilter);
+			prefilter.PrepareFor(s1);
+		}
 		// viejos y nuevos estados en orden aleatorio
 		// ojo con la condicion de parada: sin repetir
-		for (unsigned j=0; j<i; j++)
+		// con presupuesto de tiempo se evalua una muestra aleatoria de las candidatas
+		bool sampled = candidateCap < i;
+		unsigned candidates = sampled ? candidateCap : i;
+		if(sampled) SampleCandidates(i);
+		for (unsigned c=0; c<candidates; c++)
 		{
+			unsigned j = sampled ? candidateOrder[c] : c;
+			if(TimeBudgetSeconds > 0 && BudgetExhausted(currentPosSampleIdx)) break;
 			int s2 = randomIds[j];
+			Profiler::Count(Profiler::CounterCandidates);
+			// la mezcla reconoceria alguna muestra negativa, no hace falta simularla
+			if(UseNegativePrefilter && prefilter.IsRejected(s2))
+			{
+				Profiler::Count(Profiler::CounterPrefilterRejected);
+				continue;
+			}
+
 			testNfa->CloneFrom(*nfa); // copiamos en el de prueba			
 			testNfa->Merge(s2, s1); // hacemos la mezcla
 
-			bool anyNegMatch = _anyMatch(*negSamples, *testNfa);
-			if(anyNegMatch) continue;
+			bool anyNegMatch;
+			{
+				ProfileScope profile(Profiler::PhaseNegativeCheck);
+				anyNegMatch = _anyMatch(*negSamples, *testNfa);
+			}
+			if(anyNegMatch) 
+			{
+				Profiler::Count(Profiler::CounterNegativeRejected);
+				continue;
+			}
+			Profiler::Count(Profiler::CounterAccepted);
 			
 			// cuenta las que reconozca en adelante porque las anteriores y la actual es fijo que debe reconocerlas
-			int score = _countMatches(nextPosSampleIterator, posSamples->cend(), *testNfa);
+			int score;
+			{
+				ProfileScope profile(Profiler::PhasePositiveScore);
+				score = _countMatches(*posSamples, nextPosSample, posSamples->size(), *testNfa);
+			}
 			if(score > bestScore)
 			{
 				bestScore = score;
 				bestJ = j;
 				swap(bestNfa, testNfa);
 				// acaba con la busqueda de estados que se puedan combinar					
-				if(SkipSearchBestMerge) break;
+				if(skipSearch) break;
 			}
 			if(ShowPossibleMerges) 
 			{
@@ -206,30 +339,17 @@ void OilTrainer::DoAllMergesPossible(TSamples::const_iterator currentPosSampleIt
 		if(bestScore != -1) 
 		{
 			mergeCounter++;
+			Profiler::Count(Profiler::CounterMerges);
 			if(ShowMerges)
 			{
 				cout << "Mezcla "<< bestJ << " " << i << " -> " << randomIds[bestJ] << " " << s1 << " (score: " << bestScore << ")" << endl;
-				//NfaDotExporter::Export(*bestNfa, "nfa"+lexical_cast<string>(currentPosSampleIterator-posSamples->cbegin())+"-"+lexical_cast<string>(mergeCounter)+".dot");
+				//NfaDotExporter::Export(*bestNfa, "nfa"+lexical_cast<string>(currentPosSampleIdx)+"-"+lexical_cast<string>(mergeCounter)+".dot");
 			}
 			// intercambia los automatas de prueba y final
 			swap(nfa, bestNfa);
+			if(UseNegativePrefilter) UpdatePrefilter(randomIds[bestJ], s1);
 						
-			if(DoNotUseRandomSort) 
-			{
-				// aunque este modo podria ser optimizado eliminando el indicador en una lista enlazada
-				// se prefiere el mecanismo usando vector porque se presume que mantiene mayor localidad
-				// en cache para el escenario de orden aleatorio (el mas usado)
-				// TODO: Comprobar si ambos casos son mejorados usando lista enlazada
-				move(randomIds.cbegin()+1+i, randomIds.cend(), randomIds.begin()+i);
-			} 
-			else 
-			{
-				// guarda el ultimo en el lugar donde estaba el estado
-				// que fue eliminado, asi podemos descartar y reducir el
-				// tamao del vector sin penalizar el desempeo
-				randomIds[i] = randomIds.back();				
-			}
-			randomIds.pop_back();
+			RemoveNewState(i);
 			totalLenght--;			
 		}
 		else
@@ -241,10 +361,813 @@ void OilTrainer::DoAllMergesPossible(TSamples::const_iterator currentPosSampleIt
 	// no debe quedar reconociendo muestras negativas
 	assert(!_anyMatch(*negSamples, *nfa));
 	// no debe perderse la capacidad de reconocer la nueva muestra ni las anteriores
-	assert(_allMatch(posSamples->cbegin(), nextPosSampleIterator, *nfa));
+	assert(_allMatch(*posSamples, 0, nextPosSample, *nfa));
+}
+
+/** Elimina el estado nuevo de la posicion i del arreglo de identificadores
+*/
+void OilTrainer::RemoveNewState(unsigned i)
+{
+	if(DoNotUseRandomSort) 
+	{
+		// aunque este modo podria ser optimizado eliminando el indicador en una lista enlazada
+		// se prefiere el mecanismo usando vector porque se presume que mantiene mayor localidad
+		// en cache para el escenario de orden aleatorio (el mas usado)
+		// TODO: Comprobar si ambos casos son mejorados usando lista enlazada
+		move(randomIds.cbegin()+1+i, randomIds.cend(), randomIds.begin()+i);
+	} 
+	else 
+	{
+		// guarda el ultimo en el lugar donde estaba el estado
+		// que fue eliminado, asi podemos descartar y reducir el
+		// tama�o del vector sin penalizar el desempe�o
+		randomIds[i] = randomIds.back();				
+	}
+	randomIds.pop_back();
+}
+
+/** Evalua sin modificar el modelo la mezcla del estado s1 en el estado s2. Retorna el
+    numero de muestras positivas siguientes que reconoce o -1 si reconoce alguna negativa.
+	Puede ejecutarse desde varios hilos a la vez, cada uno con su automata de prueba.
+	El resultado se guarda en la cache del estado s1 para las siguientes rondas: una mezcla
+	que reconoce alguna muestra negativa sigue descartada despues de confirmar otras mezclas
+	porque mezclar mas estados solo agranda el lenguaje, y el puntaje de una mezcla valida
+	se conserva hasta la siguiente mezcla confirmada (ver InvalidateMergeCache)
+*/
+int OilTrainer::EvaluateMerge(int s2, int s1, Nfa& test, TMergeCache& cache, size_t nextPosSample, 
+	unsigned long long& prefilterCandidates, unsigned long long& prefilterRejected) const
+{
+	if(cache.Rejected[s2]) return -1;
+	{
+		lock_guard<mutex> lock(cache.ScoresLock);
+		auto known = cache.Scores.find(s2);
+		if(known != cache.Scores.end()) return known->second;
+	}
+
+	Profiler::Count(Profiler::CounterCandidates);
+	if(UseNegativePrefilter)
+	{
+		prefilterCandidates++;
+		if(_TestBit(&cache.Forbidden[0], s2))
+		{
+			prefilterRejected++;
+			Profiler::Count(Profiler::CounterPrefilterRejected);
+			cache.Rejected[s2] = true;
+			return -1;
+		}
+	}
+
+	test.CloneFrom(*nfa);
+	test.Merge(s2, s1);
+
+	bool anyNegMatch;
+	{
+		ProfileScope profile(Profiler::PhaseNegativeCheck);
+		anyNegMatch = _anyMatch(*negSamples, test);
+	}
+	if(anyNegMatch) 
+	{
+		Profiler::Count(Profiler::CounterNegativeRejected);
+		cache.Rejected[s2] = true;
+		return -1;
+	}
+	Profiler::Count(Profiler::CounterAccepted);
+
+	int score;
+	{
+		ProfileScope profile(Profiler::PhasePositiveScore);
+		score = _countMatches(*posSamples, nextPosSample, posSamples->size(), test);
+	}
+	lock_guard<mutex> lock(cache.ScoresLock);
+	cache.Scores[s2] = score;
+	return score;
+}
+
+/** Descarta los resultados que pueden cambiar al mezclar removedState en keptState.
+	Los rechazos se conservan, pero las muestras positivas suelen recorrer la mayor parte
+	de los estados activos y casi cualquier mezcla cambia su puntaje, por lo que los
+	puntajes se vuelven a simular en vez de guardar los estados que recorrio cada mezcla
+*/
+void OilTrainer::InvalidateMergeCache(int removedState)
+{
+	mergeCache.erase(removedState);
+	for(auto it=mergeCache.begin(); it!=mergeCache.end(); ++it)
+	{
+		it->second.ForbiddenValid = false;
+		it->second.Scores.clear();
+	}
+}
+
+/** Recalcula el prefiltro para el modelo actual e informa cuando se desactiva por
+    superar el limite de memoria. Despues de mezclar removedState en keptState solo
+	recalcula las posiciones que alcanzan alguno de los dos estados
+*/
+void OilTrainer::UpdatePrefilter(int keptState, int removedState)
+{
+	ProfileScope profile(Profiler::PhasePrefilter);
+	bool wasDisabled = prefilter.IsDisabled();
+	prefilter.MemoryLimit = PrefilterMemoryLimit;
+	if(keptState >= 0) prefilter.UpdateMerged(*nfa, keptState, removedState);
+	else prefilter.Update(*nfa);
+	if(ShowProgress && prefilter.IsDisabled() != wasDisabled)
+	{
+		auto required = (prefilter.GetRequiredMemory() + (1 << 20) - 1) >> 20;
+		if(wasDisabled) cout << "Prefiltro reactivado: requiere " << required << " MB" << endl;
+		else cout << "Prefiltro desactivado: requiere " << required << " MB y el limite es " << (PrefilterMemoryLimit >> 20) << " MB" << endl;
+	}
+}
+
+/** Version paralela de DoAllMergesPossible con el mismo resultado.
+	En cada ronda los hilos evaluan sobre el mismo modelo las mezclas candidatas de los
+	siguientes SpeculativeStates estados nuevos, en el mismo orden que el algoritmo secuencial.
+	Las mezclas de un estado posterior al primero con alguna mezcla valida son especulativas:
+	ese estado se mezcla con seguridad y cambia el modelo, por lo que no se toman nuevas
+	candidatas despues de el. Al final de la ronda se confirma en orden la mejor mezcla del
+	primer estado que la tenga y la siguiente ronda solo vuelve a simular las mezclas cuyo
+	resultado pudo cambiar
+*/
+void OilTrainer::DoAllMergesSpeculative(size_t currentPosSampleIdx)
+{
+	auto nextPosSample = currentPosSampleIdx + 1;
+	bool skipSearch = SkipSearchBestMerge || budgetSkipSearch;
+	unsigned threads = Threads;
+	unsigned window = SpeculativeStates > 0 ? SpeculativeStates : threads;
+	unsigned tokens = nfa->GetMaxStates() / Nfa::BitsPerToken;
+	if(workers.GetCount() != threads) workers.Start(threads);
+	while(speculativeNfas.size() < threads) speculativeNfas.push_back(new Nfa(nfa->GetAlphabetLenght()));
+
+	vector<unsigned long long> prefilterCandidates(threads), prefilterRejected(threads);
+	vector<TMergeCache*> caches(window);
+	// inicio de las candidatas de cada estado de la ronda
+	vector<size_t> offsets(window + 1);
+	mergeCache.clear();
+
+	unsigned i = statesAddedBeginInRandom;
+	while(i < randomIds.size())
+	{
+		if(TimeBudgetSeconds > 0 && BudgetExhausted(currentPosSampleIdx)) break;
+		unsigned count = min(window, (unsigned)randomIds.size() - i);
+		offsets[0] = 0;
+		for(unsigned k=0; k<count; k++)
+		{
+			auto& cache = mergeCache[randomIds[i+k]];
+			if(cache.Rejected.empty())
+			{
+				cache.Rejected.resize(nfa->GetMaxStates(), false);
+				cache.Forbidden.resize(tokens);
+				cache.ForbiddenValid = false;
+			}
+			caches[k] = &cache;
+			// el estado de la posicion i+k tiene una candidata por cada posicion anterior
+			offsets[k+1] = offsets[k] + i + k;
+		}
+
+		if(UseNegativePrefilter)
+		{
+			atomic<unsigned> nextState(0);
+			workers.Run([&](unsigned)
+			{
+				ProfileScope profile(Profiler::PhasePrefilter);
+				unsigned k;
+				while((k = nextState++) < count)
+				{
+					if(caches[k]->ForbiddenValid) continue;
+					prefilter.GetForbidden(randomIds[i+k], &caches[k]->Forbidden[0]);
+					caches[k]->ForbiddenValid = true;
+				}
+			});
+		}
+
+		// las candidatas desde cutoff en adelante ya no afectan el resultado de la ronda
+		atomic<size_t> nextTask(0), cutoff(offsets[count]);
+		workers.Run([&](unsigned worker)
+		{
+			unsigned k = 0;
+			size_t t;
+			while((t = nextTask++) < cutoff)
+			{
+				while(t >= offsets[k+1]) k++;
+				unsigned j = (unsigned)(t - offsets[k]);
+				int score = EvaluateMerge(randomIds[j], randomIds[i+k], *speculativeNfas[worker], *caches[k], nextPosSample,
+					prefilterCandidates[worker], prefilterRejected[worker]);
+				if(score < 0) continue;
+				// el estado se mezclara: basta terminar sus candidatas (o las anteriores si se omite la busqueda)
+				size_t limit = skipSearch ? t + 1 : offsets[k+1];
+				size_t current = cutoff;
+				while(limit < current && !cutoff.compare_exchange_weak(current, limit));
+			}
+		});
+
+		for(unsigned w=0; w<threads; w++)
+		{
+			prefilter.Candidates += prefilterCandidates[w];
+			prefilter.Rejected += prefilterRejected[w];
+			prefilterCandidates[w] = prefilterRejected[w] = 0;
+		}
+
+		// busca en orden el primer estado con alguna mezcla valida
+		int bestScore = -1;
+		int bestJ = -1;
+		unsigned k = 0;
+		for(; k<count && bestScore == -1; k++)
+		{
+			auto& cache = *caches[k];
+			for(unsigned j=0; j<i+k; j++)
+			{
+				int s2 = randomIds[j];
+				if(cache.Rejected[s2]) continue;
+				int score = cache.Scores[s2];
+				if(score > bestScore)
+				{
+					bestScore = score;
+					bestJ = j;
+					if(skipSearch) break;
+				}
+			}
+		}
+		if(bestScore == -1)
+		{
+			for(unsigned p=0; p<count; p++) mergeCache.erase(randomIds[i+p]);
+			i += count;
+			continue;
+		}
+
+		// los estados anteriores de la ronda no se mezclan y no vuelven a evaluarse
+		for(unsigned p=0; p+1<k; p++) mergeCache.erase(randomIds[i+p]);
+		i += k - 1;
+		int s1 = randomIds[i];
+		int s2 = randomIds[bestJ];
+		Profiler::Count(Profiler::CounterMerges);
+		if(ShowMerges)
+		{
+			cout << "Mezcla "<< bestJ << " " << i << " -> " << s2 << " " << s1 << " (score: " << bestScore << ")" << endl;
+		}
+		nfa->Merge(s2, s1);
+		if(UseNegativePrefilter) UpdatePrefilter(s2, s1);
+		RemoveNewState(i);
+		InvalidateMergeCache(s1);
+	}
+	mergeCache.clear();
+	
+	// no debe quedar reconociendo muestras negativas
+	assert(!_anyMatch(*negSamples, *nfa));
+	// no debe perderse la capacidad de reconocer la nueva muestra ni las anteriores
+	assert(_allMatch(*posSamples, 0, nextPosSample, *nfa));
+}
+
+/** Inicia la medicion del presupuesto de tiempo sin concesiones
+*/
+void OilTrainer::StartBudget(size_t firstPosSample)
+{
+	budgetStart = levelStart = TBudgetClock::now();
+	levelStartSample = firstPosSample;
+	budgetSkipSearch = false;
+	candidateCap = noCandidateCap;
+	Concessions.clear();
+}
+
+/** Proyecta el tiempo de las muestras restantes con el ritmo medido desde la ultima
+    concesion y hace una nueva concesion si no alcanza el presupuesto
+*/
+void OilTrainer::UpdateBudget(size_t processedSamples)
+{
+	if(TimeBudgetSeconds <= 0 || candidateCap == 0) return;
+	if(processedSamples >= posSamples->size() || BudgetExhausted(processedSamples)) return;
+
+	auto now = TBudgetClock::now();
+	double elapsed = chrono::duration<double>(now - budgetStart).count();
+	double levelElapsed = chrono::duration<double>(now - levelStart).count();
+	size_t levelSamples = processedSamples - levelStartSample;
+	// pocas muestras no bastan para estimar el ritmo salvo que ya hayan consumido parte del presupuesto
+	if(levelSamples < budgetMinSamples && levelElapsed < TimeBudgetSeconds * 0.05) return;
+
+	double projected = levelElapsed / levelSamples * (posSamples->size() - processedSamples);
+	if(elapsed + projected <= TimeBudgetSeconds) return;
+	Concede(processedSamples, false, "se estiman " + lexical_cast<string>((long long)(projected * 1000)) + " ms para " 
+		+ lexical_cast<string>(posSamples->size() - processedSamples) + " muestras restantes");
+}
+
+/** Indica si ya se agoto el presupuesto de tiempo, en cuyo caso no se hacen mas mezclas
+*/
+bool OilTrainer::BudgetExhausted(size_t currentPosSampleIdx)
+{
+	if(candidateCap == 0) return true;
+	double elapsed = chrono::duration<double>(TBudgetClock::now() - budgetStart).count();
+	if(elapsed < TimeBudgetSeconds) return false;
+	Concede(currentPosSampleIdx, true, "presupuesto agotado");
+	return true;
+}
+
+/** Pasa a la siguiente concesion: primero acepta la primera mezcla valida en lugar de buscar la
+    mejor, luego limita las candidatas por estado a una muestra aleatoria cada vez menor y por
+	ultimo deja de mezclar estados. Todas las mezclas se siguen validando con las muestras negativas
+*/
+void OilTrainer::Concede(size_t processedSamples, bool exhausted, const string& reason)
+{
+	string concession;
+	if(exhausted)
+	{
+		candidateCap = 0;
+		concession = "no se mezclan mas estados";
+	}
+	else if(!SkipSearchBestMerge && !budgetSkipSearch)
+	{
+		budgetSkipSearch = true;
+		concession = "se acepta la primera mezcla valida en lugar de la mejor";
+	}
+	else if(candidateCap > 1)
+	{
+		candidateCap = candidateCap == noCandidateCap ? firstCandidateCap : candidateCap / 4;
+		if(candidateCap == 0) candidateCap = 1;
+		concession = "se evaluan hasta " + lexical_cast<string>(candidateCap) + " mezclas candidatas al azar por estado";
+	}
+	else
+	{
+		candidateCap = 0;
+		concession = "no se mezclan mas estados";
+	}
+
+	double elapsed = chrono::duration<double>(TBudgetClock::now() - budgetStart).count();
+	auto entry = "muestra " + lexical_cast<string>(processedSamples) + ", " + lexical_cast<string>((long long)(elapsed * 1000)) 
+		+ " ms: " + concession + " (" + reason + ")";
+	Concessions.push_back(entry);
+	if(ShowProgress) cout << "Presupuesto de tiempo: " << entry << endl;
+
+	levelStart = TBudgetClock::now();
+	levelStartSample = processedSamples;
+}
+
+/** Elige al azar candidateCap posiciones de [0, count) y las deja en orden creciente
+    al inicio de candidateOrder para conservar el orden de evaluacion secuencial
+*/
+void OilTrainer::SampleCandidates(unsigned count)
+{
+	candidateOrder.resize(count);
+	for(unsigned c=0; c<count; c++) candidateOrder[c] = c;
+	for(unsigned c=0; c<candidateCap; c++)
+	{
+		uniform_int_distribution<unsigned> dist(c, count - 1);
+		swap(candidateOrder[c], candidateOrder[dist(rng)]);
+	}
+	sort(candidateOrder.begin(), candidateOrder.begin() + candidateCap);
+}
+
+/** Libera los hilos y automatas de la evaluacion especulativa
+*/
+void OilTrainer::ReleaseSpeculative()
+{
+	workers.Stop();
+	for(auto it=speculativeNfas.begin(); it!=speculativeNfas.end(); ++it) delete *it;
+	speculativeNfas.clear();
+	mergeCache.clear();
+}
+
+const char checkpointMagic[8] = { 'F', 'O', 'I', 'L', 'C', 'K', 'P', '2' };
+const char sessionMagic[8] = { 'F', 'O', 'I', 'L', 'S', 'E', 'S', '1' };
+
+/** Reemplaza un archivo por otro recien escrito. Si el proceso se interrumpe
+    el archivo destino conserva su contenido anterior
+*/
+void _replaceFile(const string& source, const string& destination)
+{
+#ifdef _WIN32
+	// rename() no reemplaza archivos existentes en Windows
+	remove(destination.c_str());
+#endif
+	if(rename(source.c_str(), destination.c_str()) != 0)
+	{
+		throw runtime_error("No fue posible reemplazar el archivo " + destination);
+	}
+}
+
+/** Escribe un conjunto de muestras en formato binario
+*/
+void _writeSamples(ostream& out, const SampleSet& samples)
+{
+	unsigned long long count = samples.size();
+	out.write((const char*)&count, sizeof(count));
+	for(size_t i=0; i<samples.size(); i++)
+	{
+		auto sample = samples[i].ToSample();
+		unsigned long long len = sample.size();
+		out.write((const char*)&len, sizeof(len));
+		out.write((const char*)sample.data(), sample.size() * sizeof(TSymbol));
+	}
+}
+
+/** Lee un conjunto de muestras escrito con _writeSamples
+*/
+void _readSamples(istream& in, SampleSet& samples)
+{
+	unsigned long long count;
+	in.read((char*)&count, sizeof(count));
+	samples.Clear();
+	TSample sample;
+	for(unsigned long long i=0; i<count && in; i++)
+	{
+		unsigned long long len;
+		in.read((char*)&len, sizeof(len));
+		sample.resize((size_t)len);
+		in.read((char*)sample.data(), sample.size() * sizeof(TSymbol));
+		samples.Add(sample);
+	}
+}
+
+/** Acumula bytes en un hash FNV-1a de 64 bits
+*/
+unsigned long long _hashBytes(unsigned long long hash, const void* data, size_t size)
+{
+	auto bytes = (const unsigned char*)data;
+	for(size_t i=0; i<size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+/** Acumula en el hash el contenido de un conjunto de muestras ordenado: longitud, simbolos
+    y peso de cada muestra, independiente del ancho con que se guardan los simbolos
+*/
+unsigned long long _hashSamples(unsigned long long hash, const SampleSet& samples)
+{
+	for(size_t n=0; n<samples.size(); n++)
+	{
+		auto sample = samples[n];
+		unsigned long long len = sample.size();
+		unsigned weight = samples.GetWeight(n);
+		hash = _hashBytes(hash, &len, sizeof(len));
+		for(size_t i=0; i<sample.size(); i++)
+		{
+			TSymbol sym = sample[i];
+			hash = _hashBytes(hash, &sym, sizeof(sym));
+		}
+		hash = _hashBytes(hash, &weight, sizeof(weight));
+	}
+	return hash;
+}
+
+/** Calcula los hash que identifican un punto de control: el contenido de las muestras
+    y las opciones que cambian el resultado del entrenamiento. Los hilos y la evaluacion
+	especulativa no se incluyen porque el modelo es el mismo que el secuencial
+*/
+void OilTrainer::CheckpointHashes(unsigned long long hashes[2]) const
+{
+	const unsigned long long fnvBasis = 14695981039346656037ULL;
+	unsigned long long counts[2] = { posSamples->size(), negSamples->size() };
+	hashes[0] = _hashBytes(fnvBasis, counts, sizeof(counts));
+	hashes[0] = _hashSamples(hashes[0], *posSamples);
+	hashes[0] = _hashSamples(hashes[0], *negSamples);
+
+	unsigned flags = (SkipSearchBestMerge ? 1 : 0) | (DoNotUseRandomSort ? 2 : 0) | (UseNegativePrefilter ? 4 : 0);
+	unsigned long long memoryLimit = PrefilterMemoryLimit;
+	hashes[1] = _hashBytes(fnvBasis, &flags, sizeof(flags));
+	hashes[1] = _hashBytes(hashes[1], &Seed, sizeof(Seed));
+	hashes[1] = _hashBytes(hashes[1], &memoryLimit, sizeof(memoryLimit));
+	hashes[1] = _hashBytes(hashes[1], &TimeBudgetSeconds, sizeof(TimeBudgetSeconds));
+}
+
+/** Escribe el estado del algoritmo: identificadores aleatorios, generador aleatorio,
+    contadores del prefiltro y automata actual
+*/
+void OilTrainer::WriteState(ostream& out) const
+{
+	unsigned long long idsCount = randomIds.size();
+	unsigned long long prefilterCounters[2] = { prefilter.Candidates, prefilter.Rejected };
+	ostringstream rngState;
+	rngState << rng;
+	string rngText = rngState.str();
+	unsigned long long rngLength = rngText.size();
+
+	out.write((const char*)&idsCount, sizeof(idsCount));
+	out.write((const char*)randomIds.data(), randomIds.size() * sizeof(int));
+	out.write((const char*)&rngLength, sizeof(rngLength));
+	out.write(rngText.data(), rngText.size());
+	out.write((const char*)prefilterCounters, sizeof(prefilterCounters));
+	nfa->Save(out);
+}
+
+/** Lee el estado escrito con WriteState()
+*/
+void OilTrainer::ReadState(istream& in)
+{
+	unsigned long long idsCount;
+	in.read((char*)&idsCount, sizeof(idsCount));
+	randomIds.resize((size_t)idsCount);
+	in.read((char*)randomIds.data(), randomIds.size() * sizeof(int));
+
+	unsigned long long rngLength;
+	in.read((char*)&rngLength, sizeof(rngLength));
+	string rngText((size_t)rngLength, ' ');
+	in.read(&rngText[0], rngText.size());
+	istringstream rngState(rngText);
+	rngState >> rng;
+
+	unsigned long long prefilterCounters[2];
+	in.read((char*)prefilterCounters, sizeof(prefilterCounters));
+	prefilter.Candidates = prefilterCounters[0];
+	prefilter.Rejected = prefilterCounters[1];
+
+	nfa->Load(in);
+}
+
+/** Guarda el estado completo del entrenamiento entre dos muestras positivas.
+    Se escribe en un archivo temporal que luego reemplaza al anterior, de esta manera
+	una interrupcion durante la escritura no destruye el ultimo punto de control valido
+	@nextPosSample Indice de la siguiente muestra positiva a procesar
+*/
+void OilTrainer::SaveCheckpoint(const string& filename, size_t nextPosSample)
+{
+	string tmpFilename = filename + ".tmp";
+	{
+		ofstream out(tmpFilename, ios::binary);
+		if(!out.is_open())
+		{
+			throw runtime_error("No fue posible crear el archivo de punto de control");
+		}
+		unsigned long long header[3] = { posSamples->size(), negSamples->size(), nextPosSample };
+		unsigned long long hashes[2];
+		CheckpointHashes(hashes);
+
+		out.write(checkpointMagic, sizeof(checkpointMagic));
+		out.write((const char*)header, sizeof(header));
+		out.write((const char*)hashes, sizeof(hashes));
+		WriteState(out);
+		out.close();
+		if(out.fail())
+		{
+			throw runtime_error("Error escribiendo el archivo de punto de control");
+		}
+	}
+	_replaceFile(tmpFilename, filename);
+}
+
+/** Restaura el estado del entrenamiento guardado con SaveCheckpoint().
+    Las muestras y las opciones de entrenamiento deben ser las mismas que las originales,
+	se comparan los hash de su contenido y se rechaza el punto de control si difieren
+	@return Indice de la siguiente muestra positiva a procesar
+*/
+size_t OilTrainer::LoadCheckpoint(const string& filename)
+{
+	ifstream in(filename, ios::binary);
+	if(!in.is_open())
+	{
+		throw runtime_error("No fue posible abrir el archivo de punto de control");
+	}
+	char magic[sizeof(checkpointMagic)];
+	unsigned long long header[3];
+	unsigned long long hashes[2];
+	in.read(magic, sizeof(magic));
+	in.read((char*)header, sizeof(header));
+	in.read((char*)hashes, sizeof(hashes));
+	if(!in || !equal(magic, magic+sizeof(magic), checkpointMagic))
+	{
+		throw runtime_error("Formato de punto de control invalido");
+	}
+	unsigned long long expected[2];
+	CheckpointHashes(expected);
+	if(header[0] != posSamples->size() || header[1] != negSamples->size() || header[2] > posSamples->size() || hashes[0] != expected[0])
+	{
+		throw runtime_error("El punto de control no corresponde a estas muestras");
+	}
+	if(hashes[1] != expected[1])
+	{
+		throw runtime_error("El punto de control no corresponde a estas opciones de entrenamiento");
+	}
+
+	ReadState(in);
+	return (size_t)header[2];
+}
+
+/** Inicia una sesion de entrenamiento incremental con un modelo vacio.
+    Las muestras se agregan con AddNegative() y AddPositive() y el modelo se actualiza
+	solo con las muestras nuevas
+*/
+void OilTrainer::BeginSession(unsigned alpha)
+{
+	delete nfa;
+	delete testNfa;
+	delete bestNfa;
+	nfa = new Nfa(alpha);
+	testNfa = new Nfa(alpha);
+	bestNfa = new Nfa(alpha);
+	nfa->Clear();
+
+	sessionPos.Clear();
+	sessionNeg.Clear();
+	posSamples = &sessionPos;
+	negSamples = &sessionNeg;
+	if(UseNegativePrefilter) prefilter.SetSamples(sessionNeg);
+	randomIds.clear();
+	rng.seed(Seed >= 0 ? (unsigned)Seed : (unsigned)rand());
+	IgnoredNegatives = 0;
+	// el presupuesto de tiempo se cuenta desde el inicio de la sesion
+	StartBudget(0);
+}
+
+/** Agrega una muestra positiva a la sesion. Si el modelo no la reconoce se fuerza su
+    reconocimiento y se realizan las mezclas posibles solo sobre los nuevos estados
+	@return true si el modelo fue modificado
+*/
+bool OilTrainer::AddPositive(const TSample& sample)
+{
+	assert(nfa != NULL && posSamples == &sessionPos);
+	if(nfa->IsMatch(sample))
+	{
+		sessionPos.Add(sample);
+		return false;
+	}
+	if(sessionNeg.Contains(sample))
+	{
+		throw runtime_error("La muestra positiva ya fue agregada como negativa");
+	}
+	sessionPos.Add(sample);
+	auto currentPosSampleIdx = sessionPos.size() - 1;
+	CoreceMatch(currentPosSampleIdx);
+	DoAllMergesPossible(currentPosSampleIdx);
+	Profiler::Record(sessionPos.size(), *nfa);
+	return true;
+}
+
+/** Agrega una muestra negativa a la sesion. Si el modelo actual la reconoce se aplica
+    la politica ConflictPolicy
+	@return true si el modelo fue modificado
+*/
+bool OilTrainer::AddNegative(const TSample& sample)
+{
+	assert(nfa != NULL && negSamples == &sessionNeg);
+	if(!nfa->IsMatch(sample))
+	{
+		sessionNeg.Add(sample);
+		if(UseNegativePrefilter) prefilter.AppendSamples();
+		return false;
+	}
+
+	if(ConflictPolicy == IgnoreConflicts)
+	{
+		IgnoredNegatives++;
+		return false;
+	}
+	if(ConflictPolicy == RejectConflicts)
+	{
+		throw runtime_error("La muestra negativa es reconocida por el modelo actual");
+	}
+	if(sessionPos.Contains(sample))
+	{
+		throw runtime_error("La muestra negativa ya fue agregada como positiva");
+	}
+	sessionNeg.Add(sample);
+	RetrainSession();
+	return true;
+}
+
+/** Agrega un bloque de muestras negativas a la sesion. A diferencia de AddNegative()
+    con la politica RetrainOnConflict el modelo se reentrena a lo sumo una vez. Si alguna
+	muestra se rechaza no se agrega ninguna del bloque
+	@return true si el modelo fue modificado
+*/
+bool OilTrainer::AddNegatives(const TSamples& samples)
+{
+	assert(nfa != NULL && negSamples == &sessionNeg);
+	// se verifica todo el bloque antes de agregarlo, asi un error deja la sesion intacta
+	bool retrain = false;
+	vector<bool> ignored(samples.size(), false);
+	for(size_t n=0; n<samples.size(); n++)
+	{
+		if(!nfa->IsMatch(samples[n])) continue;
+		if(ConflictPolicy == IgnoreConflicts)
+		{
+			ignored[n] = true;
+			continue;
+		}
+		if(ConflictPolicy == RejectConflicts)
+		{
+			throw runtime_error("La muestra negativa es reconocida por el modelo actual");
+		}
+		if(sessionPos.Contains(samples[n]))
+		{
+			throw runtime_error("La muestra negativa ya fue agregada como positiva");
+		}
+		retrain = true;
+	}
+	for(size_t n=0; n<samples.size(); n++)
+	{
+		if(ignored[n]) IgnoredNegatives++;
+		else sessionNeg.Add(samples[n]);
+	}
+	if(UseNegativePrefilter) prefilter.AppendSamples();
+	if(retrain) RetrainSession();
+	return retrain;
+}
+
+/** Reconstruye el modelo de la sesion desde cero con todas sus muestras,
+    en el mismo orden que el entrenamiento por lotes
+*/
+void OilTrainer::RetrainSession()
+{
+	sessionPos.Sort();
+	sessionNeg.Sort();
+	if(UseNegativePrefilter) prefilter.SetSamples(sessionNeg);
+	nfa->Clear();
+	randomIds.clear();
+
+	for (size_t currentPosSampleIdx=0; currentPosSampleIdx < sessionPos.size(); currentPosSampleIdx++)
+	{
+		auto sample = sessionPos[currentPosSampleIdx];
+		if(!sample.IsMatchedBy(*nfa))
+		{
+			CoreceMatch(currentPosSampleIdx);
+			DoAllMergesPossible(currentPosSampleIdx);
+		}
+	}
+}
+
+/** Obtiene el modelo actual de la sesion
+*/
+const Nfa& OilTrainer::GetModel() const
+{
+	assert(nfa != NULL);
+	return *nfa;
+}
+
+size_t OilTrainer::GetPositiveCount() const
+{
+	return sessionPos.size();
+}
+
+size_t OilTrainer::GetNegativeCount() const
+{
+	return sessionNeg.size();
+}
+
+/** Guarda la sesion: muestras, estado del algoritmo y modelo actual
+*/
+void OilTrainer::SaveSession(const string& filename) const
+{
+	assert(nfa != NULL);
+	string tmpFilename = filename + ".tmp";
+	{
+		ofstream out(tmpFilename, ios::binary);
+		if(!out.is_open())
+		{
+			throw runtime_error("No fue posible crear el archivo de sesion");
+		}
+		unsigned alpha = nfa->GetAlphabetLenght();
+		out.write(sessionMagic, sizeof(sessionMagic));
+		out.write((const char*)&alpha, sizeof(alpha));
+		_writeSamples(out, sessionPos);
+		_writeSamples(out, sessionNeg);
+		WriteState(out);
+		out.close();
+		if(out.fail())
+		{
+			throw runtime_error("Error escribiendo el archivo de sesion");
+		}
+	}
+	_replaceFile(tmpFilename, filename);
+}
+
+/** Carga una sesion guardada con SaveSession() para continuar agregando muestras
+*/
+void OilTrainer::LoadSession(const string& filename)
+{
+	ifstream in(filename, ios::binary);
+	if(!in.is_open())
+	{
+		throw runtime_error("No fue posible abrir el archivo de sesion");
+	}
+	char magic[sizeof(sessionMagic)];
+	unsigned alpha;
+	in.read(magic, sizeof(magic));
+	in.read((char*)&alpha, sizeof(alpha));
+	if(!in || !equal(magic, magic+sizeof(magic), sessionMagic))
+	{
+		throw runtime_error("Formato de sesion invalido");
+	}
+	BeginSession(alpha);
+	_readSamples(in, sessionPos);
+	_readSamples(in, sessionNeg);
+	if(UseNegativePrefilter) prefilter.SetSamples(sessionNeg);
+	ReadState(in);
+	if(nfa->GetAlphabetLenght() != alpha)
+	{
+		throw runtime_error("Formato de sesion invalido, longitud de alfabeto incorrecta");
+	}
 }
 
 OilTrainer::OilTrainer()
-	: ShowMerges(false), ShowProgress(false), SkipSearchBestMerge(false), DoNotUseRandomSort(false), ShowPossibleMerges(false)
+	: nfa(NULL), testNfa(NULL), bestNfa(NULL), posSamples(NULL), negSamples(NULL), budgetSkipSearch(false), candidateCap(noCandidateCap),
+	  ShowMerges(false), ShowProgress(false), SkipSearchBestMerge(false), ShowPossibleMerges(false), DoNotUseRandomSort(false), UseNegativePrefilter(true), PrefilterMemoryLimit((size_t)1 << 30),
+	  CheckpointEverySamples(0), CheckpointEverySeconds(600), ConflictPolicy(RetrainOnConflict), IgnoredNegatives(0),
+	  Threads(0), SpeculativeStates(0), TimeBudgetSeconds(0), Seed(-1)
 {
 }
+
+OilTrainer::~OilTrainer()
+{
+	// el modelo entregado por Train() pertenece al llamador, solo se liberan los de la sesion
+	delete nfa;
+	delete testNfa;
+	delete bestNfa;
+	ReleaseSpeculative();
+}
@@ -1,7 +1,15 @@
 #pragma once
 
 #include "Nfa.h"
+#include "NegativePrefilter.h"
+#include "SampleSet.h"
+#include "WorkerPool.h"
 #include <vector>
+#include <string>
+#include <random>
+#include <map>
+#include <mutex>
+#include <chrono>
 
 class OilTrainer
 {
@@ -9,6 +17,17 @@ public:
 	typedef Nfa::TSymbol TSymbol;
 	typedef Nfa::TSample TSample;
 	typedef std::vector<TSample> TSamples;
+
+	/// Que hacer cuando una nueva muestra negativa es reconocida por el modelo de la sesion
+	enum TConflictPolicy
+	{
+		/// Reentrena el modelo desde cero con todas las muestras de la sesion
+		RetrainOnConflict,
+		/// Descarta la muestra negativa
+		IgnoreConflicts,
+		/// Lanza una excepcion
+		RejectConflicts
+	};
 	
 private:	
 	// donde se agregaron los estados en el arreglo de identificadores
@@ -18,12 +37,63 @@ private:
 	Nfa* testNfa;
 	Nfa* bestNfa;
 
-	TSamples* posSamples;
-	TSamples* negSamples;
+	const SampleSet* posSamples;
+	const SampleSet* negSamples;
 	std::vector<int> randomIds;
+	NegativePrefilter prefilter;
+	// generador de numeros aleatorios propio para poder guardar su estado
+	std::mt19937 rng;
+
+	// muestras propias de la sesion incremental
+	SampleSet sessionPos;
+	SampleSet sessionNeg;
+
+	// hilos y automatas de prueba de la evaluacion especulativa, uno por hilo
+	WorkerPool workers;
+	std::vector<Nfa*> speculativeNfas;
+
+	// resultados conocidos de las mezclas de un estado nuevo con los estados anteriores
+	struct TMergeCache
+	{
+		// por estado: la mezcla reconoce alguna muestra negativa
+		std::vector<char> Rejected;
+		// puntaje de cada mezcla valida desde la ultima mezcla confirmada
+		std::map<int, int> Scores;
+		std::mutex ScoresLock;
+		// estados prohibidos por el prefiltro
+		std::vector<Nfa::TToken> Forbidden;
+		bool ForbiddenValid;
+	};
+	std::map<int, TMergeCache> mergeCache;
+
+	// entrenamiento con presupuesto de tiempo: concesiones vigentes y ritmo del nivel actual
+	typedef std::chrono::steady_clock TBudgetClock;
+	TBudgetClock::time_point budgetStart;
+	TBudgetClock::time_point levelStart;
+	size_t levelStartSample;
+	bool budgetSkipSearch;
+	unsigned candidateCap;
+	std::vector<unsigned> candidateOrder;
 	
-	void CoreceMatch(TSamples::const_iterator currentPosSampleIterator);
-	void DoAllMergesPossible(TSamples::const_iterator currentPosSampleIterator);
+	void CoreceMatch(size_t currentPosSampleIdx);
+	void DoAllMergesPossible(size_t currentPosSampleIdx);
+	void DoAllMergesSpeculative(size_t currentPosSampleIdx);
+	int EvaluateMerge(int s2, int s1, Nfa& test, TMergeCache& cache, size_t nextPosSample, unsigned long long& prefilterCandidates, unsigned long long& prefilterRejected) const;
+	void InvalidateMergeCache(int removedState);
+	void RemoveNewState(unsigned i);
+	void ReleaseSpeculative();
+	void UpdatePrefilter(int keptState = -1, int removedState = -1);
+	void CheckpointHashes(unsigned long long hashes[2]) const;
+	void SaveCheckpoint(const std::string& filename, size_t nextPosSample);
+	size_t LoadCheckpoint(const std::string& filename);
+	void WriteState(std::ostream& out) const;
+	void ReadState(std::istream& in);
+	void RetrainSession();
+	void StartBudget(size_t firstPosSample);
+	void UpdateBudget(size_t processedSamples);
+	bool BudgetExhausted(size_t currentPosSampleIdx);
+	void Concede(size_t processedSamples, bool exhausted, const std::string& reason);
+	void SampleCandidates(unsigned count);
 
 public:
 	/// Indica si durante el entrenamiento se muestran mensajes de combinacion de estados
@@ -33,8 +103,54 @@ public:
 	bool SkipSearchBestMerge;
 	bool ShowPossibleMerges;
 	bool DoNotUseRandomSort;
+	/// Descarta mezclas que reconocen con seguridad alguna muestra negativa sin ejecutarlas
+	bool UseNegativePrefilter;
+	/// Memoria maxima del prefiltro en bytes (0: sin limite); si no alcanza el prefiltro se desactiva
+	size_t PrefilterMemoryLimit;
+	/// Archivo donde se guarda periodicamente el estado del entrenamiento (vacio: desactivado)
+	std::string CheckpointFilename;
+	/// Guarda el estado cada N muestras positivas procesadas (0: desactivado)
+	unsigned CheckpointEverySamples;
+	/// Guarda el estado cada M segundos (0: desactivado)
+	unsigned CheckpointEverySeconds;
+	/// Archivo desde el que se reanuda el entrenamiento (vacio: desde el inicio)
+	std::string ResumeFilename;
+	/// Politica de la sesion incremental ante muestras negativas reconocidas por el modelo
+	TConflictPolicy ConflictPolicy;
+	/// Muestras negativas descartadas por la politica IgnoreConflicts
+	unsigned IgnoredNegatives;
+	/// Hilos que evaluan mezclas candidatas en paralelo (0 o 1: secuencial)
+	unsigned Threads;
+	/// Estados nuevos cuyas mezclas se evaluan por adelantado en cada ronda paralela (0: tantos como hilos)
+	unsigned SpeculativeStates;
+	/// Tiempo maximo del entrenamiento en segundos (0: sin limite). Si el ritmo no alcanza, el
+	/// entrenamiento reduce la busqueda de mezclas; el modelo siempre es consistente con las muestras
+	double TimeBudgetSeconds;
+	/// Concesiones hechas en el ultimo entrenamiento para cumplir el presupuesto de tiempo
+	std::vector<std::string> Concessions;
 		
-	Nfa* Train(TSamples& posSamples, TSamples& negSamples, unsigned alpha);	
+	/// Semilla del generador aleatorio (-1: se toma de rand())
+	int Seed;
+		
+	/// Semillas de los count automatas de un comite a partir de la semilla del comite.
+	/// Usa su propio generador, no altera ni depende del estado de rand()
+	static std::vector<int> CommitteeSeeds(unsigned seed, unsigned count);
+
+	Nfa* Train(TSamples& posSamples, TSamples& negSamples, unsigned alpha);
+	Nfa* Train(SampleSet& posSamples, SampleSet& negSamples, unsigned alpha);
+
+	// Sesion incremental
+	void BeginSession(unsigned alpha);
+	bool AddPositive(const TSample& sample);
+	bool AddNegative(const TSample& sample);
+	bool AddNegatives(const TSamples& samples);
+	const Nfa& GetModel() const;
+	size_t GetPositiveCount() const;
+	size_t GetNegativeCount() const;
+	void SaveSession(const std::string& filename) const;
+	void LoadSession(const std::string& filename);
+
 	OilTrainer();
+	~OilTrainer();
 };
 
@@ -0,0 +1,116 @@
+#include "StdAfx.h"
+#include "Profiler.h"
+#include "Nfa.h"
+
+using namespace std;
+
+bool Profiler::enabled = false;
+bool Profiler::csv = false;
+unsigned Profiler::run = 0;
+ofstream Profiler::out;
+Profiler::TClock::time_point Profiler::start;
+mutex Profiler::threadsMutex;
+list<Profiler::TThreadData*> Profiler::threads;
+PROFILER_THREAD_LOCAL Profiler::TThreadData* Profiler::local = NULL;
+
+const char* phaseNames[Profiler::PhaseCount] = { "coerce", "clone", "merge", "negative_check", "positive_score", "prefilter", "resize" };
+const char* counterNames[Profiler::CounterCount] = { "candidates", "prefilter_rejected", "negative_rejected", "accepted", "merges" };
+
+/** Obtiene el bloque de acumulacion del hilo actual, creandolo en el primer uso
+*/
+Profiler::TThreadData& Profiler::Local()
+{
+	if(local == NULL)
+	{
+		local = new TThreadData();
+		memset(local, 0, sizeof(TThreadData));
+		lock_guard<mutex> lock(threadsMutex);
+		threads.push_back(local);
+	}
+	return *local;
+}
+
+/** Suma los bloques de todos los hilos. Los hilos de trabajo deben estar detenidos
+    para que los valores sean exactos
+*/
+void Profiler::Sum(TThreadData& total)
+{
+	memset(&total, 0, sizeof(total));
+	lock_guard<mutex> lock(threadsMutex);
+	for(auto it=threads.cbegin(); it!=threads.cend(); ++it)
+	{
+		for(int p=0; p<PhaseCount; p++) total.Nanoseconds[p] += (*it)->Nanoseconds[p];
+		for(int c=0; c<CounterCount; c++) total.Counters[c] += (*it)->Counters[c];
+	}
+}
+
+/** Activa el perfilador y abre el archivo de la linea de tiempo
+*/
+void Profiler::Open(const string& filename)
+{
+	out.open(filename);
+	if(!out.is_open())
+	{
+		throw runtime_error("No fue posible abrir el archivo de perfil");
+	}
+	csv = filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".csv") == 0;
+	if(csv)
+	{
+		out << "run,sample,seconds,states,max_states";
+		for(int c=0; c<CounterCount; c++) out << "," << counterNames[c];
+		for(int p=0; p<PhaseCount; p++) out << "," << phaseNames[p];
+		out << '\n';
+	}
+	run = 0;
+	start = TClock::now();
+	enabled = true;
+}
+
+/** Indica el inicio de un nuevo entrenamiento (por ejemplo cada modelo de train_multiple)
+*/
+void Profiler::BeginRun()
+{
+	if(enabled) run++;
+}
+
+/** Escribe un registro con los acumulados actuales y el numero de estados del automata.
+    Los tiempos se expresan en segundos
+*/
+void Profiler::Record(unsigned long long sample, const Nfa& nfa)
+{
+	if(!enabled) return;
+	TThreadData total;
+	Sum(total);
+	double seconds = chrono::duration_cast<chrono::nanoseconds>(TClock::now() - start).count() / 1e9;
+
+	if(csv)
+	{
+		out << run << "," << sample << "," << seconds << "," << nfa.GetActiveStateCount() << "," << nfa.GetMaxStates();
+		for(int c=0; c<CounterCount; c++) out << "," << total.Counters[c];
+		for(int p=0; p<PhaseCount; p++) out << "," << total.Nanoseconds[p] / 1e9;
+	}
+	else
+	{
+		out << "{\"run\":" << run << ",\"sample\":" << sample << ",\"seconds\":" << seconds
+			<< ",\"states\":" << nfa.GetActiveStateCount() << ",\"max_states\":" << nfa.GetMaxStates();
+		for(int c=0; c<CounterCount; c++) out << ",\"" << counterNames[c] << "\":" << total.Counters[c];
+		for(int p=0; p<PhaseCount; p++) out << ",\"" << phaseNames[p] << "\":" << total.Nanoseconds[p] / 1e9;
+		out << "}";
+	}
+	// sin endl para no vaciar el buffer en cada registro
+	out << '\n';
+}
+
+/** Desactiva el perfilador, muestra el resumen y cierra el archivo
+*/
+void Profiler::Close()
+{
+	if(!enabled) return;
+	enabled = false;
+	TThreadData total;
+	Sum(total);
+	cout << "Perfil de entrenamiento:" << endl;
+	for(int p=0; p<PhaseCount; p++) cout << "\t" << phaseNames[p] << ": " << total.Nanoseconds[p] / 1e9 << " s" << endl;
+	for(int c=0; c<CounterCount; c++) cout << "\t" << counterNames[c] << ": " << total.Counters[c] << endl;
+	out.close();
+}
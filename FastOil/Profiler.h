@@ -0,0 +1,108 @@
+#pragma once
+
+#include <string>
+#include <list>
+#include <fstream>
+#include <mutex>
+#include <chrono>
+
+#ifdef _MSC_VER
+#define PROFILER_THREAD_LOCAL __declspec(thread)
+#else
+#define PROFILER_THREAD_LOCAL __thread
+#endif
+
+class Nfa;
+
+/** Perfilador de las fases del entrenamiento.
+    Cada hilo acumula tiempos y contadores en su propio bloque, sin sincronizacion.
+	Los bloques se suman al escribir un registro de la linea de tiempo, que se
+	escribe en formato JSON por lineas o CSV si el archivo termina en ".csv".
+	Cuando esta desactivado el costo es una comparacion por fase medida
+*/
+class Profiler
+{
+public:
+	enum TPhase
+	{
+		PhaseCoerce,
+		PhaseClone,
+		PhaseMerge,
+		PhaseNegativeCheck,
+		PhasePositiveScore,
+		PhasePrefilter,
+		PhaseResize,
+		PhaseCount
+	};
+
+	enum TCounter
+	{
+		/// Mezclas candidatas consideradas
+		CounterCandidates,
+		/// Candidatas descartadas por el prefiltro
+		CounterPrefilterRejected,
+		/// Candidatas descartadas por reconocer una muestra negativa
+		CounterNegativeRejected,
+		/// Candidatas validas evaluadas con las muestras positivas
+		CounterAccepted,
+		/// Mezclas aplicadas al modelo
+		CounterMerges,
+		CounterCount
+	};
+
+	typedef std::chrono::steady_clock TClock;
+
+	struct TThreadData
+	{
+		long long Nanoseconds[PhaseCount];
+		unsigned long long Counters[CounterCount];
+	};
+
+private:
+	static bool enabled;
+	static bool csv;
+	static unsigned run;
+	static std::ofstream out;
+	static TClock::time_point start;
+	static std::mutex threadsMutex;
+	static std::list<TThreadData*> threads;
+	static PROFILER_THREAD_LOCAL TThreadData* local;
+
+	static TThreadData& Local();
+	static void Sum(TThreadData& total);
+
+public:
+	static bool IsEnabled() { return enabled; }
+	static void AddTime(TPhase phase, long long nanoseconds) { Local().Nanoseconds[phase] += nanoseconds; }
+	static void Count(TCounter counter) { if(enabled) Local().Counters[counter]++; }
+
+	static void Open(const std::string& filename);
+	static void BeginRun();
+	static void Record(unsigned long long sample, const Nfa& nfa);
+	static void Close();
+};
+
+/** Mide el tiempo de una fase durante la vida del objeto
+*/
+class ProfileScope
+{
+	Profiler::TPhase phase;
+	bool active;
+	Profiler::TClock::time_point begin;
+
+public:
+	ProfileScope(Profiler::TPhase p)
+		: phase(p), active(Profiler::IsEnabled())
+	{
+		if(active) begin = Profiler::TClock::now();
+	}
+
+	~ProfileScope()
+	{
+		if(active)
+		{
+			auto elapsed = Profiler::TClock::now() - begin;
+			Profiler::AddTime(phase, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+		}
+	}
+};
@@ -0,0 +1,197 @@
+#include "StdAfx.h"
+#include "ReportWriter.h"
+
+using namespace std;
+
+ReportWriter::ReportWriter()
+	: deferred(NULL), closing(false), failed(false)
+{
+}
+
+ReportWriter::~ReportWriter()
+{
+	try
+	{
+		Close();
+	}
+	catch(...)
+	{
+	}
+}
+
+/** Abre el reporte, comprimido si el nombre termina en .gz o .zst, e inicia el hilo
+    escritor. Retorna false si el archivo no se pudo crear
+*/
+bool ReportWriter::Open(const string& filename)
+{
+	Close();
+	output.reset(new CompressedOutput(filename));
+	if(!output->is_open())
+	{
+		output.reset();
+		return false;
+	}
+	closing = false;
+	failed = false;
+	error = exception_ptr();
+	writer = thread(&ReportWriter::WriterLoop, this);
+	return true;
+}
+
+/** Entrega el contenido de buffer al reporte. buffer queda vacio, con la memoria de un
+    buffer ya escrito si lo hay. Si la escritura fallo se relanza el error
+*/
+void ReportWriter::Write(string& buffer)
+{
+	Push(buffer, Report);
+}
+
+/** Entrega el contenido de buffer a la parte diferida del reporte
+*/
+void ReportWriter::WriteDeferred(string& buffer)
+{
+	Push(buffer, Deferred);
+}
+
+/** Copia al reporte lo entregado hasta ahora con WriteDeferred()
+*/
+void ReportWriter::AppendDeferred()
+{
+	string empty;
+	Push(empty, AppendDeferredMark);
+}
+
+void ReportWriter::Push(string& buffer, TKind kind)
+{
+	assert(output);
+	if(buffer.empty() && kind != AppendDeferredMark) return;
+	unique_lock<std::mutex> lock(mutex);
+	space.wait(lock, [this]{ return failed || blocks.size() < MaxQueuedBuffers; });
+	if(failed) rethrow_exception(error);
+	blocks.push_back(TBlock());
+	blocks.back().Kind = kind;
+	blocks.back().Data.swap(buffer);
+	if(!spare.empty())
+	{
+		buffer.swap(spare.back());
+		spare.pop_back();
+	}
+	lock.unlock();
+	ready.notify_one();
+}
+
+void ReportWriter::WriterLoop()
+{
+	try
+	{
+		for(;;)
+		{
+			TBlock block;
+			{
+				unique_lock<std::mutex> lock(mutex);
+				ready.wait(lock, [this]{ return !blocks.empty() || closing; });
+				if(blocks.empty()) return;
+				block.Kind = blocks.front().Kind;
+				block.Data.swap(blocks.front().Data);
+				blocks.pop_front();
+			}
+			space.notify_one();
+			WriteBlock(block);
+			block.Data.clear();
+			lock_guard<std::mutex> lock(mutex);
+			if(spare.size() < MaxQueuedBuffers)
+			{
+				spare.push_back(string());
+				spare.back().swap(block.Data);
+			}
+		}
+	}
+	catch(...)
+	{
+		{
+			lock_guard<std::mutex> lock(mutex);
+			error = current_exception();
+			failed = true;
+		}
+		space.notify_all();
+	}
+}
+
+void ReportWriter::WriteBlock(TBlock& block)
+{
+	if(block.Kind == Report)
+	{
+		output->write(block.Data.data(), block.Data.size());
+		if(!*output) throw runtime_error("Error escribiendo el archivo de reporte");
+	}
+	else if(block.Kind == Deferred)
+	{
+		if(deferred == NULL && (deferred = tmpfile()) == NULL)
+		{
+			throw runtime_error("Error creando el archivo temporal del reporte");
+		}
+		if(fwrite(block.Data.data(), 1, block.Data.size(), deferred) != block.Data.size())
+		{
+			throw runtime_error("Error escribiendo el archivo temporal del reporte");
+		}
+	}
+	else if(deferred != NULL)
+	{
+		rewind(deferred);
+		vector<char> copy(BufferSize);
+		size_t readed;
+		while((readed = fread(copy.data(), 1, copy.size(), deferred)) > 0) output->write(copy.data(), readed);
+		if(ferror(deferred) || !*output) throw runtime_error("Error copiando la parte diferida del reporte");
+		fclose(deferred);
+		deferred = NULL;
+	}
+}
+
+/** Espera que se escriba todo lo entregado y cierra el reporte. Relanza el error del hilo escritor
+*/
+void ReportWriter::Close()
+{
+	if(writer.joinable())
+	{
+		{
+			lock_guard<std::mutex> lock(mutex);
+			closing = true;
+		}
+		ready.notify_all();
+		writer.join();
+	}
+	blocks.clear();
+	spare.clear();
+	if(deferred != NULL)
+	{
+		fclose(deferred);
+		deferred = NULL;
+	}
+	if(output)
+	{
+		// el archivo se cierra aunque la escritura haya fallado
+		unique_ptr<CompressedOutput> closed;
+		closed.swap(output);
+		if(!failed) closed->close();
+	}
+	if(failed)
+	{
+		failed = false;
+		rethrow_exception(error);
+	}
+}
+
+/** Agrega al buffer un numero en decimal
+*/
+void ReportWriter::AppendNumber(string& buffer, unsigned long long value)
+{
+	char digits[20];
+	size_t count = 0;
+	do
+	{
+		digits[count++] = (char)('0' + value % 10);
+		value /= 10;
+	}
+	while(value != 0);
+	while(count > 0) buffer += digits[--count];
+}
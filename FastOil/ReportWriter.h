@@ -0,0 +1,73 @@
+#pragma once
+
+#include "CompressedOutput.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <cstdio>
+
+/** Escribe un reporte en un hilo propio. Quien evalua formatea los registros en buffers
+    grandes y los entrega con Write(); el hilo escritor los vuelca al archivo mientras se
+	sigue evaluando. Los buffers entregados con WriteDeferred() se guardan en un archivo
+	temporal y se copian al reporte, en su orden, cuando se llama AppendDeferred()
+*/
+class ReportWriter
+{
+public:
+	/// Tamano a partir del cual conviene entregar un buffer
+	static const size_t BufferSize = 1 << 20;
+	/// Buffers que pueden esperar al hilo escritor antes de detener a quien los entrega
+	static const size_t MaxQueuedBuffers = 8;
+
+private:
+	enum TKind
+	{
+		Report,
+		Deferred,
+		AppendDeferredMark
+	};
+
+	struct TBlock
+	{
+		TKind Kind;
+		std::string Data;
+	};
+
+	std::unique_ptr<CompressedOutput> output;
+	FILE* deferred;
+	std::thread writer;
+	std::mutex mutex;
+	std::condition_variable ready;
+	std::condition_variable space;
+	std::deque<TBlock> blocks;
+	// buffers ya escritos que se devuelven para reutilizar su memoria
+	std::vector<std::string> spare;
+	bool closing;
+	bool failed;
+	std::exception_ptr error;
+
+	void Push(std::string& buffer, TKind kind);
+	void WriterLoop();
+	void WriteBlock(TBlock& block);
+
+	// no se puede copiar
+	ReportWriter(const ReportWriter&);
+	ReportWriter& operator=(const ReportWriter&);
+
+public:
+	bool Open(const std::string& filename);
+	void Write(std::string& buffer);
+	void WriteDeferred(std::string& buffer);
+	void AppendDeferred();
+	void Close();
+
+	static void AppendNumber(std::string& buffer, unsigned long long value);
+
+	ReportWriter();
+	~ReportWriter();
+};
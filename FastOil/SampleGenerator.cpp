@@ -0,0 +1,143 @@
+#include "StdAfx.h"
+#include "SampleGenerator.h"
+
+using namespace std;
+
+typedef SampleGenerator::TSamples TSamples;
+typedef SampleGenerator::TSample TSample;
+typedef SampleGenerator::TSymbol TSymbol;
+
+SampleGenerator::SampleGenerator(unsigned seed)
+	: rng(seed),
+	States(16), AlphabetLength(4), Deterministic(true), Density(1.5), FinalRatio(0.5),
+	MinLength(1), MaxLength(20), LengthMean(0), LengthDeviation(0)
+{
+}
+
+void SampleGenerator::Seed(unsigned seed)
+{
+	rng.seed(seed);
+}
+
+/** Construye un automata objetivo aleatorio. El estado 0 es el unico inicial
+*/
+Nfa* SampleGenerator::CreateTarget()
+{
+	if(States == 0 || AlphabetLength == 0)
+	{
+		throw runtime_error("El automata objetivo debe tener al menos un estado y un simbolo");
+	}
+	auto target = new Nfa(AlphabetLength);
+	target->Clear();
+	target->SetInitial(0);
+
+	uniform_int_distribution<unsigned> stateDist(0, States - 1);
+	bernoulli_distribution finalDist(FinalRatio);
+	poisson_distribution<unsigned> densityDist(Density);
+	for(unsigned st=0; st<States; st++)
+	{
+		if(finalDist(rng)) target->SetFinal(st);
+		for(TSymbol sym=0; sym<AlphabetLength; sym++)
+		{
+			unsigned count = Deterministic ? 1 : densityDist(rng);
+			for(unsigned k=0; k<count; k++)
+			{
+				target->SetTransition(st, stateDist(rng), sym);
+			}
+		}
+	}
+	// al menos un estado final para que existan muestras positivas
+	target->SetFinal(stateDist(rng));
+	return target;
+}
+
+unsigned SampleGenerator::RandomLength()
+{
+	if(LengthDeviation > 0)
+	{
+		normal_distribution<double> lengthDist(LengthMean, LengthDeviation);
+		auto len = lengthDist(rng) + 0.5;
+		if(len < MinLength) return MinLength;
+		if(len > MaxLength) return MaxLength;
+		return (unsigned)len;
+	}
+	uniform_int_distribution<unsigned> lengthDist(MinLength, MaxLength);
+	return lengthDist(rng);
+}
+
+TSample SampleGenerator::RandomSample()
+{
+	uniform_int_distribution<TSymbol> symbolDist(0, AlphabetLength - 1);
+	TSample sample(RandomLength());
+	for(auto it=sample.begin(); it!=sample.end(); ++it)
+	{
+		*it = symbolDist(rng);
+	}
+	return sample;
+}
+
+/** Genera muestras aleatorias y las etiqueta con el automata objetivo hasta completar
+    la cantidad pedida de cada clase
+*/
+void SampleGenerator::Generate(const Nfa& target, unsigned positives, unsigned negatives, TSamples& pos, TSamples& neg)
+{
+	if(MinLength > MaxLength)
+	{
+		throw runtime_error("La longitud minima de las muestras es mayor que la maxima");
+	}
+	pos.reserve(pos.size() + positives);
+	neg.reserve(neg.size() + negatives);
+
+	// evita ciclos infinitos cuando el lenguaje objetivo es casi vacio o casi universal
+	unsigned long long attempts = 1000ULL * (positives + negatives) + 1000;
+	while(positives > 0 || negatives > 0)
+	{
+		if(attempts-- == 0)
+		{
+			throw runtime_error("No fue posible generar suficientes muestras de ambas clases con este automata objetivo");
+		}
+		auto sample = RandomSample();
+		if(target.IsMatch(sample))
+		{
+			if(positives == 0) continue;
+			pos.push_back(sample);
+			positives--;
+		}
+		else
+		{
+			if(negatives == 0) continue;
+			neg.push_back(sample);
+			negatives--;
+		}
+	}
+}
+
+/** Escribe las muestras en el formato que lee SamplesReader
+*/
+void SampleGenerator::WriteSamples(string filename, const TSamples& pos, const TSamples& neg, unsigned alpha)
+{
+	ofstream out(filename);
+	if(!out.is_open())
+	{
+		throw runtime_error("No fue posible crear el archivo de muestras");
+	}
+	out << (pos.size() + neg.size()) << " " << alpha << '\n';
+	const TSamples* sets[2] = { &pos, &neg };
+	for(int label=0; label<2; label++)
+	{
+		for(auto it=sets[label]->cbegin(); it!=sets[label]->cend(); ++it)
+		{
+			out << (label == 0 ? 1 : 0) << " " << it->size();
+			for(auto sym=it->cbegin(); sym!=it->cend(); ++sym)
+			{
+				out << " " << *sym;
+			}
+			out << '\n';
+		}
+	}
+	out.close();
+	if(out.fail())
+	{
+		throw runtime_error("Error escribiendo el archivo de muestras");
+	}
+}
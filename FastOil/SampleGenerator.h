@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Nfa.h"
+#include <vector>
+#include <string>
+#include <random>
+
+/** Genera conjuntos de muestras sinteticos a partir de un automata objetivo aleatorio.
+    Las muestras se etiquetan segun las reconozca o no el automata objetivo
+*/
+class SampleGenerator
+{
+public:
+	typedef Nfa::TSymbol TSymbol;
+	typedef Nfa::TSample TSample;
+	typedef std::vector<TSample> TSamples;
+
+private:
+	std::mt19937 rng;
+
+	unsigned RandomLength();
+	TSample RandomSample();
+
+public:
+	/// Cantidad de estados del automata objetivo
+	unsigned States;
+	/// Longitud del alfabeto
+	unsigned AlphabetLength;
+	/// Genera un automata determinista (una transicion por estado y simbolo)
+	bool Deterministic;
+	/// Numero medio de transiciones por estado y simbolo del automata no determinista
+	double Density;
+	/// Probabilidad de que un estado sea final
+	double FinalRatio;
+	/// Longitud minima y maxima de las muestras
+	unsigned MinLength;
+	unsigned MaxLength;
+	/// Si la desviacion es mayor que cero la longitud sigue una distribucion normal
+	/// recortada a [MinLength, MaxLength], en otro caso es uniforme
+	double LengthMean;
+	double LengthDeviation;
+
+	Nfa* CreateTarget();
+	void Generate(const Nfa& target, unsigned positives, unsigned negatives, TSamples& pos, TSamples& neg);
+
+	static void WriteSamples(std::string filename, const TSamples& pos, const TSamples& neg, unsigned alpha);
+
+	void Seed(unsigned seed);
+	SampleGenerator(unsigned seed);
+};
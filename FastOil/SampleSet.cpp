@@ -0,0 +1,531 @@
+#include "StdAfx.h"
+#include "SampleSet.h"
+
+using namespace std;
+
+typedef SampleSet::TSymbol TSymbol;
+typedef SampleSet::TOffset TOffset;
+typedef SampleSet::TWeight TWeight;
+typedef SampleSet::TSampleView TSampleView;
+
+/** Escribe length simbolos en dest con el ancho indicado
+*/
+void _storeSymbols(unsigned char* dest, unsigned width, const TSymbol* source, size_t length)
+{
+	if(width == 1)
+	{
+		for(size_t i=0; i<length; i++) dest[i] = (Nfa::TSymbol8)source[i];
+	}
+	else if(width == 2)
+	{
+		auto d = (Nfa::TSymbol16*)dest;
+		for(size_t i=0; i<length; i++) d[i] = (Nfa::TSymbol16)source[i];
+	}
+	else
+	{
+		memcpy(dest, source, length * sizeof(TSymbol));
+	}
+}
+
+/** Escribe en dest los simbolos de una muestra con el ancho indicado
+*/
+void _storeSymbols(unsigned char* dest, unsigned width, const TSampleView& source)
+{
+	if(source.GetSymbolWidth() == width)
+	{
+		memcpy(dest, source.GetData(), source.size() * width);
+		return;
+	}
+	for(size_t i=0; i<source.size(); i++)
+	{
+		TSymbol sym = source[i];
+		if(width == 1) dest[i] = (Nfa::TSymbol8)sym;
+		else if(width == 2) ((Nfa::TSymbol16*)dest)[i] = (Nfa::TSymbol16)sym;
+		else ((TSymbol*)dest)[i] = sym;
+	}
+}
+
+SampleSet::SampleSet()
+	: symbolWidth(1), external(false)
+{
+	offsets.push_back(0);
+	Bind();
+}
+
+SampleSet::SampleSet(const vector<TSample>& samples)
+	: symbolWidth(1), external(false)
+{
+	size_t total = 0;
+	TSymbol maxSymbol = 0;
+	for(auto it=samples.cbegin(); it!=samples.cend(); ++it)
+	{
+		total += it->size();
+		if(!it->empty()) maxSymbol = max(maxSymbol, *max_element(it->cbegin(), it->cend()));
+	}
+	symbolWidth = SymbolWidthFor(maxSymbol);
+	symbols.resize(total * symbolWidth);
+	offsets.reserve(samples.size() + 1);
+	offsets.push_back(0);
+	size_t pos = 0;
+	for(auto it=samples.cbegin(); it!=samples.cend(); ++it)
+	{
+		_storeSymbols(symbols.data() + pos * symbolWidth, symbolWidth, it->data(), it->size());
+		pos += it->size();
+		offsets.push_back(pos);
+	}
+	Bind();
+}
+
+SampleSet::SampleSet(const SampleSet& c)
+	: symbols(c.symbols), offsets(c.offsets), weights(c.weights), symbolsData(c.symbolsData), offsetsData(c.offsetsData),
+	  weightsData(c.weightsData), count(c.count), symbolWidth(c.symbolWidth), external(c.external)
+{
+	if(!external) Bind();
+}
+
+SampleSet& SampleSet::operator=(const SampleSet& c)
+{
+	symbols = c.symbols;
+	offsets = c.offsets;
+	weights = c.weights;
+	symbolsData = c.symbolsData;
+	offsetsData = c.offsetsData;
+	weightsData = c.weightsData;
+	count = c.count;
+	symbolWidth = c.symbolWidth;
+	external = c.external;
+	if(!external) Bind();
+	return *this;
+}
+
+/** Apunta los datos efectivos al almacenamiento propio
+*/
+void SampleSet::Bind()
+{
+	symbolsData = symbols.data();
+	offsetsData = offsets.data();
+	weightsData = weights.empty() ? NULL : weights.data();
+	count = offsets.size() - 1;
+}
+
+size_t SampleSet::GetSymbolCount() const
+{
+	return (size_t)offsetsData[count];
+}
+
+/** Menor ancho en bytes con que se puede guardar un simbolo
+*/
+unsigned SampleSet::SymbolWidthFor(TSymbol maxSymbol)
+{
+	if(maxSymbol <= 0xFF) return 1;
+	if(maxSymbol <= 0xFFFF) return 2;
+	return sizeof(TSymbol);
+}
+
+/** Vuelve a codificar los simbolos con un ancho mayor
+*/
+void SampleSet::Widen(unsigned width)
+{
+	if(width <= symbolWidth) return;
+	size_t total = GetSymbolCount();
+	vector<unsigned char> wide(total * width);
+	_storeSymbols(wide.data(), width, TSampleView(symbolsData, total, symbolWidth));
+	symbols.swap(wide);
+	symbolWidth = width;
+	Bind();
+}
+
+/** Ajusta el ancho de los simbolos a un alfabeto de alpha simbolos. Un conjunto vacio
+    toma el menor ancho del alfabeto, uno con muestras solo se ensancha si hace falta
+*/
+void SampleSet::SetAlphabetLength(unsigned alpha)
+{
+	if(external)
+	{
+		throw runtime_error("No es posible modificar un conjunto de muestras externo");
+	}
+	unsigned width = SymbolWidthFor(alpha == 0 ? 0 : alpha - 1);
+	if(count == 0) symbolWidth = width;
+	else Widen(width);
+}
+
+/** Cantidad de muestras contando sus repeticiones
+*/
+unsigned long long SampleSet::GetTotalWeight() const
+{
+	if(weightsData == NULL) return count;
+	unsigned long long total = 0;
+	for(size_t i=0; i<count; i++) total += weightsData[i];
+	return total;
+}
+
+/** Indica si los datos pertenecen a una imagen externa de solo lectura
+*/
+bool SampleSet::IsExternal() const
+{
+	return external;
+}
+
+/** Agrega una muestra al final del conjunto. Si algun simbolo no cabe en el ancho actual
+    el conjunto se ensancha
+*/
+void SampleSet::Add(const TSymbol* begin, const TSymbol* end)
+{
+	if(external)
+	{
+		throw runtime_error("No es posible modificar un conjunto de muestras externo");
+	}
+	if(begin != end) Widen(SymbolWidthFor(*max_element(begin, end)));
+	size_t pos = GetSymbolCount();
+	symbols.resize((pos + (end - begin)) * symbolWidth);
+	_storeSymbols(symbols.data() + pos * symbolWidth, symbolWidth, begin, end - begin);
+	offsets.push_back(pos + (end - begin));
+	if(!weights.empty()) weights.push_back(1);
+	Bind();
+}
+
+void SampleSet::Add(const TSample& sample)
+{
+	Add(sample.data(), sample.data() + sample.size());
+}
+
+void SampleSet::Add(const TSampleView& sample)
+{
+	if(external)
+	{
+		throw runtime_error("No es posible modificar un conjunto de muestras externo");
+	}
+	if(sample.GetSymbolWidth() > symbolWidth)
+	{
+		TSymbol maxSymbol = 0;
+		for(size_t i=0; i<sample.size(); i++) maxSymbol = max(maxSymbol, sample[i]);
+		Widen(SymbolWidthFor(maxSymbol));
+	}
+	size_t pos = GetSymbolCount();
+	symbols.resize((pos + sample.size()) * symbolWidth);
+	_storeSymbols(symbols.data() + pos * symbolWidth, symbolWidth, sample);
+	offsets.push_back(pos + sample.size());
+	if(!weights.empty()) weights.push_back(1);
+	Bind();
+}
+
+/** Agrega al final todas las muestras de otro conjunto, con sus pesos
+*/
+void SampleSet::Append(const SampleSet& other)
+{
+	if(external)
+	{
+		throw runtime_error("No es posible modificar un conjunto de muestras externo");
+	}
+	if(other.weightsData != NULL && weights.empty()) weights.assign(count, 1);
+	Widen(other.symbolWidth);
+	TOffset base = GetSymbolCount();
+	symbols.resize((size_t)(base + other.GetSymbolCount()) * symbolWidth);
+	_storeSymbols(symbols.data() + base * symbolWidth, symbolWidth, TSampleView(other.symbolsData, other.GetSymbolCount(), other.symbolWidth));
+	offsets.reserve(offsets.size() + other.count);
+	for(size_t i=1; i<=other.count; i++) offsets.push_back(base + other.offsetsData[i]);
+	if(!weights.empty())
+	{
+		for(size_t i=0; i<other.count; i++) weights.push_back(other.GetWeight(i));
+	}
+	Bind();
+}
+
+/** Agrega al final las muestras de otro conjunto indicadas por su posicion, con sus pesos
+*/
+void SampleSet::AppendSelected(const SampleSet& other, const vector<size_t>& indices)
+{
+	if(external)
+	{
+		throw runtime_error("No es posible modificar un conjunto de muestras externo");
+	}
+	if(other.weightsData != NULL && weights.empty()) weights.assign(count, 1);
+	Widen(other.symbolWidth);
+	size_t symbolCount = 0;
+	for(auto it=indices.cbegin(); it!=indices.cend(); ++it) symbolCount += other[*it].size();
+	TOffset end = GetSymbolCount();
+	symbols.resize((size_t)(end + symbolCount) * symbolWidth);
+	offsets.reserve(offsets.size() + indices.size());
+	for(auto it=indices.cbegin(); it!=indices.cend(); ++it)
+	{
+		auto sample = other[*it];
+		_storeSymbols(symbols.data() + (size_t)end * symbolWidth, symbolWidth, sample);
+		end += sample.size();
+		offsets.push_back(end);
+		if(!weights.empty()) weights.push_back(other.GetWeight(*it));
+	}
+	Bind();
+}
+
+/** Reserva espacio para la cantidad total de muestras y simbolos indicada
+*/
+void SampleSet::Reserve(size_t samples, size_t symbolCount)
+{
+	if(external)
+	{
+		throw runtime_error("No es posible modificar un conjunto de muestras externo");
+	}
+	offsets.reserve(samples + 1);
+	symbols.reserve(symbolCount * symbolWidth);
+	Bind();
+}
+
+void SampleSet::Clear()
+{
+	if(external)
+	{
+		throw runtime_error("No es posible modificar un conjunto de muestras externo");
+	}
+	symbols.clear();
+	offsets.assign(1, 0);
+	weights.clear();
+	Bind();
+}
+
+/** Compara dos muestras de la misma longitud simbolo a simbolo: negativo si la primera
+    es menor, cero si son iguales y positivo si es mayor
+*/
+template<class TSymbolIn>
+int _compareSymbols(const TSymbolIn* a, const TSymbolIn* b, size_t length)
+{
+	for(size_t i=0; i<length; i++)
+	{
+		if(a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+	}
+	return 0;
+}
+
+int _compareSymbols(const TSampleView& a, const TSampleView& b)
+{
+	assert(a.size() == b.size());
+	if(a.GetSymbolWidth() == b.GetSymbolWidth())
+	{
+		switch(a.GetSymbolWidth())
+		{
+		case 1: return memcmp(a.GetData(), b.GetData(), a.size());
+		case 2: return _compareSymbols((const Nfa::TSymbol16*)a.GetData(), (const Nfa::TSymbol16*)b.GetData(), a.size());
+		default: return _compareSymbols((const TSymbol*)a.GetData(), (const TSymbol*)b.GetData(), a.size());
+		}
+	}
+	for(size_t i=0; i<a.size(); i++)
+	{
+		if(a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+	}
+	return 0;
+}
+
+/** Indica si el conjunto contiene una muestra igual a la suministrada
+*/
+bool SampleSet::Contains(const TSample& sample) const
+{
+	if(!sample.empty() && SymbolWidthFor(*max_element(sample.cbegin(), sample.cend())) > symbolWidth) return false;
+	vector<unsigned char> encoded(sample.size() * symbolWidth);
+	_storeSymbols(encoded.data(), symbolWidth, sample.data(), sample.size());
+	for(size_t i=0; i<count; i++)
+	{
+		auto s = (*this)[i];
+		if(s.size() == sample.size() && memcmp(s.GetData(), encoded.data(), encoded.size()) == 0) return true;
+	}
+	return false;
+}
+
+/** Orden usado por el entrenamiento: por longitud y luego lexicografico
+*/
+bool _viewComparer(const TSampleView& a, const TSampleView& b)
+{
+	if(a.size() != b.size()) return a.size() < b.size();
+	return _compareSymbols(a, b) < 0;
+}
+
+bool SampleSet::IsSorted() const
+{
+	for(size_t i=1; i<count; i++)
+	{
+		if(_viewComparer((*this)[i], (*this)[i-1])) return false;
+	}
+	return true;
+}
+
+/** Ordena las muestras por longitud y luego en forma lexicografica. Se ordenan los rangos
+    de posiciones de las muestras, sin copiarlas, y los simbolos se reubican una sola vez
+	al final para que el recorrido del conjunto ordenado siga siendo secuencial
+*/
+void SampleSet::Sort()
+{
+	if(IsSorted()) return;
+	if(external)
+	{
+		throw runtime_error("No es posible modificar un conjunto de muestras externo");
+	}
+	// rango de cada muestra; el indice original desempata para conservar el orden de las iguales
+	struct TSpan
+	{
+		TOffset Begin;
+		TOffset End;
+		size_t Index;
+	};
+	vector<TSpan> spans(count);
+	for(size_t i=0; i<count; i++)
+	{
+		spans[i].Begin = offsetsData[i];
+		spans[i].End = offsetsData[i+1];
+		spans[i].Index = i;
+	}
+	const unsigned char* data = symbolsData;
+	unsigned width = symbolWidth;
+	sort(spans.begin(), spans.end(), [data, width](const TSpan& a, const TSpan& b) -> bool
+	{
+		auto la = a.End - a.Begin, lb = b.End - b.Begin;
+		if(la != lb) return la < lb;
+		int c = _compareSymbols(TSampleView(data + a.Begin * width, (size_t)la, width), TSampleView(data + b.Begin * width, (size_t)lb, width));
+		if(c != 0) return c < 0;
+		return a.Index < b.Index;
+	});
+
+	vector<unsigned char> sortedSymbols(GetSymbolCount() * width);
+	vector<TWeight> sortedWeights(weights.size());
+	TOffset pos = 0;
+	for(size_t i=0; i<count; i++)
+	{
+		const TSpan& span = spans[i];
+		memcpy(sortedSymbols.data() + pos * width, data + span.Begin * width, (size_t)(span.End - span.Begin) * width);
+		pos += span.End - span.Begin;
+		offsets[i+1] = pos;
+		if(!weights.empty()) sortedWeights[i] = weights[span.Index];
+	}
+	symbols.swap(sortedSymbols);
+	weights.swap(sortedWeights);
+	Bind();
+}
+
+/** Indica si dos vistas contienen la misma muestra
+*/
+bool _sameSample(const TSampleView& a, const TSampleView& b)
+{
+	return a.size() == b.size() && _compareSymbols(a, b) == 0;
+}
+
+/** Indica si el conjunto esta ordenado y no tiene muestras repetidas
+*/
+bool SampleSet::IsUnique() const
+{
+	if(!IsSorted()) return false;
+	for(size_t i=1; i<count; i++)
+	{
+		if(_sameSample((*this)[i], (*this)[i-1])) return false;
+	}
+	return true;
+}
+
+/** Ordena el conjunto y reemplaza las muestras repetidas por una sola cuyo peso es la
+    suma de los pesos de las repeticiones. Retorna la cantidad de muestras eliminadas
+*/
+size_t SampleSet::Deduplicate()
+{
+	if(IsUnique()) return 0;
+	Sort();
+	if(external)
+	{
+		throw runtime_error("No es posible modificar un conjunto de muestras externo");
+	}
+
+	vector<TWeight> uniqueWeights;
+	uniqueWeights.reserve(count);
+	size_t unique = 0;
+	TOffset end = 0;
+	for(size_t i=0; i<count; i++)
+	{
+		if(i > 0 && _sameSample((*this)[i], (*this)[unique-1]))
+		{
+			uniqueWeights.back() += GetWeight(i);
+			continue;
+		}
+		// compacta en el lugar, la muestra destino nunca esta despues de la de origen
+		auto s = (*this)[i];
+		memmove(symbols.data() + (size_t)end * symbolWidth, s.GetData(), s.size() * symbolWidth);
+		end += s.size();
+		offsets[unique+1] = end;
+		uniqueWeights.push_back(GetWeight(i));
+		unique++;
+	}
+	size_t removed = count - unique;
+	symbols.resize((size_t)end * symbolWidth);
+	symbols.shrink_to_fit();
+	offsets.resize(unique + 1);
+	offsets.shrink_to_fit();
+	weights.swap(uniqueWeights);
+	Bind();
+	return removed;
+}
+
+/** Cuenta las muestras presentes en ambos conjuntos, que deben estar ordenados
+*/
+size_t SampleSet::CountCommon(const SampleSet& a, const SampleSet& b)
+{
+	assert(a.IsSorted() && b.IsSorted());
+	size_t common = 0;
+	size_t i = 0, j = 0;
+	while(i < a.size() && j < b.size())
+	{
+		if(_viewComparer(a[i], b[j])) i++;
+		else if(_viewComparer(b[j], a[i])) j++;
+		else
+		{
+			common++;
+			// salta las repeticiones de la muestra comun
+			auto sample = a[i];
+			while(i < a.size() && _sameSample(a[i], sample)) i++;
+			while(j < b.size() && _sameSample(b[j], sample)) j++;
+		}
+	}
+	return common;
+}
+
+/** Tamao en bytes de la imagen plana del conjunto
+*/
+size_t SampleSet::GetImageSize() const
+{
+	size_t weightsSize = weightsData == NULL ? 0 : sizeof(TWeight) * count;
+	return sizeof(TOffset) * (count + 4) + weightsSize + symbolWidth * GetSymbolCount();
+}
+
+/** Escribe la imagen plana del conjunto: cantidad de muestras, indicador de pesos, ancho
+    de los simbolos, posiciones de inicio, pesos (si los hay) y simbolos. image debe tener
+	GetImageSize() bytes alineados a 8
+*/
+void SampleSet::WriteImage(void* image) const
+{
+	TOffset* header = (TOffset*)image;
+	header[0] = count;
+	header[1] = weightsData == NULL ? 0 : 1;
+	header[2] = symbolWidth;
+	memcpy(header + 3, offsetsData, sizeof(TOffset) * (count + 1));
+	char* data = (char*)(header + count + 4);
+	if(weightsData != NULL)
+	{
+		memcpy(data, weightsData, sizeof(TWeight) * count);
+		data += sizeof(TWeight) * count;
+	}
+	memcpy(data, symbolsData, symbolWidth * GetSymbolCount());
+}
+
+/** Crea un conjunto que lee sus muestras directamente de una imagen escrita con
+    WriteImage(). La imagen debe permanecer valida mientras se use el conjunto
+*/
+SampleSet SampleSet::FromImage(const void* image)
+{
+	const TOffset* header = (const TOffset*)image;
+	SampleSet result;
+	result.external = true;
+	result.count = (size_t)header[0];
+	result.symbolWidth = (unsigned)header[2];
+	result.offsetsData = header + 3;
+	const char* data = (const char*)(header + result.count + 4);
+	if(header[1] != 0)
+	{
+		result.weightsData = (const TWeight*)data;
+		data += sizeof(TWeight) * result.count;
+	}
+	result.symbolsData = (const unsigned char*)data;
+	return result;
+}
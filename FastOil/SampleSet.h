@@ -0,0 +1,109 @@
+#pragma once
+
+#include "Nfa.h"
+#include <vector>
+
+/** Conjunto de muestras en almacenamiento plano: los simbolos de todas las muestras en un
+    arreglo contiguo y el inicio de cada muestra en un arreglo de posiciones, la muestra i
+	ocupa [offsets[i], offsets[i+1]). El almacenamiento puede ser propio o una imagen
+	externa de solo lectura, por ejemplo en memoria compartida entre procesos.
+	Cada muestra tiene un peso (multiplicidad) que vale 1 salvo que el conjunto haya
+	sido reducido con Deduplicate().
+	Los simbolos se guardan con el menor ancho (1, 2 o 4 bytes) que admite el simbolo
+	mayor del conjunto o la longitud del alfabeto indicada con SetAlphabetLength()
+*/
+class SampleSet
+{
+public:
+	typedef Nfa::TSymbol TSymbol;
+	typedef Nfa::TSample TSample;
+	typedef unsigned long long TOffset;
+	typedef unsigned TWeight;
+
+	/// Vista de solo lectura de una muestra del conjunto
+	class TSampleView
+	{
+		const unsigned char* first;
+		size_t length;
+		unsigned width;
+
+	public:
+		TSampleView(const unsigned char* data, size_t length, unsigned width) : first(data), length(length), width(width) {}
+		size_t size() const { return length; }
+		unsigned GetSymbolWidth() const { return width; }
+		const unsigned char* GetData() const { return first; }
+		TSymbol operator[](size_t i) const 
+		{ 
+			if(width == 1) return first[i];
+			if(width == 2) return ((const Nfa::TSymbol16*)first)[i];
+			return ((const TSymbol*)first)[i];
+		}
+		TSample ToSample() const 
+		{ 
+			TSample sample(length);
+			for(size_t i=0; i<length; i++) sample[i] = (*this)[i];
+			return sample;
+		}
+		/// Indica si el automata reconoce la muestra, ver Nfa::IsMatch
+		bool IsMatchedBy(const Nfa& nfa) const
+		{
+			if(width == 1) return nfa.IsMatch(first, first + length);
+			if(width == 2) return nfa.IsMatch((const Nfa::TSymbol16*)first, (const Nfa::TSymbol16*)first + length);
+			return nfa.IsMatch((const TSymbol*)first, (const TSymbol*)first + length);
+		}
+	};
+
+private:
+	// simbolos codificados con symbolWidth bytes cada uno
+	std::vector<unsigned char> symbols;
+	std::vector<TOffset> offsets;
+	// vacio si todas las muestras pesan 1
+	std::vector<TWeight> weights;
+
+	// datos efectivos, propios o de una imagen externa
+	const unsigned char* symbolsData;
+	const TOffset* offsetsData;
+	const TWeight* weightsData;
+	size_t count;
+	unsigned symbolWidth;
+	bool external;
+
+	void Bind();
+	void Widen(unsigned width);
+
+public:
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	TSampleView operator[](size_t i) const { return TSampleView(symbolsData + offsetsData[i] * symbolWidth, (size_t)(offsetsData[i+1] - offsetsData[i]), symbolWidth); }
+	size_t GetSymbolCount() const;
+	unsigned GetSymbolWidth() const { return symbolWidth; }
+	void SetAlphabetLength(unsigned alpha);
+	static unsigned SymbolWidthFor(TSymbol maxSymbol);
+	bool IsExternal() const;
+	TWeight GetWeight(size_t i) const { return weightsData == NULL ? 1 : weightsData[i]; }
+	unsigned long long GetTotalWeight() const;
+
+	void Add(const TSymbol* begin, const TSymbol* end);
+	void Add(const TSample& sample);
+	void Add(const TSampleView& sample);
+	void Append(const SampleSet& other);
+	void AppendSelected(const SampleSet& other, const std::vector<size_t>& indices);
+	void Reserve(size_t samples, size_t symbolCount);
+	void Clear();
+	bool Contains(const TSample& sample) const;
+	bool IsSorted() const;
+	void Sort();
+	bool IsUnique() const;
+	size_t Deduplicate();
+	static size_t CountCommon(const SampleSet& a, const SampleSet& b);
+
+	// Imagen plana: cantidad, indicador de pesos, ancho de simbolo, posiciones, pesos y simbolos
+	size_t GetImageSize() const;
+	void WriteImage(void* image) const;
+	static SampleSet FromImage(const void* image);
+
+	SampleSet();
+	SampleSet(const std::vector<TSample>& samples);
+	SampleSet(const SampleSet& c);
+	SampleSet& operator=(const SampleSet& c);
+};
@@ -4,16 +4,19 @@
 
 #include "StdAfx.h"
 #include "SamplesReader.h"
+#include "MappedFile.h"
+#include "WorkerPool.h"
+#include "CompressedInput.h"
+#include <memory>
 
 using namespace std;
-using boost::lexical_cast;
-using boost::trim;
 
 typedef SamplesReader::TSamples TSamples;
 typedef SamplesReader::TSymbol TSymbol;
 typedef SamplesReader::TSample TSample;
 
 SamplesReader::SamplesReader(void)
+	: Threads(0), DuplicatePositives(0), DuplicateNegatives(0), Conflicts(0)
 {
 }
 
@@ -30,74 +33,457 @@ vector<string> _splitBySpaces(const string& line )
 	return splits;
 }
 
+// Las funciones de interpretacion reciben lineas terminadas en '\n', que detiene todos los
+// recorridos sin comparar contra el final del buffer
+
+// separadores de simbolos dentro de una linea
+inline bool _isBlank(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+inline const char* _skipBlanks(const char* p)
+{
+	while(_isBlank(*p)) p++;
+	return p;
+}
+
+/** Lee un entero sin signo de un token que empieza en p y avanza p hasta el final del
+    token. Retorna false si el token no es un numero o no cabe en 32 bits.
+	Si hay 8 bytes legibles antes de limit los digitos se ubican y convierten en un
+	registro de 64 bits sin un salto por cada caracter
+*/
+inline bool _parseUnsigned(const char*& p, const char* limit, unsigned& value)
+{
+	if(limit - p >= 8)
+	{
+		unsigned long long x;
+		memcpy(&x, p, 8);
+		// los digitos quedan en 0..9, el resto de los bytes es mayor
+		x ^= 0x3030303030303030ull;
+		unsigned long long nonDigits = (x | (x + 0x7676767676767676ull)) & 0x8080808080808080ull;
+		unsigned long idx;
+		if(_BitScanForward64(&idx, nonDigits))
+		{
+			unsigned len = idx / 8;
+			if(len == 0) return false;
+			// alinea los digitos arriba: los bytes bajos quedan como ceros a la izquierda
+			x <<= 64 - 8 * len;
+			x = ((x & 0x0F0F0F0F0F0F0F0Full) * 2561) >> 8;
+			x = ((x & 0x00FF00FF00FF00FFull) * 6553601) >> 16;
+			x = ((x & 0x0000FFFF0000FFFFull) * 42949672960001ull) >> 32;
+			p += len;
+			value = (unsigned)x;
+			return *p == '\n' || _isBlank(*p);
+		}
+		// 8 digitos o mas
+	}
+
+	const char* start = p;
+	unsigned long long v = 0;
+	unsigned digit;
+	while((digit = (unsigned)(*p - '0')) < 10)
+	{
+		v = v * 10 + digit;
+		p++;
+	}
+	if(p == start || (*p != '\n' && !_isBlank(*p))) return false;
+	// hasta 10 digitos no desborda el acumulador, los ceros a la izquierda no cuentan
+	if(p - start > 10)
+	{
+		while(*start == '0') start++;
+		if(p - start > 10) return false;
+	}
+	if(v > 0xFFFFFFFFull) return false;
+	value = (unsigned)v;
+	return true;
+}
+
+/** Lee un entero con signo opcional, como la etiqueta de una muestra
+*/
+inline bool _parseInt(const char*& p, const char* limit, long long& value)
+{
+	bool negative = *p == '-';
+	if(*p == '-' || *p == '+') p++;
+	unsigned magnitude;
+	if(!_parseUnsigned(p, limit, magnitude)) return false;
+	value = negative ? -(long long)magnitude : magnitude;
+	return true;
+}
+
+/** Error de formato en una linea del archivo de muestras. Conserva el motivo y la linea para
+    ubicar el error en el archivo cuando un tramo se interpreta por separado
+*/
+class _SamplesFormatError : public runtime_error
+{
+public:
+	string Reason;
+	size_t Line;
+
+	_SamplesFormatError(const string& reason, size_t line)
+		: runtime_error("Formato de archivo de secuencias invalido, " + reason + " (linea " + boost::lexical_cast<string>(line) + ")"), Reason(reason), Line(line)
+	{
+	}
+};
+
+#ifdef _MSC_VER
+#define FASTOIL_NORETURN __declspec(noreturn)
+#else
+#define FASTOIL_NORETURN __attribute__((noreturn))
+#endif
+
+// no retorna, asi el compilador sabe que los valores leidos estan inicializados
+FASTOIL_NORETURN void _throwFormatError(const char* reason, size_t line)
+{
+	throw _SamplesFormatError(reason, line);
+}
+
 /// <summary>
 /// Lee dos conjuntos de muestras a partir de un archivo de texto
 /// </summary>
 void SamplesReader::ReadSamples( string filename, TSamples& pos, TSamples& neg, unsigned* alphabetLength )
 {
-	assert(alphabetLength != NULL);
+	ParseSamples(filename, alphabetLength, [&](bool isPositive, const TSample& sample)
+	{
+		if(isPositive) pos.push_back(sample);
+		else neg.push_back(sample);
+	});
+}
+
+/// <summary>
+/// Lee dos conjuntos de muestras en almacenamiento plano, en el orden del archivo.
+/// Los archivos de texto grandes se dividen en tramos de lineas completas que se interpretan en
+/// paralelo; los tramos se concatenan en orden, el resultado no depende de los hilos
+/// </summary>
+void SamplesReader::ReadSamples( string filename, SampleSet& pos, SampleSet& neg, unsigned* alphabetLength )
+{
+	pos.Clear();
+	neg.Clear();
+	auto addTo = [](SampleSet& p, SampleSet& n) -> function<void(bool, const TSample&)>
+	{
+		return [&p, &n](bool isPositive, const TSample& sample)
+		{
+			if(isPositive) p.Add(sample);
+			else n.Add(sample);
+		};
+	};
 
-	ifstream file(filename);
-	if(!file.is_open()) 
+	// un archivo comprimido se interpreta en orden mientras su hilo lo descomprime
+	if(CompressedInput::DetectFormat(filename) != CompressedInput::Plain)
+	{
+		ParseSamples(filename, alphabetLength, addTo(pos, neg));
+		return;
+	}
+
+	MappedFile file;
+	if(!file.Open(filename)) 
 	{
 		throw runtime_error("El archivo de muestras no pudo ser abierto");
 	}
+	const char* data = file.GetData();
+	const char* end = data + file.GetSize();
+
+	// la cabecera se interpreta antes de dividir el resto del archivo
+	const char* eol = data == end ? NULL : (const char*)memchr(data, '\n', end - data);
+	const char* body = eol == NULL ? end : eol + 1;
+	bool header = true;
+	size_t headerLines = 0;
+	ParseLines(data, body - data, &header, &headerLines, alphabetLength, addTo(pos, neg));
+	// los simbolos se guardan con el menor ancho que admite el alfabeto
+	pos.SetAlphabetLength(*alphabetLength);
+	neg.SetAlphabetLength(*alphabetLength);
+
+	// limites de los tramos, cada uno termina despues de un '\n'
+	unsigned threads = Threads != 0 ? Threads : max(1u, thread::hardware_concurrency());
+	size_t ranges = max((size_t)1, min((size_t)threads, (size_t)(end - body) / ParallelMinBytes));
+	vector<const char*> bounds(1, body);
+	for(size_t k=1; k<ranges; k++)
+	{
+		const char* target = max(body + (end - body) / ranges * k, bounds.back());
+		const char* nl = (const char*)memchr(target, '\n', end - target);
+		if(nl == NULL || nl + 1 == end) break;
+		bounds.push_back(nl + 1);
+	}
+	bounds.push_back(end);
+	ranges = bounds.size() - 1;
 
-	string line;
-	enum { header, sample } state;
-	state = header;	
-	
-	while (!file.eof())
+	if(ranges == 1)
 	{
-		// Leemos la informacion de cabecera
-		getline(file, line);
-		trim(line);
-		if(state == header)
+		size_t lines = headerLines;
+		ParseLines(body, end - body, &header, &lines, alphabetLength, addTo(pos, neg));
+		return;
+	}
+
+	// conjuntos de cada tramo, se liberan a medida que se concatenan
+	vector<unique_ptr<SampleSet>> rangePos(ranges), rangeNeg(ranges);
+	for(size_t k=0; k<ranges; k++)
+	{
+		rangePos[k].reset(new SampleSet());
+		rangeNeg[k].reset(new SampleSet());
+		rangePos[k]->SetAlphabetLength(*alphabetLength);
+		rangeNeg[k]->SetAlphabetLength(*alphabetLength);
+	}
+	vector<size_t> rangeLines(ranges, 0);
+	vector<exception_ptr> errors(ranges);
+	WorkerPool pool;
+	pool.Start((unsigned)ranges);
+	pool.Run([&](unsigned k)
+	{
+		try
 		{
-			auto splits = _splitBySpaces(line);
-			if(splits.size() != 2)
-			{
-				throw runtime_error("Formato de archivo de secuencias invalido, cabecera mal formada");
-			}			
-			// int cnt = lexical_cast<int>(splits[0]); // non-used
-			*alphabetLength = lexical_cast<int>(splits[1]);
-			state = sample;
+			bool noHeader = false;
+			ParseLines(bounds[k], bounds[k+1] - bounds[k], &noHeader, &rangeLines[k], alphabetLength, addTo(*rangePos[k], *rangeNeg[k]));
 		}
-		else if(state == sample)
+		catch(...)
 		{
-			// ignora lineas vacias
-			if(line.empty()) continue;
+			errors[k] = current_exception();
+		}
+	});
+	pool.Stop();
 
-			// lee los tokens
-			auto splits = _splitBySpaces(line);
-			if(splits.size() < 2)
+	// informa el primer error del archivo con su linea absoluta
+	size_t lineBase = headerLines;
+	for(size_t k=0; k<ranges; k++)
+	{
+		if(errors[k])
+		{
+			try
 			{
-				throw runtime_error("Formato de archivo de secuencias invalido, linea incompleta");
+				rethrow_exception(errors[k]);
 			}
-			// determina si es muestra positiva
-			bool isPositive = lexical_cast<int>(splits[0]) == 1;
-			unsigned sampleLenght = lexical_cast<unsigned>(splits[1]);
-			if(splits.size() != sampleLenght + 2)
+			catch(const _SamplesFormatError& e)
 			{
-				throw runtime_error("Formato de archivo de secuencias invalido, dimensiones invalidas");
+				throw _SamplesFormatError(e.Reason, lineBase + e.Line);
 			}
+		}
+		lineBase += rangeLines[k];
+	}
+
+	size_t posCount = 0, posSymbols = 0, negCount = 0, negSymbols = 0;
+	for(size_t k=0; k<ranges; k++)
+	{
+		posCount += rangePos[k]->size();
+		posSymbols += rangePos[k]->GetSymbolCount();
+		negCount += rangeNeg[k]->size();
+		negSymbols += rangeNeg[k]->GetSymbolCount();
+	}
+	pos.Reserve(posCount, posSymbols);
+	neg.Reserve(negCount, negSymbols);
+	for(size_t k=0; k<ranges; k++)
+	{
+		pos.Append(*rangePos[k]);
+		neg.Append(*rangeNeg[k]);
+		rangePos[k].reset();
+		rangeNeg[k].reset();
+	}
+}
 
-			// Lee la nueva muestra, convierte cada simbolo
-			TSample newSample;
-			newSample.reserve(sampleLenght);
-			for (auto it = splits.cbegin()+2; it!=splits.cend(); ++it)
+/** Lee las muestras sin repeticiones: cada muestra distinta queda una vez con su multiplicidad
+    como peso. Informa las repetidas y las que aparecen con ambas etiquetas
+*/
+void SamplesReader::ReadUniqueSamples( string filename, SampleSet& pos, SampleSet& neg, unsigned* alphabetLength )
+{
+	ReadSamples(filename, pos, neg, alphabetLength);
+	DuplicatePositives = pos.Deduplicate();
+	DuplicateNegatives = neg.Deduplicate();
+	Conflicts = SampleSet::CountCommon(pos, neg);
+}
+
+/// <summary>
+/// Lee el archivo, de texto o comprimido, por bloques de tamano fijo y entrega las muestras en grupos de a lo sumo
+/// chunkSamples, sin cargar el archivo completo. Dentro de cada grupo las muestras
+/// positivas y las negativas conservan el orden del archivo. Los conjuntos entregados se
+/// reutilizan para el grupo siguiente
+/// </summary>
+void SamplesReader::ReadChunks( string filename, unsigned* alphabetLength, size_t chunkSamples, const function<void(const SampleSet& pos, const SampleSet& neg)>& chunk )
+{
+	assert(chunkSamples > 0);
+	CompressedInput input;
+	if(!input.Open(filename)) 
+	{
+		throw runtime_error("El archivo de muestras no pudo ser abierto");
+	}
+
+	SampleSet pos, neg;
+	ParseStream(input, alphabetLength, [&](bool isPositive, const TSample& sample)
+	{
+		if(isPositive) pos.Add(sample);
+		else neg.Add(sample);
+		if(pos.size() + neg.size() >= chunkSamples)
+		{
+			chunk(pos, neg);
+			pos.Clear();
+			neg.Clear();
+		}
+	});
+	if(!pos.empty() || !neg.empty()) chunk(pos, neg);
+}
+
+/// <summary>
+/// Interpreta el archivo por bloques a medida que se descomprime. Solo se interpretan
+/// lineas completas, el resto pasa al bloque siguiente
+/// </summary>
+void SamplesReader::ParseStream( CompressedInput& input, unsigned* alphabetLength, const function<void(bool positive, const TSample& sample)>& add )
+{
+	vector<char> buffer(StreamBlockSize);
+	size_t used = 0;
+	bool header = true;
+	size_t lines = 0;
+	bool eof = false;
+	while(!eof)
+	{
+		// una linea mas larga que el bloque agranda el buffer
+		if(used == buffer.size()) buffer.resize(buffer.size() * 2);
+		size_t readed = input.Read(&buffer[used], buffer.size() - used);
+		used += readed;
+		eof = readed == 0;
+
+		// al final del archivo se interpreta todo lo que queda
+		size_t complete = used;
+		if(!eof)
+		{
+			while(complete > 0 && buffer[complete - 1] != '\n') complete--;
+			if(complete == 0) continue;
+		}
+		ParseLines(buffer.data(), complete, &header, &lines, alphabetLength, add);
+		memmove(buffer.data(), buffer.data() + complete, used - complete);
+		used -= complete;
+	}
+}
+
+void SamplesReader::ParseSamples( string filename, unsigned* alphabetLength, const function<void(bool positive, const TSample& sample)>& add )
+{
+	if(CompressedInput::DetectFormat(filename) != CompressedInput::Plain)
+	{
+		CompressedInput input;
+		if(!input.Open(filename)) 
+		{
+			throw runtime_error("El archivo de muestras no pudo ser abierto");
+		}
+		ParseStream(input, alphabetLength, add);
+		return;
+	}
+	MappedFile file;
+	if(!file.Open(filename)) 
+	{
+		throw runtime_error("El archivo de muestras no pudo ser abierto");
+	}
+	ParseBuffer(file.GetData(), file.GetSize(), alphabetLength, add);
+}
+
+/// <summary>
+/// Interpreta muestras en formato de texto desde memoria. La primera linea es la cabecera
+/// con la cantidad de muestras y la longitud del alfabeto, cada linea siguiente tiene la
+/// etiqueta (1: positiva), la longitud y los simbolos separados por espacios
+/// </summary>
+void SamplesReader::ParseBuffer( const char* data, size_t size, unsigned* alphabetLength, const function<void(bool positive, const TSample& sample)>& add )
+{
+	bool header = true;
+	size_t lines = 0;
+	ParseLines(data, size, &header, &lines, alphabetLength, add);
+}
+
+/// <summary>
+/// Interpreta un tramo de lineas del archivo. Si header es true la primera linea es la
+/// cabecera y al leerla header pasa a false; la ultima linea puede no terminar en '\n'.
+/// lineNumber cuenta las lineas leidas y numera las lineas de los errores
+/// </summary>
+void SamplesReader::ParseLines( const char* data, size_t size, bool* headerPending, size_t* lineNumber, unsigned* alphabetLength, const function<void(bool positive, const TSample& sample)>& add )
+{
+	assert(alphabetLength != NULL);
+	assert(headerPending != NULL);
+	assert(lineNumber != NULL);
+
+	const char* end = data + size;
+	const char* line = data;
+	bool& header = *headerPending;
+	size_t& lines = *lineNumber;
+	// buffer reutilizado entre muestras, no asigna memoria en estado estable
+	TSample newSample;
+	// copia de la ultima linea cuando el archivo no termina en '\n'
+	string lastLine;
+	// fin de la memoria legible de la linea actual
+	const char* limit = end;
+
+	while(line < end || header)
+	{
+		const char* eol = line < end ? (const char*)memchr(line, '\n', end - line) : NULL;
+		const char* p = line;
+		if(eol == NULL)
+		{
+			lastLine.assign(line, end);
+			lastLine += '\n';
+			p = lastLine.data();
+			eol = p + lastLine.size() - 1;
+			limit = eol + 1;
+			line = end;
+		}
+		else
+		{
+			line = eol + 1;
+		}
+		lines++;
+		p = _skipBlanks(p);
+
+		if(header)
+		{
+			// Leemos la informacion de cabecera, la cantidad de muestras no se usa
+			const char* countEnd = p;
+			while(countEnd < eol && !_isBlank(*countEnd)) countEnd++;
+			const char* q = _skipBlanks(countEnd);
+			unsigned alpha;
+			if(countEnd == p || !_parseUnsigned(q, limit, alpha) || _skipBlanks(q) != eol)
 			{
-				auto val = lexical_cast<TSymbol>(*it);
-				if(val >= *alphabetLength)
-				{
-					throw runtime_error("Formato de archivo de secuencias invalido, longitud de alfabeto incorrecta");
-				}
-				newSample.push_back(val);
+				_throwFormatError("cabecera mal formada", lines);
 			}
+			*alphabetLength = alpha;
+			header = false;
+			continue;
+		}
+
+		// ignora lineas vacias
+		if(p == eol) continue;
+
+		// etiqueta y longitud
+		long long label;
+		if(!_parseInt(p, limit, label)) _throwFormatError("numero mal formado", lines);
+		p = _skipBlanks(p);
+		if(p == eol)
+		{
+			_throwFormatError("linea incompleta", lines);
+		}
+		unsigned sampleLenght;
+		if(!_parseUnsigned(p, limit, sampleLenght)) _throwFormatError("numero mal formado", lines);
+		// determina si es muestra positiva
+		bool isPositive = label == 1;
 
-			// etiqueta la muestra
-			if(isPositive) pos.push_back(newSample);
-			else neg.push_back(newSample);
+		// Lee la nueva muestra, convierte cada simbolo.
+		// Cada simbolo ocupa al menos dos caracteres con su separador
+		p = _skipBlanks(p);
+		if(sampleLenght > (size_t)(eol - p + 1) / 2)
+		{
+			_throwFormatError("dimensiones invalidas", lines);
+		}
+		newSample.resize(sampleLenght);
+		unsigned maxSymbol = 0;
+		size_t n = 0;
+		for(; n<sampleLenght && p!=eol; n++)
+		{
+			if(!_parseUnsigned(p, limit, newSample[n])) _throwFormatError("numero mal formado", lines);
+			maxSymbol = max(maxSymbol, newSample[n]);
+			p = _skipBlanks(p);
+		}
+		// faltan o sobran simbolos
+		if(n != sampleLenght || p != eol)
+		{
+			_throwFormatError("dimensiones invalidas", lines);
+		}
+		if(sampleLenght > 0 && maxSymbol >= *alphabetLength)
+		{
+			_throwFormatError("longitud de alfabeto incorrecta", lines);
 		}
+
+		// etiqueta la muestra
+		add(isPositive, newSample);
 	}
 }
@@ -1,7 +1,11 @@
 #pragma once
 
+#include "SampleSet.h"
 #include <vector>
 #include <string>
+#include <functional>
+
+class CompressedInput;
 
 class SamplesReader
 {
@@ -10,7 +14,32 @@ public:
 	typedef std::vector<TSymbol> TSample;
 	typedef std::vector<TSample> TSamples;
 
+private:
+	void ParseSamples(std::string filename, unsigned* alphabetLength, const std::function<void(bool positive, const TSample& sample)>& add);
+	void ParseLines(const char* data, size_t size, bool* headerPending, size_t* lineNumber, unsigned* alphabetLength, const std::function<void(bool positive, const TSample& sample)>& add);
+	void ParseStream(CompressedInput& input, unsigned* alphabetLength, const std::function<void(bool positive, const TSample& sample)>& add);
+	void ParseBuffer(const char* data, size_t size, unsigned* alphabetLength, const std::function<void(bool positive, const TSample& sample)>& add);
+
+public:
+	/// Tamano de los bloques en que ReadChunks lee el archivo
+	static const size_t StreamBlockSize = 1 << 20;
+	/// Tamano minimo de cada tramo que ReadSamples interpreta en un hilo
+	static const size_t ParallelMinBytes = 4 << 20;
+
+	/// Hilos que interpretan los tramos del archivo (0: tantos como nucleos)
+	unsigned Threads;
+
+	/// Muestras positivas repetidas en la ultima lectura sin repeticiones
+	size_t DuplicatePositives;
+	/// Muestras negativas repetidas en la ultima lectura sin repeticiones
+	size_t DuplicateNegatives;
+	/// Muestras distintas etiquetadas como positivas y negativas en la ultima lectura sin repeticiones
+	size_t Conflicts;
+
 	void ReadSamples(std::string filename, TSamples& pos, TSamples& neg, unsigned* alphabetLength);
+	void ReadSamples(std::string filename, SampleSet& pos, SampleSet& neg, unsigned* alphabetLength);
+	void ReadUniqueSamples(std::string filename, SampleSet& pos, SampleSet& neg, unsigned* alphabetLength);
+	void ReadChunks(std::string filename, unsigned* alphabetLength, size_t chunkSamples, const std::function<void(const SampleSet& pos, const SampleSet& neg)>& chunk);
 
 	SamplesReader(void);
 	~SamplesReader(void);
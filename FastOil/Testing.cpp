@@ -2,7 +2,19 @@
 #include "Nfa.h"
 #include "NfaDotExporter.h"
 #include "OilTrainer.h"
+#include "NegativePrefilter.h"
 #include "SamplesReader.h"
+#include "SampleSet.h"
+#include "SampleGenerator.h"
+#include "CompressedInput.h"
+#include "ClassificationServer.h"
+#include "MajorityVote.h"
+#include "ReportWriter.h"
+#include "CompressedOutput.h"
+#include "CrossValidator.h"
+#include "FastOilApi.h"
+#include "VoteHistogram.h"
+#include "WorkerPool.h"
 #include "Testing.h"
 
 using namespace std;
@@ -117,6 +129,837 @@ namespace Testing {
 		delete nfa;
 	}
 
+	bool _sameNfa(const Nfa& a, const Nfa& b)
+	{
+		if(a.GetMaxStates() != b.GetMaxStates()) return false;
+		if(a.GetAlphabetLenght() != b.GetAlphabetLenght()) return false;
+		for(unsigned i=0; i<a.GetMaxStates(); i++)
+		{
+			if(a.IsActiveState(i) != b.IsActiveState(i)) return false;
+			if(!a.IsActiveState(i)) continue;
+			if(a.IsInitial(i) != b.IsInitial(i) || a.IsFinal(i) != b.IsFinal(i)) return false;
+			for(unsigned k=0; k<a.GetMaxStates(); k++)
+			{
+				if(!a.IsActiveState(k)) continue;
+				for(Nfa::TSymbol sym=0; sym<a.GetAlphabetLenght(); sym++)
+				{
+					if(a.ExistTransition(i, k, sym) != b.ExistTransition(i, k, sym)) return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	// Muestras de 4 simbolos que comparten las pruebas del entrenador
+	void makeTrainerSamples(OilTrainer::TSamples& vpos, OilTrainer::TSamples& vneg)
+	{
+		OilTrainer::TSymbol pos[] = {
+			0, 1, 2, 3,
+			0, 0, 0, 1,
+			0, 0, 0, 2,
+			0, 0, 1, 2,
+			0, 0, 1, 3,
+		};
+		OilTrainer::TSymbol neg[] = {
+			1, 2, 3, 3,
+			1, 3, 2, 2,
+			2, 0, 1, 1,
+			2, 0, 0, 0,
+			3, 0, 2, 0,
+		};
+		vpos = makeSamples(pos, 4, 20);
+		vneg = makeSamples(neg, 4, 20);
+	}
+
+	// Muestras de un automata objetivo aleatorio de 16 estados sobre 4 simbolos. Con unos
+	// cientos de muestras el modelo llega a decenas de estados y cada muestra agrega varios
+	void makeGeneratedSamples(unsigned count, OilTrainer::TSamples& vpos, OilTrainer::TSamples& vneg)
+	{
+		SampleGenerator generator(8);
+		auto target = generator.CreateTarget();
+		generator.Generate(*target, count / 2, count - count / 2, vpos, vneg);
+		delete target;
+	}
+
+	// El prefiltro de muestras negativas no debe cambiar el modelo obtenido
+	void Test8()
+	{
+		OilTrainer::TSamples vpos, vneg;
+		makeGeneratedSamples(600, vpos, vneg);
+
+		OilTrainer trainer1, trainer2;
+		trainer1.DoNotUseRandomSort = true;
+		trainer2.DoNotUseRandomSort = true;
+		trainer2.UseNegativePrefilter = false;
+		auto nfa1 = trainer1.Train(vpos, vneg, 4);
+		auto nfa2 = trainer2.Train(vpos, vneg, 4);
+		assert(_sameNfa(*nfa1, *nfa2));
+
+		// sin memoria suficiente el prefiltro se desactiva sin cambiar el modelo
+		OilTrainer trainer3;
+		trainer3.DoNotUseRandomSort = true;
+		trainer3.PrefilterMemoryLimit = 1;
+		auto nfa3 = trainer3.Train(vpos, vneg, 4);
+		assert(_sameNfa(*nfa1, *nfa3));
+		delete nfa1;
+		delete nfa2;
+		delete nfa3;
+
+		// tambien con los estados nuevos en orden aleatorio
+		OilTrainer trainer4, trainer5;
+		trainer4.Seed = 8;
+		trainer5.Seed = 8;
+		trainer5.UseNegativePrefilter = false;
+		auto nfa4 = trainer4.Train(vpos, vneg, 4);
+		auto nfa5 = trainer5.Train(vpos, vneg, 4);
+		assert(_sameNfa(*nfa4, *nfa5));
+		delete nfa4;
+		delete nfa5;
+	}
+
+	// La sesion incremental debe mantener un modelo consistente con todas sus muestras
+	void Test9()
+	{
+		OilTrainer::TSamples vpos, vneg;
+		makeTrainerSamples(vpos, vneg);
+
+		OilTrainer trainer;
+		trainer.BeginSession(4);
+		trainer.AddNegatives(OilTrainer::TSamples(vneg.begin(), vneg.begin()+2));
+		for_each(vpos.begin(), vpos.end(), [&trainer](const OilTrainer::TSample& s){ trainer.AddPositive(s); });
+		// las negativas restantes pueden obligar a reentrenar
+		trainer.AddNegatives(OilTrainer::TSamples(vneg.begin()+2, vneg.end()));
+		trainer.SaveSession("test9.session");
+
+		OilTrainer restored;
+		restored.LoadSession("test9.session");
+		for_each(vpos.begin(), vpos.end(), [&restored](const OilTrainer::TSample& s){ assert(restored.GetModel().IsMatch(s)); });
+		for_each(vneg.begin(), vneg.end(), [&restored](const OilTrainer::TSample& s){ assert(!restored.GetModel().IsMatch(s)); });
+		assert(_sameNfa(trainer.GetModel(), restored.GetModel()));
+	}
+
+	// La evaluacion paralela y especulativa debe obtener el mismo modelo que la secuencial
+	void Test10()
+	{
+		// varios estados nuevos por muestra, de modo que cada ronda especulativa abarca varios
+		OilTrainer::TSamples vpos, vneg;
+		makeGeneratedSamples(600, vpos, vneg);
+
+		OilTrainer trainer1, trainer2;
+		trainer2.Threads = 3;
+		trainer2.SpeculativeStates = 4;
+		srand(10);
+		auto nfa1 = trainer1.Train(vpos, vneg, 4);
+		srand(10);
+		auto nfa2 = trainer2.Train(vpos, vneg, 4);
+		assert(_sameNfa(*nfa1, *nfa2));
+		delete nfa1;
+		delete nfa2;
+	}
+
+	void Test11()
+	{
+		OilTrainer::TSamples vpos, vneg;
+		makeTrainerSamples(vpos, vneg);
+
+		// el presupuesto se agota de inmediato pero el modelo debe ser consistente
+		OilTrainer trainer;
+		trainer.TimeBudgetSeconds = 1e-9;
+		auto nfa = trainer.Train(vpos, vneg, 4);
+		assert(!trainer.Concessions.empty());
+		for(auto it=vpos.cbegin(); it!=vpos.cend(); ++it) assert(nfa->IsMatch(*it));
+		for(auto it=vneg.cbegin(); it!=vneg.cend(); ++it) assert(!nfa->IsMatch(*it));
+		delete nfa;
+	}
+
+	void Test12()
+	{
+		OilTrainer::TSymbol pos[] = {
+			0, 0, 1, 2,
+			0, 1, 2, 3,
+			0, 0, 1, 2,
+			0, 0, 0, 1,
+			0, 0, 1, 2,
+			0, 1, 2, 3,
+		};
+		OilTrainer::TSymbol neg[] = {
+			1, 2, 3, 3,
+			0, 1, 2, 3,
+			1, 2, 3, 3,
+		};
+		SampleSet spos(makeSamples(pos, 4, 24));
+		SampleSet sneg(makeSamples(neg, 4, 12));
+
+		// las repeticiones se reducen a una muestra con peso
+		assert(spos.Deduplicate() == 3);
+		assert(spos.size() == 3 && spos.GetTotalWeight() == 6);
+		assert(spos.GetWeight(0) == 1 && spos.GetWeight(1) == 3 && spos.GetWeight(2) == 2);
+		assert(sneg.Deduplicate() == 1);
+		assert(SampleSet::CountCommon(spos, sneg) == 1);
+
+		// los pesos se conservan en la imagen plana
+		vector<unsigned long long> image((spos.GetImageSize() + 7) / 8);
+		spos.WriteImage(&image[0]);
+		auto view = SampleSet::FromImage(&image[0]);
+		assert(view.size() == 3 && view.GetWeight(1) == 3 && view.IsUnique());
+
+		// los simbolos usan el menor ancho posible y se ensanchan al agregar uno mayor
+		assert(spos.GetSymbolWidth() == 1);
+		OilTrainer::TSymbol wide[] = { 3, 300, 70000 };
+		spos.Add(OilTrainer::TSample(wide, wide + 2));
+		assert(spos.GetSymbolWidth() == 2 && spos[3][1] == 300 && spos[1].ToSample() == makeSamples(pos, 4, 4)[0]);
+		spos.Add(OilTrainer::TSample(wide, wide + 3));
+		assert(spos.GetSymbolWidth() == 4 && spos[4][2] == 70000 && spos[3][1] == 300);
+	}
+
+	void Test13()
+	{
+		{
+			ofstream file("test13.sample");
+			file << "7 3" << endl;
+			file << "1 2 0 1\n0 1 2\n1 0\n1 3 2 2 1\n0 2 1 1\n0 1 0\n1 1 2";
+		}
+		SamplesReader reader;
+		SampleSet pos, neg;
+		unsigned alpha;
+		reader.ReadSamples("test13.sample", pos, neg, &alpha);
+
+		// la lectura por grupos entrega las mismas muestras en el mismo orden
+		SampleSet cpos, cneg;
+		unsigned calpha, chunks = 0;
+		reader.ReadChunks("test13.sample", &calpha, 3, [&](const SampleSet& p, const SampleSet& n)
+		{
+			assert(p.size() + n.size() <= 3);
+			for(size_t i=0; i<p.size(); i++) cpos.Add(p[i]);
+			for(size_t i=0; i<n.size(); i++) cneg.Add(n[i]);
+			chunks++;
+		});
+		assert(calpha == alpha && chunks == 3);
+		assert(cpos.size() == 4 && cneg.size() == 3);
+		for(size_t i=0; i<pos.size(); i++) assert(pos[i].ToSample() == cpos[i].ToSample());
+		for(size_t i=0; i<neg.size(); i++) assert(neg[i].ToSample() == cneg[i].ToSample());
+
+		// los errores indican la linea del archivo
+		{
+			ofstream file("test13.sample");
+			file << "2 3\n1 2 0 1\n0 2 1 x\n";
+		}
+		bool failed = false;
+		try
+		{
+			reader.ReadSamples("test13.sample", pos, neg, &alpha);
+		}
+		catch(const runtime_error& e)
+		{
+			failed = string(e.what()).find("(linea 3)") != string::npos;
+		}
+		assert(failed);
+	}
+
+	void Test14()
+	{
+#ifdef _USE_ZLIB
+		// muestras comprimidas con gzip, el contenido supera varios bloques
+		{
+			ofstream plain("test14.sample");
+			CompressedOutput packed("test14.sample.gz");
+			plain << "200000 4" << endl;
+			packed << "200000 4" << endl;
+			for(unsigned i=0; i<200000; i++)
+			{
+				ostringstream line;
+				line << (i % 3 == 0 ? 1 : 0) << " " << (i % 7);
+				for(unsigned k=0; k<i % 7; k++) line << " " << (i + k) % 4;
+				plain << line.str() << endl;
+				packed << line.str() << endl;
+			}
+		}
+		assert(CompressedInput::DetectFormat("test14.sample.gz") == CompressedInput::Gzip);
+		SamplesReader reader;
+		SampleSet pos, neg, zpos, zneg;
+		unsigned alpha, zalpha;
+		reader.ReadSamples("test14.sample", pos, neg, &alpha);
+		reader.ReadSamples("test14.sample.gz", zpos, zneg, &zalpha);
+		assert(alpha == zalpha && pos.size() == zpos.size() && neg.size() == zneg.size());
+		for(size_t i=0; i<pos.size(); i++) assert(pos[i].ToSample() == zpos[i].ToSample());
+		for(size_t i=0; i<neg.size(); i++) assert(neg[i].ToSample() == zneg[i].ToSample());
+
+		// modelo escrito y leido comprimido
+		Nfa nfa(3);
+		nfa.SetInitial(0);
+		nfa.SetFinal(1);
+		nfa.SetTransition(0, 1, 2);
+		nfa.SetTransition(1, 1, 0);
+		NfaDotExporter::ExportDestinoPlainText(nfa, "test14.auto.gz");
+		assert(CompressedInput::DetectFormat("test14.auto.gz") == CompressedInput::Gzip);
+		auto imported = NfaDotExporter::ImportDestinoPlainText("test14.auto.gz");
+		assert(imported.IsInitial(0) && imported.IsFinal(1));
+		assert(imported.ExistTransition(0, 1, 2) && imported.ExistTransition(1, 1, 0));
+		assert(!imported.ExistTransition(0, 1, 0));
+#endif
+	}
+
+	void Test15()
+	{
+		// a* b sobre el alfabeto {a, b, c}
+		Nfa nfa(3);
+		nfa.SetInitial(0);
+		nfa.SetFinal(1);
+		nfa.SetTransition(0, 0, 0);
+		nfa.SetTransition(0, 1, 1);
+		vector<Nfa> models(3, nfa);
+		models[2] = Nfa(3);
+
+		// los lotes de a lo sumo 2 muestras conservan el orden de las respuestas
+		ClassificationServer server(models);
+		server.Threads = 2;
+		server.MaxBatchSamples = 2;
+		server.ReportVotes = true;
+		istringstream input("1 1\n3 0 0 1\n\n2 1 0\nx\n1 3\n2 0\n1 1");
+		ostringstream output;
+		server.ServeStream(input, output);
+		assert(output.str() == "1 2\n1 2\n0 0\nerror: longitud mal formada\nerror: simbolo fuera del alfabeto\nerror: simbolo mal formado o faltante\n1 2\n");
+	}
+
+	void Test16()
+	{
+		// dos modelos reconocen a* b y tres no reconocen nada
+		Nfa nfa(2);
+		nfa.SetInitial(0);
+		nfa.SetFinal(1);
+		nfa.SetTransition(0, 0, 0);
+		nfa.SetTransition(0, 1, 1);
+		vector<Nfa> models(5, Nfa(2));
+		models[1] = nfa;
+		models[3] = nfa;
+
+		SampleSet samples;
+		unsigned s1[] = {0, 0, 1}, s2[] = {1, 0};
+		samples.Add(s1, s1 + 3);
+		samples.Add(s2, s2 + 2);
+		MajorityVote early(models), full(models);
+		MajorityVote::TTally earlyTally, fullTally;
+		full.AllVotes = true;
+		for(size_t i=0; i<samples.size(); i++)
+		{
+			for(int label=0; label<2; label++)
+			{
+				size_t votes = 0;
+				auto expected = full.IsCorrect(samples[i], label == 1, [&](size_t, bool){ votes++; }, fullTally);
+				assert(votes == models.size());
+				assert(early.IsCorrect(samples[i], label == 1, [](size_t, bool){}, earlyTally) == expected);
+			}
+		}
+		// a* b es reconocida por 2 de 5 modelos: clasificada como negativa
+		assert(!full.IsCorrect(samples[0], true, [](size_t, bool){}, fullTally));
+		early.Update(earlyTally);
+		assert(early.Queries < early.FullQueries);
+	}
+
+	void Test17()
+	{
+		// la parte diferida se copia en su orden donde se pide
+		{
+			ReportWriter report;
+			assert(report.Open("test17.txt"));
+			string buffer = "a\n";
+			report.Write(buffer);
+			assert(buffer.empty());
+			for(unsigned i=0; i<3 * ReportWriter::MaxQueuedBuffers; i++)
+			{
+				buffer = "n";
+				ReportWriter::AppendNumber(buffer, i * 1000000007ull);
+				buffer += '\n';
+				report.WriteDeferred(buffer);
+			}
+			buffer = "b\n";
+			report.Write(buffer);
+			report.AppendDeferred();
+			buffer = "c\n";
+			report.Write(buffer);
+			report.Close();
+		}
+		ifstream file("test17.txt");
+		string line;
+		getline(file, line);
+		assert(line == "a");
+		getline(file, line);
+		assert(line == "b");
+		for(unsigned i=0; i<3 * ReportWriter::MaxQueuedBuffers; i++)
+		{
+			getline(file, line);
+			assert(line == "n" + boost::lexical_cast<string>(i * 1000000007ull));
+		}
+		getline(file, line);
+		assert(line == "c");
+		assert(!getline(file, line));
+	}
+
+	void Test18()
+	{
+		// cadenas binarias de hasta 5 simbolos, positivas si tienen una cantidad par de unos
+		SampleSet pos, neg;
+		for(unsigned length=1; length<=5; length++)
+		{
+			for(unsigned bits=0; bits<(1u << length); bits++)
+			{
+				unsigned sample[5], ones = 0;
+				for(unsigned i=0; i<length; i++) ones += sample[i] = (bits >> i) & 1;
+				if(ones % 2 == 0) pos.Add(sample, sample + length);
+				else neg.Add(sample, sample + length);
+			}
+		}
+		pos.Deduplicate();
+		neg.Deduplicate();
+
+		// los resultados no dependen de la cantidad de hilos y cada muestra se prueba una vez
+		CrossValidator validator;
+		validator.Folds = 3;
+		validator.Models = 3;
+		validator.Configure = [](OilTrainer& trainer){ trainer.ShowProgress = false; };
+		vector<CrossValidator::TFoldResult> results[2];
+		for(unsigned jobs=1; jobs<=2; jobs++)
+		{
+			srand(5);
+			validator.Jobs = jobs;
+			results[jobs - 1] = validator.Run(pos, neg, 2);
+		}
+		unsigned long long p = 0, n = 0;
+		for(unsigned f=0; f<validator.Folds; f++)
+		{
+			assert(results[0][f].TruePositives == results[1][f].TruePositives);
+			assert(results[0][f].TrueNegatives == results[1][f].TrueNegatives);
+			assert(results[0][f].Positives == results[1][f].Positives);
+			assert(results[0][f].TruePositives <= results[0][f].Positives);
+			p += results[0][f].Positives;
+			n += results[0][f].Negatives;
+		}
+		assert(p == pos.GetTotalWeight() && n == neg.GetTotalWeight());
+
+		// un pliegue sin negativas no tendria especificidad ni MCC
+		SampleSet fewNegatives;
+		fewNegatives.SetAlphabetLength(2);
+		for(size_t i=0; i<validator.Folds - 1; i++) fewNegatives.Add(neg[i]);
+		try
+		{
+			validator.Run(pos, fewNegatives, 2);
+			assert(false);
+		}
+		catch(const runtime_error&)
+		{
+		}
+	}
+
+	void Test19()
+	{
+		// a* b sobre {a, b}: positivas a^n b, negativas el resto hasta longitud 3
+		fastoil_symbol symbols[] = {1, 0, 1, 0, 0, 1, 0, 1, 0, 1, 1, 0, 0, 0};
+		size_t offsets[] = {0, 1, 3, 6, 7, 9, 11, 14};
+		unsigned char labels[] = {1, 1, 1, 0, 0, 0, 0};
+		fastoil_train_options options;
+		fastoil_train_options_init(&options);
+		options.models = 3;
+		options.seed = 1;
+		fastoil_model* model = NULL;
+		assert(fastoil_train(symbols, offsets, labels, 7, 2, &options, &model) == FASTOIL_OK);
+		assert(fastoil_model_count(model) == 3 && fastoil_model_alphabet_length(model) == 2);
+
+		// el comite reconstruido desde memoria clasifica igual que el entrenado
+		fastoil_model* copy = NULL;
+		assert(fastoil_model_create(&copy) == FASTOIL_OK);
+		for(size_t j=0; j<fastoil_model_count(model); j++)
+		{
+			char* data;
+			size_t size;
+			assert(fastoil_model_write(model, j, &data, &size) == FASTOIL_OK);
+			assert(fastoil_model_read(copy, data, size) == FASTOIL_OK);
+			fastoil_free(data);
+		}
+		unsigned char classes[7], copyClasses[7];
+		unsigned votes[7];
+		assert(fastoil_classify(model, symbols, offsets, 7, classes, votes, 1) == FASTOIL_OK);
+		assert(fastoil_classify(copy, symbols, offsets, 7, copyClasses, NULL, 3) == FASTOIL_OK);
+		for(int i=0; i<7; i++)
+		{
+			assert(classes[i] == labels[i] && copyClasses[i] == labels[i]);
+			assert(votes[i] == (labels[i] ? 3u : 0u));
+		}
+
+		// los errores se informan por codigo y mensaje
+		fastoil_symbol invalid[] = {2};
+		size_t invalidOffsets[] = {0, 1};
+		assert(fastoil_classify(model, invalid, invalidOffsets, 1, classes, NULL, 1) == FASTOIL_ERROR);
+		assert(string(fastoil_last_error()) == "Simbolo fuera del alfabeto");
+		fastoil_model_free(copy);
+		fastoil_model_free(model);
+	}
+
+	void Test20()
+	{
+		// 3 modelos: positivas con 3, 2 y 1 votos, negativas con 2, 0 y 0 votos
+		VoteHistogram histogram(3), other(3);
+		histogram.Add(true, 3);
+		histogram.Add(true, 2);
+		histogram.Add(false, 2);
+		other.Add(true, 1);
+		other.Add(false, 0);
+		other.Add(false, 0);
+		histogram.Merge(other);
+		assert(histogram.GetPositives() == 3 && histogram.GetNegatives() == 3);
+		assert(histogram.TruePositives(0) == 3 && histogram.TrueNegatives(0) == 2);
+		assert(histogram.TruePositives(1) == 2 && histogram.TrueNegatives(1) == 2);
+		assert(histogram.TruePositives(3) == 0 && histogram.TrueNegatives(3) == 3);
+		// pares positiva-negativa ordenados: 7 de 9 y un empate
+		assert(fabs(histogram.Auc() - 7.5 / 9) < 1e-12);
+	}
+
+	void Test21()
+	{
+		// 1000 estados en un ciclo con el simbolo 0 y saltos con el simbolo 1
+		ostringstream text;
+		text << "# Alfabeto\n2\n# Numero de estados\n1000\n# Estados iniciales\n0 \n# Estados finales\n999 \n";
+		text << "# Descripcion de las transiciones\n2000\n";
+		for(unsigned i=0; i<1000; i++) text << i << " " << (i + 1) % 1000 << " 0\n" << i << " " << (i * 7) % 1000 << " 1\n";
+		istringstream input(text.str());
+		auto nfa = NfaDotExporter::ImportDestinoPlainText(input);
+
+		// el espacio reservado es el de la cabecera, sin duplicar por crecimiento
+		assert(nfa.GetActiveStateCount() == 1000);
+		assert(nfa.GetMaxStates() < 2 * 1000);
+		assert(nfa.ExistTransition(999, 0, 0) && nfa.ExistTransition(3, 21, 1) && !nfa.ExistTransition(3, 21, 0));
+		ostringstream output, again;
+		NfaDotExporter::ExportDestinoPlainText(nfa, output);
+		istringstream exported(output.str());
+		NfaDotExporter::ExportDestinoPlainText(NfaDotExporter::ImportDestinoPlainText(exported), again);
+		assert(output.str() == again.str() && output.str().find("\n2000\n") != string::npos);
+
+		// las transiciones deben referir estados de la cabecera
+		istringstream invalid("2\n3\n0\n2\n1\n0 3 1\n");
+		try
+		{
+			NfaDotExporter::ImportDestinoPlainText(invalid);
+			assert(false);
+		}
+		catch(const runtime_error&)
+		{
+		}
+	}
+
+	// Un entrenador con varios hilos debe poder entrenar mas de una vez
+	void Test22()
+	{
+		OilTrainer::TSamples vpos, vneg;
+		makeTrainerSamples(vpos, vneg);
+
+		OilTrainer trainer;
+		trainer.Threads = 3;
+		trainer.SpeculativeStates = 4;
+		srand(22);
+		auto nfa1 = trainer.Train(vpos, vneg, 4);
+		srand(22);
+		auto nfa2 = trainer.Train(vpos, vneg, 4);
+		assert(_sameNfa(*nfa1, *nfa2));
+		delete nfa1;
+		delete nfa2;
+
+		// los hilos de un conjunto reiniciado esperan la siguiente tarea aunque tarden en arrancar
+		WorkerPool pool;
+		atomic<unsigned> runs(0);
+		for(int round=0; round<2; round++)
+		{
+			pool.Start(3);
+			this_thread::sleep_for(chrono::milliseconds(20));
+			pool.Run([&](unsigned){ runs++; });
+			pool.Stop();
+		}
+		assert(runs == 6);
+	}
+
+	// Reanudar desde un punto de control debe obtener el mismo modelo que sin interrupcion
+	void Test23()
+	{
+		OilTrainer::TSamples vpos, vneg;
+		makeTrainerSamples(vpos, vneg);
+
+		OilTrainer full;
+		full.Seed = 23;
+		auto nfa1 = full.Train(vpos, vneg, 4);
+
+		// el punto de control queda despues de la tercera positiva
+		OilTrainer interrupted;
+		interrupted.Seed = 23;
+		interrupted.CheckpointFilename = "test23.checkpoint";
+		interrupted.CheckpointEverySamples = 3;
+		interrupted.CheckpointEverySeconds = 0;
+		delete interrupted.Train(vpos, vneg, 4);
+
+		OilTrainer resumed;
+		resumed.Seed = 23;
+		resumed.ResumeFilename = "test23.checkpoint";
+		auto nfa2 = resumed.Train(vpos, vneg, 4);
+		assert(_sameNfa(*nfa1, *nfa2));
+		delete nfa1;
+		delete nfa2;
+
+		// otra semilla u otras muestras con la misma cantidad no deben reanudarse
+		OilTrainer otherSeed;
+		otherSeed.Seed = 24;
+		otherSeed.ResumeFilename = "test23.checkpoint";
+		try
+		{
+			delete otherSeed.Train(vpos, vneg, 4);
+			assert(false);
+		}
+		catch(const runtime_error&)
+		{
+		}
+
+		auto changed = vpos;
+		changed[0].back() = 2;
+		OilTrainer otherSamples;
+		otherSamples.Seed = 23;
+		otherSamples.ResumeFilename = "test23.checkpoint";
+		try
+		{
+			delete otherSamples.Train(changed, vneg, 4);
+			assert(false);
+		}
+		catch(const runtime_error&)
+		{
+		}
+	}
+
+	// Un bloque de negativas rechazado no debe dejar muestras a medio agregar en la sesion
+	void Test24()
+	{
+		OilTrainer::TSamples vpos, vneg;
+		makeTrainerSamples(vpos, vneg);
+
+		OilTrainer trainer;
+		trainer.ConflictPolicy = OilTrainer::RejectConflicts;
+		trainer.BeginSession(4);
+		trainer.AddNegatives(OilTrainer::TSamples(vneg.begin(), vneg.begin()+2));
+		for(size_t i=0; i<3; i++) trainer.AddPositive(vpos[i]);
+
+		// la primera muestra del bloque es valida, la segunda la reconoce el modelo
+		OilTrainer::TSamples batch;
+		batch.push_back(vneg[4]);
+		batch.push_back(vpos[0]);
+		try
+		{
+			trainer.AddNegatives(batch);
+			assert(false);
+		}
+		catch(const runtime_error&)
+		{
+		}
+		assert(trainer.GetNegativeCount() == 2);
+
+		// la sesion sigue mezclando estados con el prefiltro consistente
+		for(size_t i=3; i<vpos.size(); i++) trainer.AddPositive(vpos[i]);
+		trainer.ConflictPolicy = OilTrainer::RetrainOnConflict;
+		trainer.AddNegatives(OilTrainer::TSamples(vneg.begin()+2, vneg.end()));
+		for(auto it=vpos.cbegin(); it!=vpos.cend(); ++it) assert(trainer.GetModel().IsMatch(*it));
+		for(auto it=vneg.cbegin(); it!=vneg.cend(); ++it) assert(!trainer.GetModel().IsMatch(*it));
+	}
+
+	// La actualizacion del prefiltro despues de una mezcla debe coincidir con recalcularlo
+	void Test25()
+	{
+		OilTrainer::TSamples vpos, vneg;
+		makeTrainerSamples(vpos, vneg);
+
+		// arbol de prefijos de las muestras positivas
+		Nfa nfa(4);
+		nfa.SetInitial(0);
+		unsigned states = 1;
+		for(auto it=vpos.cbegin(); it!=vpos.cend(); ++it)
+		{
+			unsigned current = 0;
+			for(auto sym=it->cbegin(); sym!=it->cend(); ++sym)
+			{
+				nfa.SetTransition(current, states, *sym);
+				current = states++;
+			}
+			nfa.SetFinal(current);
+		}
+
+		SampleSet negatives(vneg);
+		NegativePrefilter incremental;
+		incremental.SetSamples(negatives);
+		incremental.Update(nfa);
+		vector<Nfa::TToken> expected(nfa.GetMaxStates() / Nfa::BitsPerToken), actual(expected.size());
+		for(unsigned removed=states-1; removed>0; removed--)
+		{
+			unsigned kept = removed / 3;
+			nfa.Merge(kept, removed);
+			incremental.UpdateMerged(nfa, kept, removed);
+
+			NegativePrefilter full;
+			full.SetSamples(negatives);
+			full.Update(nfa);
+			for(unsigned st=0; st<removed; st++)
+			{
+				incremental.GetForbidden(st, &actual[0]);
+				full.GetForbidden(st, &expected[0]);
+				assert(actual == expected);
+			}
+		}
+	}
+
+	// Asignar sobre un automata existente lo reemplaza sin compartir memoria con el original
+	void Test26()
+	{
+		Nfa source(2);
+		source.SetInitial(0);
+		source.SetFinal(300);
+		for(unsigned i=0; i<300; i++) source.SetTransition(i, i+1, i % 2);
+
+		// otro alfabeto y otro tamano, con sus propias transiciones
+		Nfa target(3);
+		target.SetInitial(1);
+		target.SetFinal(2);
+		target.SetTransition(1, 2, 2);
+		{
+			Nfa copy = source;
+			target = copy;
+			copy.SetTransition(5, 0, 0);
+		}
+		target = target;
+		assert(target.GetAlphabetLenght() == 2 && _sameNfa(source, target));
+		assert(!target.ExistTransition(5, 0, 0) && !target.IsInitial(1));
+
+		// sobre un automata de las mismas dimensiones
+		Nfa same(2);
+		same.SetTransition(0, 1, 1);
+		same.SetFinal(1);
+		Nfa other(2);
+		other = same;
+		assert(_sameNfa(same, other));
+	}
+
+	// Una cadena de 1000 estados crece varias veces mas alla de los 256 estados iniciales
+	void Test27()
+	{
+		const unsigned states = 1000;
+		Nfa nfa(2);
+		nfa.SetInitial(0);
+		OilTrainer::TSample chain;
+		for(unsigned i=0; i+1<states; i++)
+		{
+			nfa.SetTransition(i, i+1, i % 2);
+			chain.push_back(i % 2);
+		}
+		nfa.SetFinal(states - 1);
+
+		assert(nfa.GetActiveStateCount() == states);
+		for(unsigned i=0; i+1<states; i++)
+		{
+			assert(nfa.ExistTransition(i, i+1, i % 2) && !nfa.ExistTransition(i, i+1, 1 - i % 2));
+			assert(!nfa.ExistTransition(i+1, i, i % 2));
+			assert(nfa.IsInitial(i) == (i == 0) && !nfa.IsFinal(i));
+		}
+		assert(nfa.IsMatch(chain));
+		chain.pop_back();
+		assert(!nfa.IsMatch(chain));
+		chain.push_back(0);
+		chain.back() = 1 - chain.back();
+		assert(!nfa.IsMatch(chain));
+	}
+
+	// Lectura, entrenamiento, sesiones y evaluacion por la interfaz C, como las usa el ejecutable
+	void Test28()
+	{
+		fastoil_generator_options generatorOptions;
+		fastoil_generator_options_init(&generatorOptions);
+		generatorOptions.states = 8;
+		generatorOptions.alphabet_length = 2;
+		generatorOptions.seed = 1;
+		fastoil_generator* generator = NULL;
+		assert(fastoil_generator_create(&generatorOptions, &generator) == FASTOIL_OK);
+		assert(fastoil_generator_write_samples(generator, "test28.sample", 60) == FASTOIL_OK);
+		fastoil_generator_free(generator);
+
+		fastoil_samples* samples = NULL;
+		fastoil_samples_info info;
+		assert(fastoil_samples_load("test28.sample", &samples) == FASTOIL_OK);
+		assert(fastoil_samples_describe(samples, &info) == FASTOIL_OK);
+		assert(info.alphabet_length == 2);
+		assert(info.positives + info.duplicate_positives == 30 && info.negatives + info.duplicate_negatives == 30);
+
+		// con procesos de trabajo el comite es el mismo, y cada automata se entrega al terminar
+		fastoil_train_options options;
+		fastoil_train_options_init(&options);
+		options.models = 3;
+		options.seed = 5;
+		fastoil_model* sequential = NULL;
+		fastoil_model* parallel = NULL;
+		unsigned trained = 0;
+		options.trained = [](void* context, unsigned, const fastoil_model* automaton)
+		{
+			assert(fastoil_model_count(automaton) == 1);
+			++*(unsigned*)context;
+		};
+		options.context = &trained;
+		assert(fastoil_train_samples(samples, &options, &sequential) == FASTOIL_OK);
+		options.workers = 2;
+		assert(fastoil_train_samples(samples, &options, &parallel) == FASTOIL_OK);
+		assert(trained == 6);
+		for(size_t j=0; j<3; j++)
+		{
+			char* data;
+			char* parallelData;
+			size_t size, parallelSize;
+			assert(fastoil_model_write(sequential, j, &data, &size) == FASTOIL_OK);
+			assert(fastoil_model_write(parallel, j, &parallelData, &parallelSize) == FASTOIL_OK);
+			assert(string(data, size) == string(parallelData, parallelSize));
+			fastoil_free(data);
+			fastoil_free(parallelData);
+		}
+
+		// el comite es consistente con sus muestras de entrenamiento, contadas con sus repeticiones
+		fastoil_evaluate_options evaluateOptions;
+		fastoil_evaluate_options_init(&evaluateOptions);
+		evaluateOptions.report = FASTOIL_REPORT_METRICS;
+		evaluateOptions.jobs = 3;
+		fastoil_evaluation evaluation;
+		assert(fastoil_evaluate(sequential, "test28.sample", "test28.report", &evaluateOptions, &evaluation) == FASTOIL_OK);
+		assert(evaluation.positives == 30 && evaluation.true_positives == 30);
+		assert(evaluation.negatives == 30 && evaluation.true_negatives == 30);
+		assert(evaluation.full_queries == 0);
+		evaluateOptions.early_vote = 1;
+		assert(fastoil_evaluate(sequential, "test28.sample", "test28.report", &evaluateOptions, &evaluation) == FASTOIL_OK);
+		assert(evaluation.true_positives == 30 && evaluation.true_negatives == 30);
+		assert(evaluation.full_queries == 180 && evaluation.queries <= evaluation.full_queries);
+
+		// una sesion nueva que recibe todas las muestras tambien es consistente con ellas
+		fastoil_train_options_init(&options);
+		options.seed = 5;
+		fastoil_session* session = NULL;
+		fastoil_session_update update;
+		assert(fastoil_session_create(2, &options, &session) == FASTOIL_OK);
+		assert(fastoil_session_add(session, samples, &update) == FASTOIL_OK);
+		assert(update.positives == info.positives && update.negatives == info.negatives);
+		fastoil_model* current = NULL;
+		assert(fastoil_session_model(session, &current) == FASTOIL_OK);
+		evaluateOptions.early_vote = 0;
+		assert(fastoil_evaluate(current, "test28.sample", "test28.report", &evaluateOptions, &evaluation) == FASTOIL_OK);
+		assert(evaluation.true_positives == 30 && evaluation.true_negatives == 30);
+
+		// una sesion solo acepta muestras de su alfabeto
+		fastoil_session* other = NULL;
+		assert(fastoil_session_create(3, &options, &other) == FASTOIL_OK);
+		assert(fastoil_session_add(other, samples, &update) == FASTOIL_ERROR);
+		assert(string(fastoil_last_error()) == "La longitud del alfabeto no corresponde a la de la sesion");
+
+		fastoil_session_free(other);
+		fastoil_model_free(current);
+		fastoil_session_free(session);
+		fastoil_model_free(parallel);
+		fastoil_model_free(sequential);
+		fastoil_samples_free(samples);
+	}
+
 	void AllTesting()
 	{	
 		list<function<void()>> s;
@@ -128,6 +971,27 @@ namespace Testing {
 		s.push_back(Test5);
 		s.push_back(Test6);
 		s.push_back(Test7);
+		s.push_back(Test8);
+		s.push_back(Test9);
+		s.push_back(Test10);
+		s.push_back(Test11);
+		s.push_back(Test12);
+		s.push_back(Test13);
+		s.push_back(Test14);
+		s.push_back(Test15);
+		s.push_back(Test16);
+		s.push_back(Test17);
+		s.push_back(Test18);
+		s.push_back(Test19);
+		s.push_back(Test20);
+		s.push_back(Test21);
+		s.push_back(Test22);
+		s.push_back(Test23);
+		s.push_back(Test24);
+		s.push_back(Test25);
+		s.push_back(Test26);
+		s.push_back(Test27);
+		s.push_back(Test28);
 		
 		int i=0;
 		for_each(s.begin(), s.end(), [&i](function<void()> t){
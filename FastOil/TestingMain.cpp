@@ -0,0 +1,10 @@
+#include "StdAfx.h"
+#include "Testing.h"
+
+// Ejecuta las pruebas internas. Enlaza los objetos de la biblioteca directamente porque
+// las pruebas usan clases que libfastoil.so no exporta
+int main(int argc, char* argv[])
+{
+	Testing::AllTesting();
+	return 0;
+}
@@ -0,0 +1,73 @@
+#include "StdAfx.h"
+#include "VoteHistogram.h"
+
+using namespace std;
+
+VoteHistogram::VoteHistogram(size_t models)
+	: positives(models + 1, 0), negatives(models + 1, 0)
+{
+}
+
+void VoteHistogram::Add(bool isPositive, size_t votes)
+{
+	assert(votes < positives.size());
+	(isPositive ? positives : negatives)[votes]++;
+}
+
+void VoteHistogram::Merge(const VoteHistogram& other)
+{
+	assert(other.positives.size() == positives.size());
+	for(size_t v=0; v<positives.size(); v++)
+	{
+		positives[v] += other.positives[v];
+		negatives[v] += other.negatives[v];
+	}
+}
+
+unsigned long long VoteHistogram::GetPositives() const
+{
+	unsigned long long total = 0;
+	for(size_t v=0; v<positives.size(); v++) total += positives[v];
+	return total;
+}
+
+unsigned long long VoteHistogram::GetNegatives() const
+{
+	unsigned long long total = 0;
+	for(size_t v=0; v<negatives.size(); v++) total += negatives[v];
+	return total;
+}
+
+/** Positivas reconocidas por mas de threshold modelos
+*/
+unsigned long long VoteHistogram::TruePositives(size_t threshold) const
+{
+	unsigned long long total = 0;
+	for(size_t v=threshold+1; v<positives.size(); v++) total += positives[v];
+	return total;
+}
+
+/** Negativas reconocidas por a lo sumo threshold modelos
+*/
+unsigned long long VoteHistogram::TrueNegatives(size_t threshold) const
+{
+	unsigned long long total = 0;
+	for(size_t v=0; v<=threshold && v<negatives.size(); v++) total += negatives[v];
+	return total;
+}
+
+/** Area bajo la curva ROC de los umbrales: probabilidad de que una positiva reciba mas
+    votos que una negativa, los empates cuentan la mitad
+*/
+double VoteHistogram::Auc() const
+{
+	double pairs = (double)GetPositives() * GetNegatives();
+	if(pairs == 0) return 0;
+	double below = 0, sum = 0;
+	for(size_t v=0; v<positives.size(); v++)
+	{
+		sum += positives[v] * (below + negatives[v] / 2.0);
+		below += negatives[v];
+	}
+	return sum / pairs;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <vector>
+
+/** Cantidad de muestras positivas y negativas por cantidad de votos positivos de un
+    comite de N modelos. Basta para obtener las metricas de todos los umbrales sin volver
+	a evaluar las muestras: con el umbral t una muestra se clasifica como positiva si mas
+	de t modelos la reconocen. Con N impar, t = N/2 es la votacion por mayoria
+*/
+class VoteHistogram
+{
+	std::vector<unsigned long long> positives;
+	std::vector<unsigned long long> negatives;
+
+public:
+	void Add(bool isPositive, size_t votes);
+	void Merge(const VoteHistogram& other);
+	size_t GetModelCount() const { return positives.size() - 1; }
+	unsigned long long GetPositives() const;
+	unsigned long long GetNegatives() const;
+	unsigned long long TruePositives(size_t threshold) const;
+	unsigned long long TrueNegatives(size_t threshold) const;
+	double Auc() const;
+
+	explicit VoteHistogram(size_t models = 0);
+};
@@ -0,0 +1,117 @@
+#include "StdAfx.h"
+#include "WorkerPool.h"
+
+using namespace std;
+
+/** Inicia count hilos en total, contando al llamador de Run(). Los hilos nuevos parten
+    de la generacion actual, que se conserva entre Stop() y Start()
+*/
+void WorkerPool::Start(unsigned count)
+{
+	Stop();
+	unsigned current;
+	{
+		lock_guard<std::mutex> lock(mutex);
+		stopping = false;
+		current = generation;
+	}
+	for(unsigned w=1; w<count; w++)
+	{
+		threads.push_back(thread(&WorkerPool::WorkerLoop, this, w, current));
+	}
+}
+
+/** Detiene y espera a todos los hilos
+*/
+void WorkerPool::Stop()
+{
+	{
+		lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for(auto it=threads.begin(); it!=threads.end(); ++it) it->join();
+	threads.clear();
+}
+
+/** Ejecuta la tarea en todos los hilos y espera que terminen. Si algun hilo
+    lanza una excepcion se relanza en el llamador
+*/
+void WorkerPool::Run(const TTask& t)
+{
+	if(threads.empty())
+	{
+		t(0);
+		return;
+	}
+	{
+		lock_guard<std::mutex> lock(mutex);
+		task = &t;
+		pending = (unsigned)threads.size();
+		error = exception_ptr();
+		generation++;
+	}
+	wake.notify_all();
+
+	exception_ptr localError;
+	try
+	{
+		t(0);
+	}
+	catch(...)
+	{
+		localError = current_exception();
+	}
+
+	unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [this]{ return pending == 0; });
+	task = NULL;
+	if(localError) rethrow_exception(localError);
+	if(error) rethrow_exception(error);
+}
+
+void WorkerPool::WorkerLoop(unsigned worker, unsigned seen)
+{
+	for(;;)
+	{
+		const TTask* current;
+		{
+			unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&]{ return stopping || generation != seen; });
+			if(stopping) return;
+			seen = generation;
+			current = task;
+		}
+
+		exception_ptr localError;
+		try
+		{
+			(*current)(worker);
+		}
+		catch(...)
+		{
+			localError = current_exception();
+		}
+
+		lock_guard<std::mutex> lock(mutex);
+		if(localError && !error) error = localError;
+		if(--pending == 0) done.notify_one();
+	}
+}
+
+/** Cantidad de hilos, incluido el llamador
+*/
+unsigned WorkerPool::GetCount() const
+{
+	return (unsigned)threads.size() + 1;
+}
+
+WorkerPool::WorkerPool()
+	: task(NULL), generation(0), pending(0), stopping(false)
+{
+}
+
+WorkerPool::~WorkerPool()
+{
+	Stop();
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+
+/** Conjunto fijo de hilos que ejecutan una misma tarea en paralelo.
+    Run() entrega la tarea a todos los hilos, incluido el llamador que actua como
+	el hilo 0, y retorna cuando todos terminaron. Los hilos se conservan entre
+	llamadas para no crearlos en cada ronda de trabajo
+*/
+class WorkerPool
+{
+public:
+	typedef std::function<void(unsigned worker)> TTask;
+
+private:
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	const TTask* task;
+	unsigned generation;
+	unsigned pending;
+	bool stopping;
+	std::exception_ptr error;
+
+	void WorkerLoop(unsigned worker, unsigned seen);
+
+public:
+	void Start(unsigned count);
+	void Stop();
+	void Run(const TTask& task);
+	unsigned GetCount() const;
+
+	WorkerPool();
+	~WorkerPool();
+};
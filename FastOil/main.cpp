@@ -1,260 +1,643 @@
 #include "stdafx.h"
-#include "Nfa.h"
-#include "SamplesReader.h"
-#include "OilTrainer.h"
-#include "NfaDotExporter.h"
-#include "Testing.h"
+#include "FastOilApi.h"
+#include <sstream>
+#include <memory>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
 
 using namespace std;
 using boost::starts_with;
 using boost::lexical_cast;
 
+// Objetos de la interfaz C que se liberan al salir del alcance
+typedef unique_ptr<fastoil_model, void(*)(fastoil_model*)> TModel;
+typedef unique_ptr<fastoil_samples, void(*)(fastoil_samples*)> TSamples;
+typedef unique_ptr<fastoil_session, void(*)(fastoil_session*)> TSession;
+typedef unique_ptr<fastoil_generator, void(*)(fastoil_generator*)> TGenerator;
+
+// Obtiene el maximo de memoria residente usada por el proceso en bytes
+size_t PeakMemoryBytes()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if(!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+	return counters.PeakWorkingSetSize;
+#else
+	struct rusage usage;
+	if(getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+	return (size_t)usage.ru_maxrss;
+#else
+	return (size_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+// Opciones de entrenamiento obtenidas de la linea de comandos
+struct TrainOptions
+{
+	bool showProgress;
+	bool showMerges;
+	bool skipSearch;
+	bool noRandom;
+	bool noPrefilter;
+	unsigned prefilterMemory;
+	int customSeed;
+	string checkpointFilename;
+	unsigned checkpointEverySamples;
+	unsigned checkpointEverySeconds;
+	string resumeFilename;
+	int conflictPolicy;
+	string profileFilename;
+	unsigned threads;
+	unsigned speculativeStates;
+	unsigned workers;
+	double timeBudget;
+};
+
+// Convierte un error de la interfaz C en una excepcion con su descripcion
+void Check(int status)
+{
+	if(status != FASTOIL_OK) throw runtime_error(fastoil_last_error());
+}
+
+// Obtiene las opciones de entrenamiento de la interfaz C; las cadenas apuntan a las de options
+fastoil_train_options ApiTrainOptions(const TrainOptions& options)
+{
+	fastoil_train_options api;
+	fastoil_train_options_init(&api);
+	api.seed = options.customSeed;
+	api.show_progress = options.showProgress;
+	api.show_merges = options.showMerges;
+	api.skip_search = options.skipSearch;
+	api.no_random = options.noRandom;
+	api.no_prefilter = options.noPrefilter;
+	api.prefilter_memory = options.prefilterMemory;
+	api.checkpoint = options.checkpointFilename.empty() ? NULL : options.checkpointFilename.c_str();
+	api.checkpoint_samples = options.checkpointEverySamples;
+	api.checkpoint_seconds = options.checkpointEverySeconds;
+	api.resume = options.resumeFilename.empty() ? NULL : options.resumeFilename.c_str();
+	api.conflict_policy = options.conflictPolicy;
+	api.profile = options.profileFilename.empty() ? NULL : options.profileFilename.c_str();
+	api.threads = options.threads;
+	api.speculative_states = options.speculativeStates;
+	api.workers = options.workers;
+	api.time_budget = options.timeBudget;
+	return api;
+}
+
+// Lee las muestras de entrenamiento sin repeticiones e informa las repetidas; las contradictorias son un error
+TSamples ReadTrainingSamples(string samplesFilename)
+{
+	fastoil_samples* loaded = NULL;
+	Check(fastoil_samples_load(samplesFilename.c_str(), &loaded));
+	TSamples samples(loaded, fastoil_samples_free);
+	fastoil_samples_info info;
+	Check(fastoil_samples_describe(samples.get(), &info));
+	if(info.duplicate_positives > 0 || info.duplicate_negatives > 0)
+	{
+		cout << "Muestras repetidas: " << info.duplicate_positives << " positivas, " << info.duplicate_negatives << " negativas" << endl;
+	}
+	return samples;
+}
+
+// Guarda el automata index del comite en texto plano y en formato dot
+void SaveModel(const fastoil_model* model, size_t index, string modelFilename)
+{
+	Check(fastoil_model_save_dot(model, index, (modelFilename+".dot").c_str()));
+	Check(fastoil_model_save(model, index, modelFilename.c_str()));
+}
+
 // Entrena un solo modelo
-void TrainSingle(string samplesFilename, string modelFilename, bool showProgress, bool showMerges, bool skipSearch, bool noRandom)
+void TrainSingle(string samplesFilename, string modelFilename, const TrainOptions& options)
 {
 	cout << "Cargando muestras" << endl;
-	SamplesReader reader;
-	SamplesReader::TSamples pos, neg;
-	unsigned alpha;
-	reader.ReadSamples(samplesFilename, pos, neg, &alpha);
+	auto samples = ReadTrainingSamples(samplesFilename);
 
 	cout << "Entrenando modelo" << endl;
-	OilTrainer trainer;
-	trainer.ShowProgress = showProgress;
-	trainer.ShowMerges = showMerges;
-	trainer.SkipSearchBestMerge = skipSearch;
-	trainer.DoNotUseRandomSort = noRandom;
-	trainer.ShowPossibleMerges = showMerges;
-	auto ndfa = trainer.Train(pos, neg, alpha);
+	auto api = ApiTrainOptions(options);
+	// un solo modelo no usa procesos de trabajo
+	api.workers = 0;
+	fastoil_model* trained = NULL;
+	Check(fastoil_train_samples(samples.get(), &api, &trained));
+	TModel model(trained, fastoil_model_free);
 
 	cout << "Exportando modelo" << endl;
-	NfaDotExporter::Export(*ndfa, modelFilename+".dot");
-	NfaDotExporter::ExportDestinoPlainText(*ndfa, modelFilename);
-	delete ndfa;
+	SaveModel(model.get(), 0, modelFilename);
 }
 
-// Entrena un conjunto de modelos
-void TrainMultiple(string samplesFilename, string modelsManifestFilename, int count, bool showProgress, bool showMerges, bool skipSearch, bool noRandom, int customSeed)
+// Actualiza un modelo de entrenamiento incremental con nuevas muestras.
+// Si el archivo de sesion no existe se inicia una sesion nueva
+void TrainUpdate(string sessionFilename, string samplesFilename, string modelFilename, const TrainOptions& options)
 {
-	ofstream manifest(modelsManifestFilename);
-	if(!manifest.is_open())
+	cout << "Cargando muestras" << endl;
+	auto samples = ReadTrainingSamples(samplesFilename);
+	fastoil_samples_info info;
+	Check(fastoil_samples_describe(samples.get(), &info));
+
+	auto api = ApiTrainOptions(options);
+	fastoil_session* opened = NULL;
+	if(ifstream(sessionFilename).is_open())
 	{
-		throw runtime_error("No fue posible abrir el archivo de manifiesto");
+		cout << "Cargando sesion" << endl;
+		Check(fastoil_session_load(sessionFilename.c_str(), &api, &opened));
 	}
-	manifest << "# Manifiesto de clasificador" << endl;
-	manifest << "# Los siguientes archivos de modelos referenciados" << endl;
-	string modelFilename;	
-	for(int i=0; i<count; i++)
+	else
 	{
-		modelFilename = string("automata-") + lexical_cast<string>(i) + ".auto";
-		TrainSingle(samplesFilename, modelFilename, showProgress, showMerges, skipSearch, noRandom);
-		manifest << modelFilename << endl;
-		cout << "Progreso global: modelo " << i << " (" << ((i+1)*100/count) << "%)" << endl;
+		cout << "Iniciando sesion nueva" << endl;
+		Check(fastoil_session_create(info.alphabet_length, &api, &opened));
 	}
-	manifest.close();
+	TSession session(opened, fastoil_session_free);
+
+	// primero las negativas para que las nuevas positivas las respeten
+	cout << "Agregando " << info.negatives << " muestras negativas" << endl;
+	cout << "Agregando " << info.positives << " muestras positivas" << endl;
+	fastoil_session_update update;
+	Check(fastoil_session_add(session.get(), samples.get(), &update));
+	if(update.retrained) cout << "El modelo fue reentrenado por muestras negativas en conflicto" << endl;
+	if(update.ignored_negatives > 0) cout << "Muestras negativas descartadas: " << update.ignored_negatives << endl;
+	cout << "Muestras positivas que modificaron el modelo: " << update.changes << endl;
+	cout << "Total de la sesion: " << update.positives << " positivas, " << update.negatives << " negativas" << endl;
+
+	cout << "Guardando sesion" << endl;
+	Check(fastoil_session_save(session.get(), sessionFilename.c_str()));
+
+	cout << "Exportando modelo" << endl;
+	fastoil_model* current = NULL;
+	Check(fastoil_session_model(session.get(), &current));
+	TModel model(current, fastoil_model_free);
+	SaveModel(model.get(), 0, modelFilename);
 }
 
-// Prueba una muestra con el clasificador NDFA
-int TestSample(ofstream& report, size_t n, const Nfa& model, const SamplesReader::TSample& sample)
+// Nombre del archivo del modelo i de un conjunto de modelos
+string MultipleModelFilename(int i)
 {
-	auto c = model.IsMatch(sample);		
-	report << "Evaluation # " << n << " class: " << c << endl;
-	return c == true ? 1 : 0;
+	return string("automata-") + lexical_cast<string>(i) + ".auto";
 }
 
-// Escribe los resultados de un experimento
-void ReportMetric(ostream& report, int tp, int tn, int totalP, int totalN)
+// Avance de train_multiple. Los errores se guardan porque no pueden atravesar la interfaz C
+struct TMultipleProgress
 {
-	auto fp = totalP - tp;
-	auto fn = totalN - tn;
-	auto acc = (tp + tn)/(float)(totalP + totalN);
-	auto sens = tp/(float)totalP;
-	auto spec = tn/(float)totalN;
-	auto mcc = (tp*tn - fp*fn)/sqrt((float)(tp+fp)*(tp+fn)*(tn+fp)*(tn+fn));
-
-	// informa resultado
-	report << "True Positives: " << tp << ", True Negatives: " << tn << endl;	
-	report << "Total Samples: " << (totalP + totalN) << ", Total P-samples: " << totalP << ", Total N-samples: " << totalN << endl;
-	report << "Accuracy: " << acc << ", Sensitivity: " << sens << ", Specificity: " << spec << ", MCC: " << mcc << endl;
-}
+	unsigned Count;
+	unsigned Finished;
+	string Error;
+};
 
-// Evalua un modelo en un conjunto de muestras
-void TestSingle(string samplesFilename, string modelFilename, string reportFilename)
-{	
-	SamplesReader::TSamples pos, neg;
-	cout << "Cargando modelo." << endl;
-	auto model = NfaDotExporter::ImportDestinoPlainText(modelFilename);
-
-	cout << "Cargando archivo de muestras." << endl;
-	SamplesReader reader;
-	
-	unsigned alpha;
-	reader.ReadSamples(samplesFilename, pos, neg, &alpha);
-		
-	ofstream report(reportFilename);
-	if(!report.is_open())
+// Exporta cada modelo de train_multiple en cuanto termina e informa el avance global
+void ExportTrained(void* context, unsigned index, const fastoil_model* automaton)
+{
+	auto progress = (TMultipleProgress*)context;
+	auto modelFilename = MultipleModelFilename(index);
+	if(fastoil_model_save_dot(automaton, 0, (modelFilename+".dot").c_str()) != FASTOIL_OK ||
+		fastoil_model_save(automaton, 0, modelFilename.c_str()) != FASTOIL_OK)
 	{
-		throw runtime_error("Error abriendo el archivo de reporte");
+		if(progress->Error.empty()) progress->Error = fastoil_last_error();
 		return;
 	}
+	progress->Finished++;
+	cout << "Progreso global: modelo " << index << " (" << (progress->Finished*100/progress->Count) << "%)" << endl;
+}
 
-	cout << "Evaluando..." << endl;
-
-	int pc = 0, nc = 0;
-	report << "Muestras Positivas" << endl;
-	for(size_t i = 0; i < pos.size(); i++)
-	{
-		auto r = TestSample(report, i, model, pos[i]);		
-		if(r == 1) pc++;
-	}
-	report << "Muestras Negativas" << endl;
-	for(size_t i=0; i<neg.size(); i++)
+// Entrena un conjunto de modelos. Con --workers los modelos se entrenan en procesos de
+// trabajo que comparten una sola copia de las muestras
+void TrainMultiple(string samplesFilename, string modelsManifestFilename, int count, const TrainOptions& options)
+{
+	ofstream manifest(modelsManifestFilename);
+	if(!manifest.is_open())
 	{
-		auto r = TestSample(report, i, model, neg[i]);		
-		if(r == 0) nc++;
+		throw runtime_error("No fue posible abrir el archivo de manifiesto");
 	}
+	manifest << "# Manifiesto de clasificador" << endl;
+	manifest << "# Los siguientes archivos de modelos referenciados" << endl;
+
+	cout << "Cargando muestras" << endl;
+	auto samples = ReadTrainingSamples(samplesFilename);
 
-	ReportMetric(cout, pc, nc, (int)pos.size(), (int)neg.size());
-	ReportMetric(report, pc, nc, (int)pos.size(), (int)neg.size());
+	// con --seed el comite es el mismo con y sin procesos de trabajo, y el de fastoil_train
+	TMultipleProgress progress = { (unsigned)count, 0, "" };
+	auto api = ApiTrainOptions(options);
+	api.models = count;
+	api.trained = ExportTrained;
+	api.context = &progress;
+	fastoil_model* trained = NULL;
+	Check(fastoil_train_samples(samples.get(), &api, &trained));
+	fastoil_model_free(trained);
+	if(!progress.Error.empty()) throw runtime_error(progress.Error);
 
-	report.close();
+	for(int i=0; i<count; i++) manifest << MultipleModelFilename(i) << endl;
+	manifest.close();
 }
 
-// Lee los modelos indicados en el manifiesto
-void ReadManifest(string manifestFilename, vector<string>& models)
+// Escribe en la salida estandar las metricas de una evaluacion
+void ReportMetric(const fastoil_evaluation& evaluation)
 {
-	ifstream manifest(manifestFilename);
-	if(!manifest.is_open())
+	char* text = NULL;
+	size_t size;
+	Check(fastoil_evaluation_format(&evaluation, &text, &size));
+	cout << text;
+	fastoil_free(text);
+}
+
+// Carga un modelo o, con manifest, los modelos indicados en el manifiesto como un comite
+TModel LoadModels(string filename, bool manifest, ostream& log)
+{
+	fastoil_model* loaded = NULL;
+	if(manifest)
 	{
-		throw runtime_error("Error with manifest file");
-		return;
+		log << "Cargando manifiesto." << endl;
+		Check(fastoil_ensemble_load(filename.c_str(), &loaded));
 	}
-	string line;
-	while(!manifest.eof())
+	else
 	{
-		getline(manifest, line);
-		boost::trim(line);
-		if(line.size() == 0 || line[0] == '#') continue;
-		models.push_back(line);
+		Check(fastoil_model_load(filename.c_str(), &loaded));
 	}
-	manifest.close();
+	TModel models(loaded, fastoil_model_free);
+	if(manifest) log << "Cargados " << fastoil_model_count(models.get()) << " modelos" << endl;
+	return models;
 }
 
+// Evalua un comite de modelos sobre las muestras del archivo y escribe el reporte en el
+// formato FASTOIL_REPORT_*, ver fastoil_evaluate(). Con earlyVote cada muestra consulta
+// los modelos solo hasta que la mayoria queda decidida. Las muestras se reparten entre
+// jobs hilos y el reporte no depende de la cantidad de hilos
+void EvaluateModels(string samplesFilename, const fastoil_model* models, string reportFilename, int format, bool earlyVote, bool auc, unsigned jobs)
+{
+	fastoil_evaluate_options options;
+	fastoil_evaluate_options_init(&options);
+	options.report = format;
+	options.early_vote = earlyVote;
+	options.auc = auc;
+	options.jobs = jobs;
+
+	cout << "Evaluando..." << endl;
+	fastoil_evaluation evaluation;
+	Check(fastoil_evaluate(models, samplesFilename.c_str(), reportFilename.c_str(), &options, &evaluation));
+	ReportMetric(evaluation);
+	if(evaluation.full_queries > 0 && fastoil_model_count(models) > 1)
+	{
+		cout << "Modelos consultados: " << evaluation.queries << " de " << evaluation.full_queries << " (" << (evaluation.queries * 100 / evaluation.full_queries) << "%)" << endl;
+	}
+}
+
+// Evalua un modelo en un conjunto de muestras
+void TestSingle(string samplesFilename, string modelFilename, string reportFilename, int format, bool auc, unsigned jobs)
+{	
+	cout << "Cargando modelo." << endl;
+	auto models = LoadModels(modelFilename, false, cout);
+	EvaluateModels(samplesFilename, models.get(), reportFilename, format, false, auc, jobs);
+}
 
 // Evalua un conjunto de modelos sobre un conjunto de muestras
-void TestMultiple(string samplesFilename, string modelsManifestFilename, string reportFilename)
+void TestMultiple(string samplesFilename, string modelsManifestFilename, string reportFilename, int format, bool earlyVote, bool auc, unsigned jobs)
 {
-	SamplesReader::TSamples pos, neg;
-	vector<Nfa> models;
-		
-	// Carga modelos del clasificador
+	auto models = LoadModels(modelsManifestFilename, true, cout);
+	EvaluateModels(samplesFilename, models.get(), reportFilename, format, earlyVote, auc, jobs);
+}
+
+// Obtiene las metricas de todos los umbrales desde una matriz de votos escrita con
+// --report=binary o --report=csv, sin volver a evaluar las muestras
+void SweepVoteMatrix(string matrixFilename, string reportFilename, bool auc)
+{
+	fastoil_evaluation evaluation;
+	Check(fastoil_sweep(matrixFilename.c_str(), reportFilename.c_str(), auc, &evaluation));
+	ReportMetric(evaluation);
+}
+
+// Clasifica muestras sin etiqueta con un modelo o un comite cargado una sola vez. La
+// salida estandar puede ser el canal de respuestas, los mensajes van a la salida de errores
+void Serve(string modelFilename, vector<string>::const_iterator optBegin, vector<string>::const_iterator optEnd)
+{
+	bool manifest = false;
+	string socketPath;
+	fastoil_serve_options options;
+	fastoil_serve_options_init(&options);
+	for_each(optBegin, optEnd, [&](string opt)
 	{
-		cout << "Cargando manifiesto." << endl;
-		vector<string> modelFiles;
-		ReadManifest(modelsManifestFilename, modelFiles);
-		for(auto i = modelFiles.begin(); i!=modelFiles.end(); i++)
-		{			
-			auto model = NfaDotExporter::ImportDestinoPlainText(*i);
-			models.push_back(model);
-			cout << "Modelo \"" << *i << "\" cargado." << endl;
-		}
-		cout << "Cargados " << models.size() << " modelos" << endl;
-	}
-	
-	cout << "Cargando archivo de muestras." << endl;
-	SamplesReader reader;
-	
-	unsigned alpha;
-	reader.ReadSamples(samplesFilename, pos, neg, &alpha);
-
-	ofstream report(reportFilename);
-	if(!report.is_open())
+		if(opt == "--manifest") manifest = true;
+		else if(opt == "--votes") options.votes = 1;
+		else if(boost::starts_with(opt, "--socket=")) socketPath = opt.substr(9);
+		else if(boost::starts_with(opt, "--threads=")) options.threads = lexical_cast<unsigned>(opt.substr(10));
+		else if(boost::starts_with(opt, "--batch=")) options.batch = lexical_cast<size_t>(opt.substr(8));
+		else if(boost::starts_with(opt, "--batch-latency=")) options.batch_latency = lexical_cast<unsigned>(opt.substr(16));
+		else throw runtime_error("Opcion de serve desconocida: " + opt);
+	});
+
+	auto models = LoadModels(modelFilename, manifest, cerr);
+	if(socketPath.empty())
 	{
-		throw runtime_error("Error abriendo el archivo de reporte");		
+		cerr << "Atendiendo la entrada estandar" << endl;
 	}
-	
-	cout << "Evaluando..." << endl;
-	
-	// el umbral se fija en la mitad entera del numero de modelos	
-	auto threshold = models.size() / 2;
-	int pc = 0, nc = 0;
-	report << "Muestras Positivas" << endl;
-	for(size_t i = 0; i < pos.size(); i++)
+	else
 	{
-		unsigned answerCounter = 0;
-		for(auto j=models.begin(); j != models.end(); j++)
-		{
-			auto rj = TestSample(report, i, *j, pos[i]);
-			// cuenta los modelos que votan por "positiva"
-			if(rj == 1) answerCounter++; 
-		}		
-		// si mas de la mitad de los votos son por "positiva"
-		if(answerCounter > threshold) pc++; 
+		cerr << "Atendiendo el socket " << socketPath << endl;
+		options.socket = socketPath.c_str();
 	}
-	report << "Muestras Negativas" << endl;
-	for(size_t i=0; i<neg.size(); i++)
+	Check(fastoil_serve(models.get(), &options));
+}
+
+// Procesa los argumentos del generador de muestras
+void ParseGenerateOptions(vector<string>::const_iterator optBegin, vector<string>::const_iterator optEnd, fastoil_generator_options* generator, string* targetFilename)
+{
+	assert(generator != NULL);
+	assert(targetFilename != NULL);
+
+	for_each(optBegin, optEnd, [generator, targetFilename](string opt)
 	{
-		unsigned answerCounter = 0;
-		for(auto j=models.begin(); j != models.end(); j++)
-		{
-			auto r = TestSample(report, i, *j, neg[i]);		
-			// cuenta los modelos que votan por "negativa"
-			if(r == 0) answerCounter++;
-		}
-		// si mas de la mitad de los votos son por "negativa"
-		if(answerCounter > threshold) nc++;
+		if(opt == "--nfa") generator->deterministic = 0;
+		else if(opt == "--dfa") generator->deterministic = 1;
+		else if(boost::starts_with(opt, "--density=")) generator->density = lexical_cast<double>(opt.substr(10));
+		else if(boost::starts_with(opt, "--final-ratio=")) generator->final_ratio = lexical_cast<double>(opt.substr(14));
+		else if(boost::starts_with(opt, "--min-length=")) generator->min_length = lexical_cast<unsigned>(opt.substr(13));
+		else if(boost::starts_with(opt, "--max-length=")) generator->max_length = lexical_cast<unsigned>(opt.substr(13));
+		else if(boost::starts_with(opt, "--length-mean=")) generator->length_mean = lexical_cast<double>(opt.substr(14));
+		else if(boost::starts_with(opt, "--length-sd=")) generator->length_sd = lexical_cast<double>(opt.substr(12));
+		else if(boost::starts_with(opt, "--seed=")) generator->seed = lexical_cast<int>(opt.substr(7));
+		else if(boost::starts_with(opt, "--target=")) *targetFilename = opt.substr(9);
+	});
+}
+
+// Crea el generador de muestras y su automata objetivo aleatorio
+TGenerator CreateGenerator(const fastoil_generator_options& options)
+{
+	fastoil_generator* created = NULL;
+	Check(fastoil_generator_create(&options, &created));
+	return TGenerator(created, fastoil_generator_free);
+}
+
+// Genera un archivo de muestras sintetico a partir de un automata objetivo aleatorio
+void Generate(string samplesFilename, unsigned states, unsigned alpha, unsigned count, vector<string>::const_iterator optBegin, vector<string>::const_iterator optEnd)
+{
+	fastoil_generator_options options;
+	fastoil_generator_options_init(&options);
+	options.states = states;
+	options.alphabet_length = alpha;
+	string targetFilename;
+	ParseGenerateOptions(optBegin, optEnd, &options, &targetFilename);
+
+	cout << "Generando automata objetivo de " << states << " estados" << endl;
+	auto generator = CreateGenerator(options);
+	if(!targetFilename.empty())
+	{
+		fastoil_model* target = NULL;
+		Check(fastoil_generator_target(generator.get(), &target));
+		TModel model(target, fastoil_model_free);
+		Check(fastoil_model_save(model.get(), 0, targetFilename.c_str()));
 	}
 
-	// informa resultado
-	ReportMetric(cout, pc, nc, (int)pos.size(), (int)neg.size());
-	ReportMetric(report, pc, nc, (int)pos.size(), (int)neg.size());
+	cout << "Generando " << count << " muestras" << endl;
+	Check(fastoil_generator_write_samples(generator.get(), samplesFilename.c_str(), count));
+}
 
-	report.close();
+// Convierte una lista separada por comas "8,16,32"
+vector<unsigned> ParseList(string list)
+{
+	vector<string> splits;
+	boost::split(splits, list, [](char c){ return c == ','; });
+	vector<unsigned> values;
+	for(auto it=splits.cbegin(); it!=splits.cend(); ++it)
+	{
+		values.push_back(lexical_cast<unsigned>(*it));
+	}
+	return values;
 }
 
 // Procesa los argumentos para obtener la configuracion
-void ParseTrainOptions(vector<string>::const_iterator optBegin, vector<string>::const_iterator optEnd, bool* showProgress, bool* showMerges, bool* skipSearch, bool* noRandom, int* customSeed)
+void ParseTrainOptions(vector<string>::const_iterator optBegin, vector<string>::const_iterator optEnd, TrainOptions* options)
 {
-	assert(showProgress != NULL);
-	assert(showMerges != NULL);
-	assert(skipSearch != NULL);
-	assert(noRandom != NULL);
-	assert(customSeed != NULL);
-
-	*showProgress = true;
-	*showMerges = false;
-	*skipSearch = false;
-	*noRandom = false;
-	*customSeed = -1;
-
-	for_each(optBegin, optEnd, [skipSearch, noRandom, showMerges, customSeed](string opt) 
+	assert(options != NULL);
+
+	options->showProgress = true;
+	options->showMerges = false;
+	options->skipSearch = false;
+	options->noRandom = false;
+	options->noPrefilter = false;
+	options->prefilterMemory = 1024;
+	options->customSeed = -1;
+	options->checkpointFilename = "";
+	options->checkpointEverySamples = 0;
+	options->checkpointEverySeconds = 600;
+	options->resumeFilename = "";
+	options->conflictPolicy = FASTOIL_CONFLICT_RETRAIN;
+	options->profileFilename = "";
+	options->threads = 0;
+	options->speculativeStates = 0;
+	options->workers = 0;
+	options->timeBudget = 0;
+
+	for_each(optBegin, optEnd, [options](string opt) 
 	{
 		if(opt == "--skip-search")
 		{
-			*skipSearch = true;		
+			options->skipSearch = true;		
 			cout << "Omitir la busqueda" << endl;
 		}
 		else if(opt == "--no-random")
 		{
-			*noRandom = true;
+			options->noRandom = true;
 			cout << "No realizar mezcla en orden aleatorio" << endl;
 		} 
+		else if(opt == "--no-prefilter")
+		{
+			options->noPrefilter = true;
+			cout << "No usar el prefiltro de muestras negativas" << endl;
+		}
+		else if(boost::starts_with(opt, "--prefilter-memory="))
+		{
+			options->prefilterMemory = lexical_cast<unsigned>(opt.substr(19));
+			cout << "Memoria maxima del prefiltro: " << options->prefilterMemory << " MB" << endl;
+		}
 		else if(opt == "-v")
 		{
-			*showMerges = true;
+			options->showMerges = true;
 			cout << "Mostrar mezclas" << endl;
 		}
 		else if(boost::starts_with(opt, "--seed="))
 		{
-			*customSeed = lexical_cast<int>(opt.substr(7));
-			cout << "Semilla personalizada: " << (*customSeed) << endl;
+			options->customSeed = lexical_cast<int>(opt.substr(7));
+			cout << "Semilla personalizada: " << options->customSeed << endl;
+		}
+		else if(boost::starts_with(opt, "--checkpoint="))
+		{
+			options->checkpointFilename = opt.substr(13);
+			cout << "Punto de control: " << options->checkpointFilename << endl;
+		}
+		else if(boost::starts_with(opt, "--checkpoint-samples="))
+		{
+			options->checkpointEverySamples = lexical_cast<unsigned>(opt.substr(21));
+			cout << "Punto de control cada " << options->checkpointEverySamples << " muestras" << endl;
+		}
+		else if(boost::starts_with(opt, "--checkpoint-seconds="))
+		{
+			options->checkpointEverySeconds = lexical_cast<unsigned>(opt.substr(21));
+			cout << "Punto de control cada " << options->checkpointEverySeconds << " segundos" << endl;
+		}
+		else if(boost::starts_with(opt, "--resume="))
+		{
+			options->resumeFilename = opt.substr(9);
+			cout << "Reanudar desde: " << options->resumeFilename << endl;
+		}
+		else if(boost::starts_with(opt, "--profile="))
+		{
+			options->profileFilename = opt.substr(10);
+			cout << "Perfil de entrenamiento: " << options->profileFilename << endl;
+		}
+		else if(boost::starts_with(opt, "--threads="))
+		{
+			options->threads = lexical_cast<unsigned>(opt.substr(10));
+			cout << "Hilos de entrenamiento: " << options->threads << endl;
+		}
+		else if(boost::starts_with(opt, "--speculate="))
+		{
+			options->speculativeStates = lexical_cast<unsigned>(opt.substr(12));
+			cout << "Estados evaluados por adelantado: " << options->speculativeStates << endl;
+		}
+		else if(boost::starts_with(opt, "--workers="))
+		{
+			options->workers = lexical_cast<unsigned>(opt.substr(10));
+			cout << "Procesos de entrenamiento: " << options->workers << endl;
+		}
+		else if(boost::starts_with(opt, "--time-budget="))
+		{
+			options->timeBudget = lexical_cast<double>(opt.substr(14));
+			cout << "Presupuesto de tiempo: " << options->timeBudget << " segundos" << endl;
+		}
+		else if(boost::starts_with(opt, "--on-conflict="))
+		{
+			auto policy = opt.substr(14);
+			if(policy == "retrain") options->conflictPolicy = FASTOIL_CONFLICT_RETRAIN;
+			else if(policy == "ignore") options->conflictPolicy = FASTOIL_CONFLICT_IGNORE;
+			else if(policy == "error") options->conflictPolicy = FASTOIL_CONFLICT_REJECT;
+			else throw runtime_error("Politica de conflicto invalida: " + policy);
+			cout << "Politica de conflicto: " << policy << endl;
 		}
 	});
 }
 
+// Validacion cruzada de k pliegues: lee las muestras una vez, entrena en memoria el comite
+// de cada pliegue con los demas y lo evalua sobre el pliegue. Informa las metricas de cada
+// pliegue y las de todos los pliegues juntos
+void CrossValidate(string samplesFilename, vector<string>::const_iterator optBegin, vector<string>::const_iterator optEnd)
+{
+	unsigned folds = 10;
+	unsigned models = 1;
+	unsigned jobs = 0;
+	for_each(optBegin, optEnd, [&](string opt)
+	{
+		if(boost::starts_with(opt, "--folds=")) folds = lexical_cast<unsigned>(opt.substr(8));
+		else if(boost::starts_with(opt, "--models=")) models = lexical_cast<unsigned>(opt.substr(9));
+		else if(boost::starts_with(opt, "--jobs=")) jobs = lexical_cast<unsigned>(opt.substr(7));
+	});
+	TrainOptions options;
+	ParseTrainOptions(optBegin, optEnd, &options);
+	if(!options.checkpointFilename.empty() || !options.resumeFilename.empty())
+	{
+		throw runtime_error("Los puntos de control solo estan disponibles con train_single");
+	}
+	if(options.workers > 0 || !options.profileFilename.empty())
+	{
+		throw runtime_error("La validacion cruzada no admite --workers ni --profile");
+	}
+
+	cout << "Cargando muestras" << endl;
+	auto samples = ReadTrainingSamples(samplesFilename);
+
+	// los entrenamientos paralelos no muestran su progreso, solo el avance de los pliegues
+	auto api = ApiTrainOptions(options);
+	api.models = models;
+	cout << "Validacion cruzada: " << folds << " pliegues, " << models << " modelos por pliegue" << endl;
+	vector<fastoil_evaluation> results(folds);
+	Check(fastoil_crossvalidate(samples.get(), folds, jobs, &api, results.data()));
+
+	fastoil_evaluation all = fastoil_evaluation();
+	for(unsigned f=0; f<folds; f++)
+	{
+		cout << "Pliegue " << f << ":" << endl;
+		ReportMetric(results[f]);
+		all.true_positives += results[f].true_positives;
+		all.true_negatives += results[f].true_negatives;
+		all.positives += results[f].positives;
+		all.negatives += results[f].negatives;
+	}
+	cout << "Todos los pliegues:" << endl;
+	ReportMetric(all);
+}
+
+// Mide entrenamiento y evaluacion de extremo a extremo sobre una malla de problemas
+// sinteticos. Escribe una fila CSV por cada punto de la malla
+void Benchmark(string resultsFilename, vector<string>::const_iterator optBegin, vector<string>::const_iterator optEnd)
+{
+	vector<unsigned> statesGrid(1, 16), alphaGrid(1, 4), samplesGrid(1, 500);
+	unsigned models = 3;
+	unsigned seed = 1;
+	for_each(optBegin, optEnd, [&](string opt)
+	{
+		if(boost::starts_with(opt, "--states=")) statesGrid = ParseList(opt.substr(9));
+		else if(boost::starts_with(opt, "--alphabets=")) alphaGrid = ParseList(opt.substr(12));
+		else if(boost::starts_with(opt, "--samples=")) samplesGrid = ParseList(opt.substr(10));
+		else if(boost::starts_with(opt, "--models=")) models = lexical_cast<unsigned>(opt.substr(9));
+		else if(boost::starts_with(opt, "--seed=")) seed = lexical_cast<unsigned>(opt.substr(7));
+	});
+	TrainOptions options;
+	ParseTrainOptions(optBegin, optEnd, &options);
+	options.showProgress = false;
+	// sin --seed el comite de cada punto se entrena con la semilla de la malla
+	if(options.customSeed == -1) options.customSeed = (int)seed;
+
+	// el maximo de memoria es el del proceso hasta cada punto, por eso la malla se
+	// recorre en orden creciente
+	sort(statesGrid.begin(), statesGrid.end());
+	sort(alphaGrid.begin(), alphaGrid.end());
+	sort(samplesGrid.begin(), samplesGrid.end());
+
+	ofstream results(resultsFilename);
+	if(!results.is_open())
+	{
+		throw runtime_error("No fue posible crear el archivo de resultados");
+	}
+	results << "states,alphabet,samples,models,train_seconds,test_seconds,peak_rss_mb,train_samples_per_second,test_evaluations_per_second" << endl;
+
+	for(auto st=statesGrid.cbegin(); st!=statesGrid.cend(); ++st)
+	for(auto al=alphaGrid.cbegin(); al!=alphaGrid.cend(); ++al)
+	for(auto sa=samplesGrid.cbegin(); sa!=samplesGrid.cend(); ++sa)
+	{
+		cout << "Punto: " << *st << " estados, alfabeto " << *al << ", " << *sa << " muestras" << endl;
+		fastoil_generator_options generatorOptions;
+		fastoil_generator_options_init(&generatorOptions);
+		generatorOptions.states = *st;
+		generatorOptions.alphabet_length = *al;
+		string ignoredTarget;
+		ParseGenerateOptions(optBegin, optEnd, &generatorOptions, &ignoredTarget);
+		generatorOptions.seed = (int)seed;
+		// las muestras de prueba siguen a las de entrenamiento en la secuencia del generador
+		auto generator = CreateGenerator(generatorOptions);
+		Check(fastoil_generator_write_samples(generator.get(), "benchmark-train.sample", *sa));
+		Check(fastoil_generator_write_samples(generator.get(), "benchmark-test.sample", *sa));
+
+		auto t0 = chrono::steady_clock::now();
+		TrainMultiple("benchmark-train.sample", "benchmark.manifest", models, options);
+		auto t1 = chrono::steady_clock::now();
+		// votacion completa, sin votacion temprana: la columna de evaluaciones por segundo cuenta todos los modelos
+		TestMultiple("benchmark-test.sample", "benchmark.manifest", "benchmark.report", FASTOIL_REPORT_TEXT, false, false, 1);
+		auto t2 = chrono::steady_clock::now();
+
+		double trainSeconds = chrono::duration_cast<chrono::microseconds>(t1 - t0).count() / 1e6;
+		double testSeconds = chrono::duration_cast<chrono::microseconds>(t2 - t1).count() / 1e6;
+		double peakMb = PeakMemoryBytes() / (1024.0 * 1024.0);
+		results << *st << "," << *al << "," << *sa << "," << models << "," << trainSeconds << "," << testSeconds << "," << peakMb << ","
+			<< (*sa * models) / trainSeconds << "," << (*sa * models) / testSeconds << endl;
+	}
+	results.close();
+}
+
 int main(int argc, char* argv[])
 {
-	//Testing::AllTesting(); return 0;
 	try
 	{
 		if(argc < 2)
@@ -271,36 +654,119 @@ int main(int argc, char* argv[])
 
 		bool trainSingle = arguments[0] == "train_single";
 		bool trainMultiple = arguments[0] == "train_multiple";
+		bool trainUpdate = arguments[0] == "train_update";
 		bool testSingle = arguments[0] == "test_single";
 		bool testMultiple = arguments[0] == "test_multiple";
+		bool generate = arguments[0] == "generate";
+		bool benchmark = arguments[0] == "benchmark";
+		bool sweep = arguments[0] == "sweep";
+		bool serve = arguments[0] == "serve";
+		bool crossval = arguments[0] == "crossval";
 		bool help = arguments[0] == "help";
 
 		if(help)
 		{
 			cout
 				<< "Construye modelos por el algoritmo Order Independent Language (OIL)" << endl
-				<< "\tFastOIL {help|train_single|train_multiple|test_single|test_multiple} <options>" << endl
+				<< "\tFastOIL {help|train_single|train_multiple|train_update|test_single|test_multiple|sweep|serve|crossval|generate|benchmark} <options>" << endl
 				<< "Options:" << endl
 				<< endl
 				<< "help" <<endl
 				<< "\tMuestra este mensaje de ayuda" << endl
 				<< endl
-				<< "train_single <samples> <model> [--skip-search] [--no-random] [--seed=N] [-v]" << endl
+				<< "train_single <samples> <model> [--skip-search] [--no-random] [--no-prefilter] [--prefilter-memory=MB] [--seed=N] [-v] [--profile=<file>]" << endl
+				<< "\t[--threads=N] [--speculate=K] [--time-budget=S] [--checkpoint=<file>] [--checkpoint-samples=N] [--checkpoint-seconds=M] [--resume=<file>]" << endl
 				<< "\tEntrena a partir de las muestras del archivo <samples> un solo" << endl
 				<< "\tmodelo y lo guarda en el archivo <model>" << endl
 				<< endl
-				<< "train_multiple <samples> <models-manifest> <count> [--skip-search] [--no-random] [--seed=N] [-v]" << endl
+				<< "train_multiple <samples> <models-manifest> <count> [--skip-search] [--no-random] [--no-prefilter] [--prefilter-memory=MB] [--seed=N] [-v] [--profile=<file>]" << endl
+				<< "\t[--threads=N] [--speculate=K] [--time-budget=S] [--workers=N]" << endl
 				<< "\tEntrena a partir de las muestras del archivo <samples> varios modelos" << endl
-				<< "\tque pueden ser utilizados como un comite de expertos" << endl
+				<< "\tque pueden ser utilizados como un comite de expertos. Con" << endl
+				<< "\t--workers=N los modelos se entrenan en N procesos que leen una" << endl
+				<< "\tsola copia de las muestras en memoria compartida. Los modelos" << endl
+				<< "\tson los mismos que sin --workers con la misma semilla" << endl
+				<< endl
+				<< "train_update <session> <samples> <model> [--on-conflict={retrain|ignore|error}] [--skip-search] [--no-random] [--seed=N] [-v] [--profile=<file>]" << endl
+				<< "\tAgrega las muestras del archivo <samples> a la sesion de" << endl
+				<< "\tentrenamiento incremental <session> (se crea si no existe)." << endl
+				<< "\tSolo las muestras positivas que el modelo no reconoce lo" << endl
+				<< "\tmodifican. Guarda la sesion y exporta el modelo en <model>." << endl
+				<< "\tSi el modelo reconoce una nueva muestra negativa se reentrena" << endl
+				<< "\tdesde cero (retrain), se descarta la muestra (ignore) o se" << endl
+				<< "\taborta (error)" << endl
 				<< endl
-				<< "test_single <samples> <model> <report>" << endl
+				<< "test_single <samples> <model> <report> [--report=text|csv|binary|metrics|sweep] [--auc] [--jobs=N]" << endl
 				<< "\tEvalua el modelo desde el archivo <model> en el conjunto de" << endl
 				<< "\tmuestras <samples>" << endl
 				<< endl
-				<< "test_multiple <samples> <models-manifest> <report>" << endl
+				<< "test_multiple <samples> <models-manifest> <report> [--early-vote] [--report=text|csv|binary|metrics|sweep] [--auc] [--jobs=N]" << endl
 				<< "\tEvalua multiples modelos indicados en el archivo de manifiesto" << endl
 				<< "\t<models-manifest> con las muestras en el archivo <samples>." << endl
-				<< "\tEscribe los resultados en el archivo <report>" << endl
+				<< "\tEscribe los resultados en el archivo <report>. Cada muestra" << endl
+				<< "\tconsulta todos los modelos en el orden del manifiesto. Con" << endl
+				<< "\t--early-vote consulta los modelos solo hasta que la mayoria" << endl
+				<< "\tqueda decidida, empezando por los de menor costo y mayor" << endl
+				<< "\tacuerdo con el comite; el reporte en texto indica el modelo" << endl
+				<< "\tde cada voto y omite los modelos no consultados" << endl
+				<< endl
+				<< "\tEn ambas pruebas --report elige el contenido de <report>: text" << endl
+				<< "\t(por defecto) una linea por voto y las metricas, csv la matriz" << endl
+				<< "\tde votos con una fila \"etiqueta,voto0,...\" por muestra, binary" << endl
+				<< "\tla misma matriz con cabecera \"FOVM\", la cantidad de modelos en" << endl
+				<< "\t32 bits y por muestra un byte de etiqueta y un bit por modelo," << endl
+				<< "\tmetrics solo las metricas y sweep las metricas de cada umbral" << endl
+				<< "\tt de 0 a N: una muestra es positiva si mas de t de los N" << endl
+				<< "\tmodelos la reconocen. --auc agrega el area bajo la curva ROC." << endl
+				<< "\tLas matrices y sweep consultan todos los modelos" << endl
+				<< endl
+				<< "\tLa opcion --jobs=N reparte las muestras entre N hilos (0: tantos" << endl
+				<< "\tcomo nucleos). El reporte es el mismo con cualquier N" << endl
+				<< endl
+				<< "sweep <votes> <report> [--auc]" << endl
+				<< "\tEscribe en <report> las metricas de cada umbral, como" << endl
+				<< "\t--report=sweep, a partir de la matriz de votos <votes> escrita" << endl
+				<< "\tpor una prueba con --report=binary o --report=csv, sin volver" << endl
+				<< "\ta evaluar las muestras" << endl
+				<< endl
+				<< "serve <model> [--manifest] [--socket=<path>] [--threads=N] [--batch=N] [--batch-latency=US] [--votes]" << endl
+				<< "\tCarga una vez el modelo <model> (o los modelos del manifiesto" << endl
+				<< "\t<model> con --manifest) y clasifica muestras sin etiqueta, una" << endl
+				<< "\tpor linea con el formato \"longitud s1 ... sn\", desde la entrada" << endl
+				<< "\testandar o desde las conexiones al socket Unix <path>. Responde" << endl
+				<< "\tuna linea por muestra en el mismo orden: 1 o 0 segun la mayoria" << endl
+				<< "\tde los votos, seguido de los votos positivos con --votes, o" << endl
+				<< "\t\"error: <motivo>\". Las muestras se evaluan en lotes de hasta N" << endl
+				<< "\tmuestras (--batch, por defecto 256) con --threads hilos; un lote" << endl
+				<< "\tincompleto espera a lo sumo US microsegundos desde su primera" << endl
+				<< "\tmuestra (--batch-latency, por defecto 200)" << endl
+				<< endl
+				<< "crossval <samples> [--folds=K] [--models=M] [--jobs=N] [--skip-search] [--no-random] [--no-prefilter] [--prefilter-memory=MB] [--seed=N]" << endl
+				<< "\t[--threads=N] [--speculate=K] [--time-budget=S]" << endl
+				<< "\tValidacion cruzada de K pliegues (por defecto 10) sobre las" << endl
+				<< "\tmuestras de <samples>. Cada pliegue se evalua con un comite de" << endl
+				<< "\tM modelos (por defecto 1) entrenados con los demas pliegues." << endl
+				<< "\tLas muestras se leen una vez y los modelos se entrenan en" << endl
+				<< "\tmemoria con N hilos (por defecto tantos como nucleos), sin" << endl
+				<< "\tarchivos intermedios. Informa las metricas de cada pliegue y" << endl
+				<< "\tlas de todos juntos. Con la misma semilla el resultado es el" << endl
+				<< "\tmismo con cualquier N" << endl
+				<< endl
+				<< "generate <samples> <states> <alphabet> <count> [--dfa|--nfa] [--density=D] [--final-ratio=R]" << endl
+				<< "\t[--min-length=N] [--max-length=N] [--length-mean=M --length-sd=S] [--seed=N] [--target=<file>]" << endl
+				<< "\tGenera <count> muestras (mitad positivas) etiquetadas por un" << endl
+				<< "\tautomata objetivo aleatorio de <states> estados y las escribe" << endl
+				<< "\ten <samples>. --nfa usa D transiciones medias por estado y simbolo." << endl
+				<< "\tLa longitud es uniforme en [min, max] o normal recortada si se" << endl
+				<< "\tindica --length-sd. --target guarda el automata objetivo" << endl
+				<< endl
+				<< "benchmark <results> [--states=L] [--alphabets=L] [--samples=L] [--models=N] [--seed=N] <options>" << endl
+				<< "\tPara cada combinacion de las listas L (ejemplo: 8,16,32) genera" << endl
+				<< "\tmuestras de entrenamiento y prueba, ejecuta train_multiple y" << endl
+				<< "\ttest_multiple y escribe en <results> (CSV) el tiempo, el maximo" << endl
+				<< "\tde memoria residente y el rendimiento. Acepta las opciones de" << endl
+				<< "\tgenerate y de entrenamiento. Usa archivos benchmark-* y" << endl
+				<< "\tautomata-*.auto en el directorio actual" << endl
 				<< endl
 				<< ">> Shared options:" << endl
 				<< "\tLa opcion --skip-search hace que el algoritmo omita la busqueda" << endl
@@ -316,7 +782,46 @@ int main(int argc, char* argv[])
 				<< "\tmodelos con mezcla de estados en orden aleatorio y conservar" << endl
 				<< "\tdeterminismo de los resultados de experimentacion" << endl
 				<< endl
+				<< "\tLa opcion --no-prefilter desactiva el prefiltro que descarta" << endl
+				<< "\tlas mezclas que con seguridad reconocen una muestra negativa" << endl
+				<< "\tsin ejecutarlas. El modelo obtenido es el mismo en ambos casos." << endl
+				<< "\tCon --prefilter-memory=MB el prefiltro se desactiva mientras" << endl
+				<< "\trequiera mas de MB megabytes (por defecto 1024, 0: sin limite)" << endl
+				<< endl
+				<< "\tLa opcion --threads=N evalua las mezclas candidatas con N hilos." << endl
+				<< "\tCon --speculate=K evalua por adelantado las mezclas de los" << endl
+				<< "\tsiguientes K estados nuevos (por defecto N) sobre el mismo" << endl
+				<< "\tmodelo y las confirma en orden. El modelo obtenido es el mismo" << endl
+				<< "\tque en modo secuencial. Con -v el entrenamiento es secuencial" << endl
+				<< endl
+				<< "\tLa opcion --time-budget=S limita cada entrenamiento a S segundos." << endl
+				<< "\tSi el ritmo medido no alcanza, acepta la primera mezcla valida" << endl
+				<< "\ten lugar de la mejor, luego evalua una muestra aleatoria cada" << endl
+				<< "\tvez menor de candidatas y al agotarse el tiempo deja de mezclar." << endl
+				<< "\tEl modelo siempre reconoce las positivas y rechaza las negativas." << endl
+				<< "\tCada concesion se informa en la salida" << endl
+				<< endl
 				<< "\tLa opcion -v muestra la mezcla de estados realizada" << endl
+				<< endl
+				<< "\tLa opcion --profile=<file> mide el tiempo de cada fase del" << endl
+				<< "\tentrenamiento (copia, mezcla, muestras negativas y positivas," << endl
+				<< "\tprefiltro, redimensionamiento) y los contadores de mezclas" << endl
+				<< "\tcandidatas. Escribe en <file> un registro por cada muestra" << endl
+				<< "\tpositiva que modifica el modelo, en JSON por lineas o en CSV" << endl
+				<< "\tsi <file> termina en .csv" << endl
+				<< endl
+				<< "\tLa opcion --checkpoint=<file> guarda el estado del entrenamiento" << endl
+				<< "\ten <file> cada N muestras positivas (--checkpoint-samples=N) o" << endl
+				<< "\tcada M segundos (--checkpoint-seconds=M, por defecto 600)." << endl
+				<< "\tLa opcion --resume=<file> continua un entrenamiento interrumpido" << endl
+				<< "\tcon el mismo resultado que si no se hubiera detenido. Se deben" << endl
+				<< "\tusar las mismas muestras y opciones, incluida --seed; si no" << endl
+				<< "\tcoinciden el punto de control se rechaza. Solo para train_single" << endl
+				<< endl
+				<< "\tLos archivos de muestras y de modelos pueden estar comprimidos" << endl
+				<< "\tcon gzip o zstd, el formato se reconoce por su contenido. Los" << endl
+				<< "\tmodelos y reportes que terminan en .gz o .zst se escriben" << endl
+				<< "\tcomprimidos" << endl
 				<< endl << endl
 #ifndef _NOT_USE_AVX256
 				<< "\tEsta compilacion requiere un procesador compatible con AVX-256" << endl
@@ -332,23 +837,43 @@ int main(int argc, char* argv[])
 			}
 			string samplesFilename = arguments[1];
 			string modelFilename = arguments[2];
-			bool showProgress, showMerges, skipSearch, noRandom;
-			int customSeed;
-			ParseTrainOptions(arguments.begin()+3, arguments.end(), &showProgress, &showMerges, &skipSearch, &noRandom, &customSeed);
-			auto t = customSeed == -1 ? time(NULL) : customSeed;	
-			srand((unsigned)t);
+			TrainOptions options;
+			ParseTrainOptions(arguments.begin()+3, arguments.end(), &options);
 			if(trainSingle) 
 			{
 				cout << "Entrenar modelo" << endl;				
-				TrainSingle(samplesFilename, modelFilename, showProgress, showMerges, skipSearch, noRandom);
+				TrainSingle(samplesFilename, modelFilename, options);
 			}
 			if (trainMultiple) 
 			{
 				cout << "Entrenar multiples modelos" << endl;
+				if(!options.checkpointFilename.empty() || !options.resumeFilename.empty())
+				{
+					throw runtime_error("Los puntos de control solo estan disponibles con train_single");
+				}
+				if(options.workers > 0 && !options.profileFilename.empty())
+				{
+					throw runtime_error("El perfil de entrenamiento no esta disponible con --workers");
+				}
 				int count = lexical_cast<int>(arguments[3]);
-				TrainMultiple(samplesFilename, modelFilename, count, showProgress, showMerges, skipSearch, noRandom, customSeed);
+				TrainMultiple(samplesFilename, modelFilename, count, options);
 			}
 		} 
+		else if(trainUpdate)
+		{
+			if(argc < 5)
+			{
+				cout << "Numero de argumentos incorrecto" << endl;
+				return 1;
+			}
+			string sessionFilename = arguments[1];
+			string samplesFilename = arguments[2];
+			string modelFilename = arguments[3];
+			TrainOptions options;
+			ParseTrainOptions(arguments.begin()+4, arguments.end(), &options);
+			cout << "Actualizar modelo incremental" << endl;
+			TrainUpdate(sessionFilename, samplesFilename, modelFilename, options);
+		}
 		else if(testSingle || testMultiple)
 		{
 			if(argc < 5)
@@ -359,9 +884,80 @@ int main(int argc, char* argv[])
 			string samplesFilename = arguments[1];
 			string modelFilename = arguments[2];
 			string reportFilename = arguments[3];
-			if(testSingle) TestSingle(samplesFilename, modelFilename, reportFilename);
-			if(testMultiple) TestMultiple(samplesFilename, modelFilename, reportFilename);
+			bool earlyVote = false;
+			bool auc = false;
+			int format = FASTOIL_REPORT_TEXT;
+			unsigned jobs = 1;
+			for_each(arguments.begin()+4, arguments.end(), [&](string opt)
+			{
+				if(opt == "--early-vote") earlyVote = true;
+				else if(opt == "--all-votes") earlyVote = false;
+				else if(opt == "--auc") auc = true;
+				else if(boost::starts_with(opt, "--jobs=")) jobs = lexical_cast<unsigned>(opt.substr(7));
+				else if(opt == "--report=text") format = FASTOIL_REPORT_TEXT;
+				else if(opt == "--report=csv") format = FASTOIL_REPORT_CSV;
+				else if(opt == "--report=binary") format = FASTOIL_REPORT_BINARY;
+				else if(opt == "--report=metrics") format = FASTOIL_REPORT_METRICS;
+				else if(opt == "--report=sweep") format = FASTOIL_REPORT_SWEEP;
+				else throw runtime_error("Opcion de prueba desconocida: " + opt);
+			});
+			if(testSingle) TestSingle(samplesFilename, modelFilename, reportFilename, format, auc, jobs);
+			if(testMultiple) TestMultiple(samplesFilename, modelFilename, reportFilename, format, earlyVote, auc, jobs);
 		} 
+		else if(generate)
+		{
+			if(argc < 6)
+			{
+				cout << "Numero de argumentos incorrecto" << endl;
+				return 1;
+			}
+			auto states = lexical_cast<unsigned>(arguments[2]);
+			auto alpha = lexical_cast<unsigned>(arguments[3]);
+			auto count = lexical_cast<unsigned>(arguments[4]);
+			Generate(arguments[1], states, alpha, count, arguments.begin()+5, arguments.end());
+		}
+		else if(serve)
+		{
+			if(argc < 3)
+			{
+				cout << "Numero de argumentos incorrecto" << endl;
+				return 1;
+			}
+			Serve(arguments[1], arguments.begin()+2, arguments.end());
+		}
+		else if(crossval)
+		{
+			if(argc < 3)
+			{
+				cout << "Numero de argumentos incorrecto" << endl;
+				return 1;
+			}
+			CrossValidate(arguments[1], arguments.begin()+2, arguments.end());
+		}
+		else if(sweep)
+		{
+			if(argc < 4)
+			{
+				cout << "Numero de argumentos incorrecto" << endl;
+				return 1;
+			}
+			bool auc = false;
+			for_each(arguments.begin()+3, arguments.end(), [&](string opt)
+			{
+				if(opt == "--auc") auc = true;
+				else throw runtime_error("Opcion de prueba desconocida: " + opt);
+			});
+			SweepVoteMatrix(arguments[1], arguments[2], auc);
+		}
+		else if(benchmark)
+		{
+			if(argc < 3)
+			{
+				cout << "Numero de argumentos incorrecto" << endl;
+				return 1;
+			}
+			Benchmark(arguments[1], arguments.begin()+2, arguments.end());
+		}
 		else 
 		{
 			if(arguments.size() > 0) 
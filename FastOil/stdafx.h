@@ -8,5 +8,9 @@
 #include <map>
 #include <algorithm>
 #include <ctime>
+#include <cstdio>
+#include <random>
+#include <chrono>
+#include <atomic>
 #include <boost/algorithm/string.hpp>
 #include <boost/lexical_cast.hpp>
\ No newline at end of file